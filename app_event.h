@@ -0,0 +1,33 @@
+#pragma once
+
+#include <opentok.h>
+#include <stdint.h>
+
+#include "stream_registry.h"
+
+enum class AppEventType {
+    SESSION_CONNECTED,
+    SESSION_DISCONNECTED,
+    SESSION_ERROR,
+    STREAM_RECEIVED,
+    STREAM_DROPPED,
+    SUBSCRIBER_ERROR,
+    PUBLISHER_STREAM_DESTROYED,
+    PUBLISHER_ERROR,
+};
+
+/**
+ * Something an SDK callback wants the main loop to know. Fixed size, so
+ * callbacks can post it without allocating.
+ */
+struct AppEvent {
+    static const int MAX_MESSAGE = 128;
+
+    AppEventType type;
+    // FramePacer::now_us() when posted, for callback to UI latency
+    int64_t posted_us;
+    StreamRegistry::Handle handle;
+    otc_subscriber* subscriber;
+    // Error text, or the stream ID for STREAM_RECEIVED
+    char message[MAX_MESSAGE];
+};
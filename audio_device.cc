@@ -0,0 +1,321 @@
+#include "audio_device.h"
+#include "audio_sink.h"
+#include "frame_pacer.h"
+#include "log.h"
+#include "trace.h"
+
+#include "imgui.h"
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <string.h>
+
+using namespace std;
+
+static const int64_t BLOCK_US = 10000;
+
+// Sleeps until the next 10 ms block is due. Audio must not lose time, so a
+// late thread catches up block by block unless it fell hopelessly behind.
+static void wait_next_block(int64_t* next_us) {
+    *next_us += BLOCK_US;
+    int64_t now = FramePacer::now_us();
+    if (*next_us > now) {
+        this_thread::sleep_for(chrono::microseconds(*next_us - now));
+    } else if (now - *next_us > 10 * BLOCK_US) {
+        *next_us = now;
+    }
+}
+
+AudioDevice::AudioDevice()
+    : sink(nullptr), tone(new int16_t[SAMPLE_RATE * CHANNELS]), renderer_initialized(false), rendering(false),
+      capturer_initialized(false), capturing(false), rendered_blocks(0), captured_blocks(0), overrun_samples(0) {
+    memset(&this->callbacks, 0, sizeof(this->callbacks));
+    this->callbacks.init = init;
+    this->callbacks.destroy = destroy;
+    this->callbacks.init_renderer = init_renderer;
+    this->callbacks.destroy_renderer = destroy_renderer;
+    this->callbacks.start_renderer = start_renderer;
+    this->callbacks.stop_renderer = stop_renderer;
+    this->callbacks.is_renderer_initialized = is_renderer_initialized;
+    this->callbacks.is_renderer_started = is_renderer_started;
+    this->callbacks.get_estimated_render_delay = get_estimated_render_delay;
+    this->callbacks.get_render_settings = get_render_settings;
+    this->callbacks.init_capturer = init_capturer;
+    this->callbacks.destroy_capturer = destroy_capturer;
+    this->callbacks.start_capturer = start_capturer;
+    this->callbacks.stop_capturer = stop_capturer;
+    this->callbacks.is_capturer_initialized = is_capturer_initialized;
+    this->callbacks.is_capturer_started = is_capturer_started;
+    this->callbacks.get_estimated_capture_delay = get_estimated_capture_delay;
+    this->callbacks.get_capture_settings = get_capture_settings;
+    this->callbacks.user_data = this;
+
+    // 100 ms of 880 Hz at -12 dBFS, then silence
+    for (int i = 0; i < SAMPLE_RATE; i++) {
+        int16_t sample = 0;
+        if (i < SAMPLE_RATE / 10) {
+            sample = static_cast<int16_t>(8192 * sin(2 * M_PI * 880 * i / SAMPLE_RATE));
+        }
+        for (int channel = 0; channel < CHANNELS; channel++) {
+            this->tone[i * CHANNELS + channel] = sample;
+        }
+    }
+    for (int i = 0; i < STREAM_COUNT; i++) {
+        this->rms[i].store(0.0f);
+        this->peak[i].store(0.0f);
+        this->shown_rms[i] = 0.0f;
+        this->held_peak[i] = 0.0f;
+        this->peak_held_until_us[i] = 0;
+    }
+}
+
+AudioDevice::~AudioDevice() {
+    this->stop_rendering();
+    this->stop_capturing();
+    delete this->sink;
+    delete[] this->tone;
+}
+
+bool AudioDevice::install(AudioSink* sink) {
+    if (otc_set_audio_device(&this->callbacks) != OTC_SUCCESS) {
+        LOG_ERROR("Could not install the custom audio device");
+        delete sink;
+        return false;
+    }
+    this->sink = sink;
+    LOG_INFO("Custom audio device playing out to %s", sink->name());
+    return true;
+}
+
+AudioLevels AudioDevice::levels(Stream stream) const {
+    AudioLevels levels;
+    levels.rms = this->rms[stream].load(memory_order_relaxed);
+    levels.peak = this->peak[stream].load(memory_order_relaxed);
+    return levels;
+}
+
+AudioDevice::Stats AudioDevice::stats() const {
+    Stats stats;
+    stats.rendered_blocks = this->rendered_blocks;
+    stats.captured_blocks = this->captured_blocks;
+    stats.overrun_samples = this->overrun_samples;
+    stats.sink_underruns = this->sink != nullptr ? this->sink->underruns() : 0;
+    stats.buffered_ms = static_cast<int>(this->ring.size() * 1000 / (SAMPLE_RATE * CHANNELS));
+    return stats;
+}
+
+void AudioDevice::publish_levels(Stream stream, const int16_t* samples, size_t count) {
+    AudioLevels levels = audio_levels(samples, count);
+    this->rms[stream].store(levels.rms, memory_order_relaxed);
+    this->peak[stream].store(levels.peak, memory_order_relaxed);
+}
+
+void AudioDevice::run_render() {
+    Trace::set_thread_name("audio render");
+    int16_t block[BLOCK_SAMPLES];
+    int64_t next_us = FramePacer::now_us();
+    while (this->rendering.load()) {
+        size_t samples = otc_audio_device_read_render_data(block, BLOCK_SAMPLES / CHANNELS) * CHANNELS;
+        this->publish_levels(PLAYOUT, block, samples);
+        size_t written = this->ring.write(block, samples);
+        if (written < samples) {
+            this->overrun_samples += samples - written;
+        }
+        this->rendered_blocks++;
+        wait_next_block(&next_us);
+    }
+}
+
+void AudioDevice::run_sink() {
+    Trace::set_thread_name("audio sink");
+    bool open = this->sink->open(SAMPLE_RATE, CHANNELS);
+    int16_t buffer[2 * BLOCK_SAMPLES];
+    while (this->rendering.load()) {
+        size_t samples = this->ring.read(buffer, 2 * BLOCK_SAMPLES);
+        if (samples == 0) {
+            this_thread::sleep_for(chrono::milliseconds(2));
+            continue;
+        }
+        // A sink that failed to open still drains the ring, playout carries on unheard
+        if (open && !this->sink->write(buffer, samples)) {
+            LOG_ERROR("Audio sink %s failed, dropping playout", this->sink->name());
+            this->sink->close();
+            open = false;
+        }
+    }
+    if (open) {
+        this->sink->close();
+    }
+}
+
+void AudioDevice::run_capture() {
+    Trace::set_thread_name("audio capture");
+    size_t position = 0;
+    int64_t next_us = FramePacer::now_us();
+    while (this->capturing.load()) {
+        const int16_t* block = this->tone + position;
+        otc_audio_device_write_capture_data(block, BLOCK_SAMPLES / CHANNELS);
+        this->publish_levels(CAPTURE, block, BLOCK_SAMPLES);
+        position = (position + BLOCK_SAMPLES) % (SAMPLE_RATE * CHANNELS);
+        this->captured_blocks++;
+        wait_next_block(&next_us);
+    }
+}
+
+void AudioDevice::stop_rendering() {
+    if (this->rendering.exchange(false)) {
+        this->render_thread.join();
+        this->sink_thread.join();
+        this->rms[PLAYOUT].store(0.0f);
+        this->peak[PLAYOUT].store(0.0f);
+    }
+}
+
+void AudioDevice::stop_capturing() {
+    if (this->capturing.exchange(false)) {
+        this->capture_thread.join();
+        this->rms[CAPTURE].store(0.0f);
+        this->peak[CAPTURE].store(0.0f);
+    }
+}
+
+void AudioDevice::draw() {
+    static const char* names[STREAM_COUNT] = { "Playout", "Capture" };
+    // Meters span -60 dBFS to full scale
+    static const float FLOOR_DB = -60.0f;
+
+    ImGui::Begin("Audio");
+    ImGui::Text("Sink: %s", this->sink->name());
+    int64_t now = FramePacer::now_us();
+    for (int i = 0; i < STREAM_COUNT; i++) {
+        AudioLevels levels = this->levels(static_cast<Stream>(i));
+        // Rise at once, fall back slowly like a VU needle
+        this->shown_rms[i] = max(levels.rms, this->shown_rms[i] * 0.85f);
+        if (levels.peak >= this->held_peak[i] || now > this->peak_held_until_us[i]) {
+            this->held_peak[i] = levels.peak;
+            this->peak_held_until_us[i] = now + 1500000;
+        }
+
+        float rms_db = audio_level_db(this->shown_rms[i]);
+        float peak_db = audio_level_db(this->held_peak[i]);
+        char overlay[64];
+        snprintf(overlay, sizeof(overlay), "%s  %.0f dBFS  peak %.0f", names[i], rms_db, peak_db);
+        ImGui::ProgressBar(max(0.0f, 1.0f - rms_db / FLOOR_DB), ImVec2(-1, 0), overlay);
+
+        ImVec2 bar_min = ImGui::GetItemRectMin();
+        ImVec2 bar_max = ImGui::GetItemRectMax();
+        float x = bar_min.x + (bar_max.x - bar_min.x) * max(0.0f, 1.0f - peak_db / FLOOR_DB);
+        ImGui::GetWindowDrawList()->AddLine(ImVec2(x, bar_min.y), ImVec2(x, bar_max.y), IM_COL32(255, 80, 80, 255), 2.0f);
+    }
+    Stats stats = this->stats();
+    ImGui::Text("Blocks: %llu out  %llu in  Buffered: %d ms",
+                (unsigned long long)stats.rendered_blocks, (unsigned long long)stats.captured_blocks,
+                stats.buffered_ms);
+    ImGui::Text("Overrun: %llu samples  Underruns: %llu",
+                (unsigned long long)stats.overrun_samples, (unsigned long long)stats.sink_underruns);
+    ImGui::End();
+}
+
+// SDK callbacks, from SDK threads
+
+otc_bool AudioDevice::init(const otc_audio_device* device, void* user_data) {
+    return OTC_TRUE;
+}
+
+otc_bool AudioDevice::destroy(const otc_audio_device* device, void* user_data) {
+    AudioDevice* self = static_cast<AudioDevice*>(user_data);
+    self->stop_rendering();
+    self->stop_capturing();
+    return OTC_TRUE;
+}
+
+otc_bool AudioDevice::init_renderer(const otc_audio_device* device, void* user_data) {
+    static_cast<AudioDevice*>(user_data)->renderer_initialized.store(true);
+    return OTC_TRUE;
+}
+
+otc_bool AudioDevice::destroy_renderer(const otc_audio_device* device, void* user_data) {
+    AudioDevice* self = static_cast<AudioDevice*>(user_data);
+    self->stop_rendering();
+    self->renderer_initialized.store(false);
+    return OTC_TRUE;
+}
+
+otc_bool AudioDevice::start_renderer(const otc_audio_device* device, void* user_data) {
+    AudioDevice* self = static_cast<AudioDevice*>(user_data);
+    if (!self->rendering.exchange(true)) {
+        self->sink_thread = std::thread(&AudioDevice::run_sink, self);
+        self->render_thread = std::thread(&AudioDevice::run_render, self);
+    }
+    return OTC_TRUE;
+}
+
+otc_bool AudioDevice::stop_renderer(const otc_audio_device* device, void* user_data) {
+    static_cast<AudioDevice*>(user_data)->stop_rendering();
+    return OTC_TRUE;
+}
+
+otc_bool AudioDevice::is_renderer_initialized(const otc_audio_device* device, void* user_data) {
+    return static_cast<AudioDevice*>(user_data)->renderer_initialized.load() ? OTC_TRUE : OTC_FALSE;
+}
+
+otc_bool AudioDevice::is_renderer_started(const otc_audio_device* device, void* user_data) {
+    return static_cast<AudioDevice*>(user_data)->rendering.load() ? OTC_TRUE : OTC_FALSE;
+}
+
+int AudioDevice::get_estimated_render_delay(const otc_audio_device* device, void* user_data) {
+    AudioDevice* self = static_cast<AudioDevice*>(user_data);
+    return static_cast<int>(BLOCK_US / 1000) + self->stats().buffered_ms;
+}
+
+otc_bool AudioDevice::get_render_settings(const otc_audio_device* device, void* user_data,
+                                          struct otc_audio_device_settings* settings) {
+    settings->number_of_channels = CHANNELS;
+    settings->sampling_rate = SAMPLE_RATE;
+    return OTC_TRUE;
+}
+
+otc_bool AudioDevice::init_capturer(const otc_audio_device* device, void* user_data) {
+    static_cast<AudioDevice*>(user_data)->capturer_initialized.store(true);
+    return OTC_TRUE;
+}
+
+otc_bool AudioDevice::destroy_capturer(const otc_audio_device* device, void* user_data) {
+    AudioDevice* self = static_cast<AudioDevice*>(user_data);
+    self->stop_capturing();
+    self->capturer_initialized.store(false);
+    return OTC_TRUE;
+}
+
+otc_bool AudioDevice::start_capturer(const otc_audio_device* device, void* user_data) {
+    AudioDevice* self = static_cast<AudioDevice*>(user_data);
+    if (!self->capturing.exchange(true)) {
+        self->capture_thread = std::thread(&AudioDevice::run_capture, self);
+    }
+    return OTC_TRUE;
+}
+
+otc_bool AudioDevice::stop_capturer(const otc_audio_device* device, void* user_data) {
+    static_cast<AudioDevice*>(user_data)->stop_capturing();
+    return OTC_TRUE;
+}
+
+otc_bool AudioDevice::is_capturer_initialized(const otc_audio_device* device, void* user_data) {
+    return static_cast<AudioDevice*>(user_data)->capturer_initialized.load() ? OTC_TRUE : OTC_FALSE;
+}
+
+otc_bool AudioDevice::is_capturer_started(const otc_audio_device* device, void* user_data) {
+    return static_cast<AudioDevice*>(user_data)->capturing.load() ? OTC_TRUE : OTC_FALSE;
+}
+
+int AudioDevice::get_estimated_capture_delay(const otc_audio_device* device, void* user_data) {
+    return static_cast<int>(BLOCK_US / 1000);
+}
+
+otc_bool AudioDevice::get_capture_settings(const otc_audio_device* device, void* user_data,
+                                           struct otc_audio_device_settings* settings) {
+    settings->number_of_channels = CHANNELS;
+    settings->sampling_rate = SAMPLE_RATE;
+    return OTC_TRUE;
+}
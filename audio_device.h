@@ -0,0 +1,113 @@
+#pragma once
+
+#include <opentok.h>
+
+#include <atomic>
+#include <stdint.h>
+#include <thread>
+
+#include "audio_levels.h"
+#include "spsc_ring.h"
+
+class AudioSink;
+
+/**
+ * Custom audio device for the SDK, in place of its default one.
+ *
+ * Playout is pulled from the SDK in 10 ms blocks by the render thread,
+ * metered and pushed into a lock-free ring; a sink thread drains the ring
+ * into the sink, which is free to block. Capture pushes a test tone, one
+ * short beep a second, as there is no microphone to read.
+ *
+ * The render and capture threads are the real-time path: they only touch
+ * buffers allocated up front, the ring and atomics, never a lock.
+ */
+class AudioDevice {
+public:
+    static const int SAMPLE_RATE = 48000;
+    static const int CHANNELS = 1;
+    // 10 ms, the block size the SDK works in
+    static const int BLOCK_SAMPLES = SAMPLE_RATE / 100 * CHANNELS;
+
+    // The SDK mixes every subscriber before playout, so these are the meters we get
+    enum Stream { PLAYOUT = 0, CAPTURE = 1, STREAM_COUNT };
+
+    struct Stats {
+        uint64_t rendered_blocks;
+        uint64_t captured_blocks;
+        // Samples the ring had no room for
+        uint64_t overrun_samples;
+        uint64_t sink_underruns;
+        int buffered_ms;
+    };
+
+    AudioDevice();
+    ~AudioDevice();
+
+    // Takes the sink over and hands the device to the SDK, after otc_init() and
+    // before any session. The sink is deleted if the SDK refuses the device.
+    bool install(AudioSink* sink);
+    bool installed() const { return this->sink != nullptr; }
+
+    AudioLevels levels(Stream stream) const;
+    Stats stats() const;
+    // Main thread only, VU meters and stats
+    void draw();
+
+private:
+    // About 340 ms, far more than the sink should ever fall behind
+    static const size_t RING_SAMPLES = 16384;
+
+    static otc_bool init(const otc_audio_device* device, void* user_data);
+    static otc_bool destroy(const otc_audio_device* device, void* user_data);
+    static otc_bool init_renderer(const otc_audio_device* device, void* user_data);
+    static otc_bool destroy_renderer(const otc_audio_device* device, void* user_data);
+    static otc_bool start_renderer(const otc_audio_device* device, void* user_data);
+    static otc_bool stop_renderer(const otc_audio_device* device, void* user_data);
+    static otc_bool is_renderer_initialized(const otc_audio_device* device, void* user_data);
+    static otc_bool is_renderer_started(const otc_audio_device* device, void* user_data);
+    static int get_estimated_render_delay(const otc_audio_device* device, void* user_data);
+    static otc_bool get_render_settings(const otc_audio_device* device, void* user_data,
+                                        struct otc_audio_device_settings* settings);
+    static otc_bool init_capturer(const otc_audio_device* device, void* user_data);
+    static otc_bool destroy_capturer(const otc_audio_device* device, void* user_data);
+    static otc_bool start_capturer(const otc_audio_device* device, void* user_data);
+    static otc_bool stop_capturer(const otc_audio_device* device, void* user_data);
+    static otc_bool is_capturer_initialized(const otc_audio_device* device, void* user_data);
+    static otc_bool is_capturer_started(const otc_audio_device* device, void* user_data);
+    static int get_estimated_capture_delay(const otc_audio_device* device, void* user_data);
+    static otc_bool get_capture_settings(const otc_audio_device* device, void* user_data,
+                                         struct otc_audio_device_settings* settings);
+
+    void stop_rendering();
+    void stop_capturing();
+    void run_render();
+    void run_capture();
+    void run_sink();
+    void publish_levels(Stream stream, const int16_t* samples, size_t count);
+
+    otc_audio_device_callbacks callbacks;
+    AudioSink* sink;
+    SpscRing<int16_t, RING_SAMPLES> ring;
+    // One second of the capture beep, played in a loop
+    int16_t* tone;
+
+    std::atomic<bool> renderer_initialized;
+    std::atomic<bool> rendering;
+    std::atomic<bool> capturer_initialized;
+    std::atomic<bool> capturing;
+    std::thread render_thread;
+    std::thread sink_thread;
+    std::thread capture_thread;
+
+    std::atomic<float> rms[STREAM_COUNT];
+    std::atomic<float> peak[STREAM_COUNT];
+    std::atomic<uint64_t> rendered_blocks;
+    std::atomic<uint64_t> captured_blocks;
+    std::atomic<uint64_t> overrun_samples;
+
+    // Main thread only, what the meters show
+    float shown_rms[STREAM_COUNT];
+    float held_peak[STREAM_COUNT];
+    int64_t peak_held_until_us[STREAM_COUNT];
+};
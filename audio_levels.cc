@@ -0,0 +1,59 @@
+#include "audio_levels.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+AudioLevels audio_levels(const int16_t* samples, size_t count) {
+    uint64_t squares = 0;
+    int peak = 0;
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    __m128i sums = _mm_setzero_si128();
+    __m128i highest = _mm_setzero_si128();
+    __m128i lowest = _mm_setzero_si128();
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= count; i += 8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+        // Pairs of squares fit 32 bits unsigned, even two -32768s
+        __m128i pairs = _mm_madd_epi16(x, x);
+        sums = _mm_add_epi64(sums, _mm_unpacklo_epi32(pairs, zero));
+        sums = _mm_add_epi64(sums, _mm_unpackhi_epi32(pairs, zero));
+        // abs(-32768) does not fit, so track both ends instead
+        highest = _mm_max_epi16(highest, x);
+        lowest = _mm_min_epi16(lowest, x);
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sums);
+    squares = lanes[0] + lanes[1];
+    int16_t high[8];
+    int16_t low[8];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(high), highest);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(low), lowest);
+    for (int lane = 0; lane < 8; lane++) {
+        peak = std::max(peak, std::max(static_cast<int>(high[lane]), -static_cast<int>(low[lane])));
+    }
+#endif
+
+    for (; i < count; i++) {
+        int sample = samples[i];
+        squares += static_cast<uint64_t>(sample * sample);
+        peak = std::max(peak, abs(sample));
+    }
+
+    AudioLevels levels = { 0.0f, 0.0f };
+    if (count > 0) {
+        levels.rms = static_cast<float>(sqrt(static_cast<double>(squares) / count) / 32768.0);
+        levels.peak = peak / 32768.0f;
+    }
+    return levels;
+}
+
+float audio_level_db(float level) {
+    return level > 1e-5f ? 20.0f * log10f(level) : -100.0f;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Loudness of a block of 16 bit samples, both relative to full scale.
+ */
+struct AudioLevels {
+    float rms;
+    float peak;
+};
+
+// SSE2 where available, scalar otherwise. Safe on the audio thread.
+AudioLevels audio_levels(const int16_t* samples, size_t count);
+
+// Full scale relative level in dBFS, floored at -100
+float audio_level_db(float level);
@@ -0,0 +1,180 @@
+#include "audio_sink.h"
+#include "log.h"
+
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#if defined(HAVE_ALSA)
+#include <alsa/asoundlib.h>
+#endif
+
+/**
+ * Drops everything, for measuring the audio path without a device.
+ */
+class NullSink : public AudioSink {
+public:
+    bool open(int sample_rate, int channels) override { return true; }
+    bool write(const int16_t* samples, size_t count) override { return true; }
+    void close() override {}
+    const char* name() const override { return "null"; }
+};
+
+/**
+ * 16 bit PCM WAV file. The sizes in the header are filled in on close.
+ */
+class WavSink : public AudioSink {
+public:
+    explicit WavSink(const char* path) : path(path), file(nullptr), data_bytes(0) {}
+    ~WavSink() { this->close(); }
+
+    bool open(int sample_rate, int channels) override {
+        this->close();
+        this->file = fopen(this->path.c_str(), "wb");
+        if (this->file == nullptr) {
+            LOG_ERROR("Could not open %s for audio", this->path.c_str());
+            return false;
+        }
+        this->sample_rate = sample_rate;
+        this->channels = channels;
+        this->data_bytes = 0;
+        this->write_header();
+        return true;
+    }
+
+    bool write(const int16_t* samples, size_t count) override {
+        if (this->file == nullptr || fwrite(samples, sizeof(int16_t), count, this->file) != count) {
+            return false;
+        }
+        this->data_bytes += count * sizeof(int16_t);
+        return true;
+    }
+
+    void close() override {
+        if (this->file == nullptr) {
+            return;
+        }
+        fseek(this->file, 0, SEEK_SET);
+        this->write_header();
+        fclose(this->file);
+        this->file = nullptr;
+    }
+
+    const char* name() const override { return this->path.c_str(); }
+
+private:
+    void write_u32(uint32_t value) {
+        uint8_t bytes[4] = { uint8_t(value), uint8_t(value >> 8), uint8_t(value >> 16), uint8_t(value >> 24) };
+        fwrite(bytes, 1, 4, this->file);
+    }
+
+    void write_u16(uint16_t value) {
+        uint8_t bytes[2] = { uint8_t(value), uint8_t(value >> 8) };
+        fwrite(bytes, 1, 2, this->file);
+    }
+
+    void write_header() {
+        fwrite("RIFF", 1, 4, this->file);
+        write_u32(static_cast<uint32_t>(36 + this->data_bytes));
+        fwrite("WAVEfmt ", 1, 8, this->file);
+        write_u32(16);
+        // PCM
+        write_u16(1);
+        write_u16(static_cast<uint16_t>(this->channels));
+        write_u32(static_cast<uint32_t>(this->sample_rate));
+        write_u32(static_cast<uint32_t>(this->sample_rate * this->channels * 2));
+        write_u16(static_cast<uint16_t>(this->channels * 2));
+        write_u16(16);
+        fwrite("data", 1, 4, this->file);
+        write_u32(static_cast<uint32_t>(this->data_bytes));
+    }
+
+    std::string path;
+    FILE* file;
+    int sample_rate;
+    int channels;
+    uint64_t data_bytes;
+};
+
+#if defined(HAVE_ALSA)
+/**
+ * Plays through an ALSA PCM device, "default" unless one is named.
+ */
+class AlsaSink : public AudioSink {
+public:
+    explicit AlsaSink(const char* device) : device(device), pcm(nullptr), channels(1), xruns(0) {}
+    ~AlsaSink() { this->close(); }
+
+    bool open(int sample_rate, int channels) override {
+        this->close();
+        int error = snd_pcm_open(&this->pcm, this->device.c_str(), SND_PCM_STREAM_PLAYBACK, 0);
+        if (error < 0) {
+            LOG_ERROR("Could not open ALSA device %s: %s", this->device.c_str(), snd_strerror(error));
+            this->pcm = nullptr;
+            return false;
+        }
+        // 40 ms of device buffer rides out scheduling hiccups of the sink thread
+        error = snd_pcm_set_params(this->pcm, SND_PCM_FORMAT_S16_LE, SND_PCM_ACCESS_RW_INTERLEAVED,
+                                   channels, sample_rate, 1, 40000);
+        if (error < 0) {
+            LOG_ERROR("Could not configure ALSA device %s: %s", this->device.c_str(), snd_strerror(error));
+            this->close();
+            return false;
+        }
+        this->channels = channels;
+        return true;
+    }
+
+    bool write(const int16_t* samples, size_t count) override {
+        snd_pcm_uframes_t frames = count / this->channels;
+        while (frames > 0 && this->pcm != nullptr) {
+            snd_pcm_sframes_t written = snd_pcm_writei(this->pcm, samples, frames);
+            if (written < 0) {
+                if (written == -EPIPE) {
+                    this->xruns++;
+                }
+                if (snd_pcm_recover(this->pcm, static_cast<int>(written), 1) < 0) {
+                    return false;
+                }
+                continue;
+            }
+            samples += written * this->channels;
+            frames -= written;
+        }
+        return true;
+    }
+
+    void close() override {
+        if (this->pcm != nullptr) {
+            snd_pcm_drop(this->pcm);
+            snd_pcm_close(this->pcm);
+            this->pcm = nullptr;
+        }
+    }
+
+    const char* name() const override { return this->device.c_str(); }
+    uint64_t underruns() const override { return this->xruns; }
+
+private:
+    std::string device;
+    snd_pcm_t* pcm;
+    int channels;
+    std::atomic<uint64_t> xruns;
+};
+#endif
+
+AudioSink* AudioSink::create(const char* spec) {
+    if (strcmp(spec, "null") == 0) {
+        return new NullSink();
+    }
+    if (strcmp(spec, "alsa") == 0 || strncmp(spec, "alsa:", 5) == 0) {
+#if defined(HAVE_ALSA)
+        return new AlsaSink(spec[4] == ':' ? spec + 5 : "default");
+#else
+        LOG_ERROR("Built without ALSA, use null or a .wav path");
+        return nullptr;
+#endif
+    }
+    return new WavSink(spec);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Where played out audio ends up. Only the AudioDevice sink thread calls
+ * these, so they may block and allocate freely.
+ */
+class AudioSink {
+public:
+    virtual ~AudioSink() {}
+
+    virtual bool open(int sample_rate, int channels) = 0;
+    // Interleaved samples, count is in samples. Blocks while the device is full.
+    virtual bool write(const int16_t* samples, size_t count) = 0;
+    virtual void close() = 0;
+
+    virtual const char* name() const = 0;
+    // Times the device ran dry and played silence
+    virtual uint64_t underruns() const { return 0; }
+
+    // "null", "alsa", "alsa:<device>" or the path of a .wav file to write.
+    // Returns null if the kind is not available in this build.
+    static AudioSink* create(const char* spec);
+};
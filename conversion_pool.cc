@@ -0,0 +1,67 @@
+#include "conversion_pool.h"
+#include "renderer.h"
+#include "trace.h"
+
+using namespace std;
+
+ConversionPool::ConversionPool(int threads) : stopping(false), processed(0) {
+    if (threads <= 0) {
+        threads = static_cast<int>(thread::hardware_concurrency()) - 1;
+        if (threads < 1) {
+            threads = 1;
+        }
+    }
+    for (int i = 0; i < threads; i++) {
+        this->workers.push_back(thread(&ConversionPool::run, this));
+    }
+}
+
+ConversionPool::~ConversionPool() {
+    {
+        lock_guard<mutex> lock(this->queue_mutex);
+        this->stopping = true;
+    }
+    this->queue_condition.notify_all();
+    for (thread& worker : this->workers) {
+        worker.join();
+    }
+}
+
+void ConversionPool::schedule(Renderer* renderer) {
+    {
+        lock_guard<mutex> lock(this->queue_mutex);
+        this->queue.push_back(renderer);
+    }
+    this->queue_condition.notify_one();
+}
+
+ConversionPool::Stats ConversionPool::stats() {
+    Stats stats;
+    stats.processed = this->processed;
+    stats.threads = static_cast<int>(this->workers.size());
+    lock_guard<mutex> lock(this->queue_mutex);
+    stats.queued = static_cast<int>(this->queue.size());
+    return stats;
+}
+
+void ConversionPool::run() {
+    Trace::set_thread_name("conversion worker");
+    for (;;) {
+        Renderer* renderer = nullptr;
+        {
+            unique_lock<mutex> lock(this->queue_mutex);
+            while (this->queue.empty() && !this->stopping) {
+                this->queue_condition.wait(lock);
+            }
+            // Renderers still queued hold their producer side, they only go
+            // idle once their frame is converted
+            if (this->queue.empty()) {
+                return;
+            }
+            renderer = this->queue.front();
+            this->queue.pop_front();
+        }
+        renderer->convert_pending(this);
+        this->processed++;
+    }
+}
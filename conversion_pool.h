@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+class Renderer;
+
+/**
+ * Fixed set of worker threads converting frames for every Renderer.
+ *
+ * Renderers keep at most one pending raw frame (newer frames replace it)
+ * and are queued here at most once at a time, so the queue is bounded by
+ * the number of streams and a slow machine drops stale frames instead of
+ * building up latency.
+ */
+class ConversionPool {
+public:
+    struct Stats {
+        uint64_t processed;
+        int queued;
+        int threads;
+    };
+
+    // 0 threads means one per core, minus the main thread
+    ConversionPool(int threads = 0);
+    // Converts whatever is still queued before the workers exit
+    ~ConversionPool();
+
+    void schedule(Renderer* renderer);
+    Stats stats();
+
+private:
+    void run();
+
+    std::mutex queue_mutex;
+    std::condition_variable queue_condition;
+    std::deque<Renderer*> queue;
+    bool stopping;
+    std::vector<std::thread> workers;
+    std::atomic<uint64_t> processed;
+};
@@ -0,0 +1,141 @@
+#include "fake_internal.h"
+
+#include <math.h>
+
+/**
+ * Audio engine behind an app supplied device. Playout mixes a tone per
+ * audible stream, loud or quiet following its speaking pattern; captured
+ * audio is accepted and dropped.
+ *
+ * Device state changes serialize on device_mutex; the data calls the
+ * device makes from its own threads only touch atomics.
+ */
+struct otc_audio_device {
+};
+
+static const int MAX_STREAMS = 64;
+
+static std::mutex device_mutex;
+static otc_audio_device audio_device;
+static otc_audio_device_callbacks device;
+static bool installed = false;
+static bool rendering = false;
+static bool capturing = false;
+
+static std::atomic<int> render_channels(1);
+static std::atomic<int> render_rate(48000);
+static std::atomic<uint64_t> render_position(0);
+static std::atomic<bool> capture_open(false);
+static std::atomic<int> audible[MAX_STREAMS];
+
+static otc_bool call(otc_bool (*callback)(const otc_audio_device*, void*)) {
+    return callback != nullptr ? callback(&audio_device, device.user_data) : OTC_FALSE;
+}
+
+otc_status otc_set_audio_device(const struct otc_audio_device_callbacks* callbacks) {
+    if (callbacks == nullptr) {
+        return OTC_ERROR;
+    }
+    std::lock_guard<std::mutex> lock(device_mutex);
+    if (installed) {
+        return OTC_ERROR;
+    }
+    device = *callbacks;
+    installed = true;
+    call(device.init);
+    return OTC_SUCCESS;
+}
+
+void fake_audio_render(bool on) {
+    std::lock_guard<std::mutex> lock(device_mutex);
+    if (!installed || on == rendering) {
+        return;
+    }
+    rendering = on;
+    if (!on) {
+        call(device.stop_renderer);
+        return;
+    }
+    if (!call(device.is_renderer_initialized)) {
+        call(device.init_renderer);
+    }
+    otc_audio_device_settings settings = { 1, 48000 };
+    if (device.get_render_settings != nullptr) {
+        device.get_render_settings(&audio_device, device.user_data, &settings);
+    }
+    render_channels.store(settings.number_of_channels > 0 ? settings.number_of_channels : 1);
+    render_rate.store(settings.sampling_rate > 0 ? settings.sampling_rate : 48000);
+    fake_log("fake audio device: playout %d Hz, %d channels", settings.sampling_rate, settings.number_of_channels);
+    call(device.start_renderer);
+}
+
+void fake_audio_capture(bool on) {
+    std::lock_guard<std::mutex> lock(device_mutex);
+    if (!installed || on == capturing) {
+        return;
+    }
+    capturing = on;
+    capture_open.store(on);
+    if (!on) {
+        call(device.stop_capturer);
+        return;
+    }
+    if (!call(device.is_capturer_initialized)) {
+        call(device.init_capturer);
+    }
+    call(device.start_capturer);
+}
+
+void fake_audio_shutdown() {
+    fake_audio_render(false);
+    fake_audio_capture(false);
+    std::lock_guard<std::mutex> lock(device_mutex);
+    if (!installed) {
+        return;
+    }
+    call(device.destroy_renderer);
+    call(device.destroy_capturer);
+    call(device.destroy);
+    installed = false;
+}
+
+void fake_audio_stream(int index, int delta) {
+    if (index >= 0 && index < MAX_STREAMS) {
+        audible[index].fetch_add(delta);
+    }
+}
+
+size_t otc_audio_device_read_render_data(int16_t* buffer, size_t number_of_samples) {
+    int channels = render_channels.load();
+    int rate = render_rate.load();
+    uint64_t position = render_position.fetch_add(number_of_samples);
+    int64_t now = fake_now_us();
+
+    int streams[MAX_STREAMS];
+    float amplitudes[MAX_STREAMS];
+    int count = 0;
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        if (audible[i].load(std::memory_order_relaxed) > 0) {
+            streams[count] = i;
+            amplitudes[count] = 8000.0f * fake_audio_level(i, now);
+            count++;
+        }
+    }
+    for (size_t n = 0; n < number_of_samples; n++) {
+        float mix = 0.0f;
+        for (int s = 0; s < count; s++) {
+            // A different pitch per stream, whole Hz so every second ends on a full cycle
+            double frequency = 220 + 110 * (streams[s] % 8);
+            mix += amplitudes[s] * static_cast<float>(sin(2 * M_PI * frequency * ((position + n) % rate) / rate));
+        }
+        int16_t sample = static_cast<int16_t>(mix > 32767.0f ? 32767.0f : (mix < -32768.0f ? -32768.0f : mix));
+        for (int channel = 0; channel < channels; channel++) {
+            buffer[n * channels + channel] = sample;
+        }
+    }
+    return number_of_samples;
+}
+
+otc_status otc_audio_device_write_capture_data(const int16_t* data, size_t number_of_samples) {
+    return capture_open.load() ? OTC_SUCCESS : OTC_ERROR;
+}
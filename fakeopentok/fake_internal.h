@@ -0,0 +1,102 @@
+#pragma once
+
+#include "opentok.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * A frame in one allocation with tightly packed rows, like the SDK's.
+ */
+struct otc_video_frame {
+    enum otc_video_frame_format format;
+    int width;
+    int height;
+    int64_t timestamp;
+    int plane_count;
+    uint8_t* planes[3];
+    int strides[3];
+    int plane_heights[3];
+    // All planes back to back, in storage or in memory the caller wrapped
+    uint8_t* buffer;
+    size_t size;
+    std::vector<uint8_t> storage;
+};
+
+struct otc_stream {
+    std::string id;
+    int width;
+    int height;
+    int fps;
+    enum otc_video_frame_format format;
+    // Index of the synthetic stream, drives its picture and audio pattern
+    int index;
+    // Streams a publisher of ours sends back to the session, null otherwise
+    otc_publisher* loopback;
+};
+
+/**
+ * Environment driven settings, read once by otc_init():
+ * FAKE_OTC_STREAMS, FAKE_OTC_WIDTH, FAKE_OTC_HEIGHT, FAKE_OTC_FPS,
+ * FAKE_OTC_FORMAT (i420, nv12, nv21, yuy2, uyvy, argb32, bgra32, abgr32,
+ * rgba32) and FAKE_OTC_LOOPBACK (0 keeps published streams out of the
+ * session).
+ */
+struct FakeConfig {
+    int streams;
+    int width;
+    int height;
+    int fps;
+    enum otc_video_frame_format format;
+    bool loopback;
+};
+
+const FakeConfig& fake_config();
+void fake_log(const char* format, ...) __attribute__((format(printf, 1, 2)));
+int64_t fake_now_us();
+// Sleeps until *next_us and moves it one interval on, without catching up after stalls
+void fake_wait_next(int64_t* next_us, int64_t interval_us);
+
+otc_video_frame* fake_frame_new(enum otc_video_frame_format format, int width, int height);
+// Converts into a frame of the same size that already exists, without allocating
+bool fake_frame_convert_into(const otc_video_frame* source, otc_video_frame* target);
+// Same for columns x to x + width only, widened to whole pixel pairs
+bool fake_frame_convert_columns(const otc_video_frame* source, otc_video_frame* target, int x, int width);
+
+// Speaking pattern of stream index, 0 to 1: streams take turns being loud
+float fake_audio_level(int index, int64_t now_us);
+
+// Drive the installed audio device, if any (see fake_audio_device.cc)
+void fake_audio_render(bool on);
+void fake_audio_capture(bool on);
+void fake_audio_shutdown();
+// A subscriber of stream index started (+1) or stopped (-1) playing out
+void fake_audio_stream(int index, int delta);
+
+/**
+ * Draws the synthetic picture of one stream: a gradient tinted per stream
+ * with a bar moving across it, produced as I420 and converted to the
+ * stream's format. Only the bar is redrawn and converted per frame, so
+ * even many large streams cost little to generate.
+ */
+class FakePicture {
+public:
+    FakePicture(enum otc_video_frame_format format, int width, int height, int index);
+    ~FakePicture();
+
+    // The frame for frame number n, valid until the next call
+    otc_video_frame* render(uint64_t n);
+
+private:
+    void draw_bar(int x, bool on);
+
+    otc_video_frame* i420;
+    otc_video_frame* output;
+    std::vector<uint8_t> background;
+    int bar_x;
+};
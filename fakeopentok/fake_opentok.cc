@@ -0,0 +1,601 @@
+#include "fake_internal.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+using namespace std;
+
+struct otc_video_capturer {
+    otc_publisher* publisher;
+};
+
+struct otc_publisher {
+    std::string name;
+    otc_publisher_callbacks callbacks;
+    bool custom_capturer;
+    otc_video_capturer_callbacks capturer_callbacks;
+    otc_video_capturer capturer;
+    otc_session* session;
+    // Owned by the session once published
+    otc_stream* stream;
+    std::atomic<bool> publish_video;
+    std::atomic<bool> publish_audio;
+    // Stands in for the camera when no capturer was given
+    std::thread camera;
+    std::atomic<bool> capturing;
+    // Last captured frame with a timestamp, reused while the size stays
+    otc_video_frame* delivered;
+    // Subscribers to our loopback stream, under loopback_mutex
+    std::vector<otc_subscriber*> subscribers;
+};
+
+struct otc_subscriber {
+    otc_subscriber_callbacks callbacks;
+    otc_stream* stream;
+    otc_session* session;
+    std::atomic<bool> subscribe_video;
+    std::atomic<bool> subscribe_audio;
+    std::atomic<bool> running;
+    std::thread thread;
+};
+
+struct otc_session {
+    otc_session_callbacks callbacks;
+    std::string id;
+    // Streams stay until the session is deleted, handed out pointers never dangle
+    std::mutex streams_mutex;
+    std::vector<std::unique_ptr<otc_stream>> streams;
+    int next_loopback;
+
+    // Session events are delivered from this thread, like the SDK's signaling thread
+    std::mutex events_mutex;
+    std::condition_variable events_condition;
+    std::deque<std::function<void()>> events;
+    bool stopping;
+    std::thread event_thread;
+};
+
+static std::mutex loopback_mutex;
+static otc_logger_callback logger = nullptr;
+static std::atomic<int> log_level(OTC_LOG_LEVEL_DISABLED);
+
+static int env_int(const char* name, int fallback, int min_value) {
+    const char* value = getenv(name);
+    if (value == nullptr || *value == '\0') {
+        return fallback;
+    }
+    int parsed = atoi(value);
+    return parsed < min_value ? min_value : parsed;
+}
+
+static enum otc_video_frame_format env_format(const char* name) {
+    static const struct {
+        const char* name;
+        enum otc_video_frame_format format;
+    } formats[] = {
+        { "i420", OTC_VIDEO_FRAME_FORMAT_YUV420P },
+        { "nv12", OTC_VIDEO_FRAME_FORMAT_NV12 },
+        { "nv21", OTC_VIDEO_FRAME_FORMAT_NV21 },
+        { "yuy2", OTC_VIDEO_FRAME_FORMAT_YUY2 },
+        { "uyvy", OTC_VIDEO_FRAME_FORMAT_UYVY },
+        { "argb32", OTC_VIDEO_FRAME_FORMAT_ARGB32 },
+        { "bgra32", OTC_VIDEO_FRAME_FORMAT_BGRA32 },
+        { "abgr32", OTC_VIDEO_FRAME_FORMAT_ABGR32 },
+        { "rgba32", OTC_VIDEO_FRAME_FORMAT_RGBA32 },
+    };
+    const char* value = getenv(name);
+    if (value != nullptr) {
+        for (const auto& entry : formats) {
+            if (strcasecmp(value, entry.name) == 0) {
+                return entry.format;
+            }
+        }
+    }
+    return OTC_VIDEO_FRAME_FORMAT_YUV420P;
+}
+
+const FakeConfig& fake_config() {
+    static const FakeConfig config = {
+        env_int("FAKE_OTC_STREAMS", 4, 0),
+        env_int("FAKE_OTC_WIDTH", 1280, 16) & ~1,
+        env_int("FAKE_OTC_HEIGHT", 720, 16) & ~1,
+        env_int("FAKE_OTC_FPS", 30, 1),
+        env_format("FAKE_OTC_FORMAT"),
+        env_int("FAKE_OTC_LOOPBACK", 1, 0) != 0,
+    };
+    return config;
+}
+
+void fake_log(const char* format, ...) {
+    otc_logger_callback callback = logger;
+    if (callback == nullptr || log_level.load() < OTC_LOG_LEVEL_INFO) {
+        return;
+    }
+    char message[256];
+    va_list arguments;
+    va_start(arguments, format);
+    vsnprintf(message, sizeof(message), format, arguments);
+    va_end(arguments);
+    callback(message);
+}
+
+int64_t fake_now_us() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void fake_wait_next(int64_t* next_us, int64_t interval_us) {
+    int64_t now = fake_now_us();
+    if (*next_us > now) {
+        this_thread::sleep_for(chrono::microseconds(*next_us - now));
+        *next_us += interval_us;
+    } else {
+        *next_us = now + interval_us;
+    }
+}
+
+void otc_log_set_logger_callback(otc_logger_callback callback) {
+    logger = callback;
+}
+
+void otc_log_enable(int level) {
+    log_level.store(level);
+}
+
+otc_status otc_init(void* reserved) {
+    const FakeConfig& config = fake_config();
+    fake_log("fake libopentok: %d streams of %dx%d at %d fps, loopback %s",
+             config.streams, config.width, config.height, config.fps, config.loopback ? "on" : "off");
+    return OTC_SUCCESS;
+}
+
+otc_status otc_destroy() {
+    fake_audio_shutdown();
+    return OTC_SUCCESS;
+}
+
+const char* otc_stream_get_id(const otc_stream* stream) {
+    return stream->id.c_str();
+}
+
+otc_stream* otc_stream_copy(const otc_stream* stream) {
+    return new otc_stream(*stream);
+}
+
+otc_status otc_stream_delete(otc_stream* stream) {
+    delete stream;
+    return OTC_SUCCESS;
+}
+
+// Session
+
+static void post_event(otc_session* session, std::function<void()> event) {
+    {
+        lock_guard<mutex> lock(session->events_mutex);
+        session->events.push_back(event);
+    }
+    session->events_condition.notify_one();
+}
+
+static void run_events(otc_session* session) {
+    for (;;) {
+        std::function<void()> event;
+        {
+            unique_lock<mutex> lock(session->events_mutex);
+            session->events_condition.wait(lock, [session]() {
+                return session->stopping || !session->events.empty();
+            });
+            if (session->stopping) {
+                return;
+            }
+            event = session->events.front();
+            session->events.pop_front();
+        }
+        event();
+    }
+}
+
+otc_session* otc_session_new(const char* apikey, const char* session_id, const struct otc_session_callbacks* callbacks) {
+    const FakeConfig& config = fake_config();
+    otc_session* session = new otc_session();
+    session->callbacks = *callbacks;
+    session->id = session_id != nullptr ? session_id : "";
+    session->next_loopback = 1;
+    session->stopping = false;
+    for (int i = 0; i < config.streams; i++) {
+        std::unique_ptr<otc_stream> stream(new otc_stream());
+        char id[32];
+        snprintf(id, sizeof(id), "fake-stream-%d", i + 1);
+        stream->id = id;
+        stream->width = config.width;
+        stream->height = config.height;
+        stream->fps = config.fps;
+        stream->format = config.format;
+        stream->index = i;
+        stream->loopback = nullptr;
+        session->streams.push_back(std::move(stream));
+    }
+    session->event_thread = std::thread(run_events, session);
+    return session;
+}
+
+otc_status otc_session_delete(otc_session* session) {
+    {
+        lock_guard<mutex> lock(session->events_mutex);
+        session->stopping = true;
+    }
+    session->events_condition.notify_one();
+    session->event_thread.join();
+    delete session;
+    return OTC_SUCCESS;
+}
+
+otc_status otc_session_connect(otc_session* session, const char* token) {
+    post_event(session, [session]() {
+        fake_log("fake session %s connected", session->id.c_str());
+        fake_audio_render(true);
+        if (session->callbacks.on_connected != nullptr) {
+            session->callbacks.on_connected(session, session->callbacks.user_data);
+        }
+        if (session->callbacks.on_stream_received == nullptr) {
+            return;
+        }
+        std::vector<otc_stream*> synthetic;
+        {
+            lock_guard<mutex> lock(session->streams_mutex);
+            for (const std::unique_ptr<otc_stream>& stream : session->streams) {
+                if (stream->index < fake_config().streams) {
+                    synthetic.push_back(stream.get());
+                }
+            }
+        }
+        for (otc_stream* stream : synthetic) {
+            session->callbacks.on_stream_received(session, session->callbacks.user_data, stream);
+        }
+    });
+    return OTC_SUCCESS;
+}
+
+otc_status otc_session_disconnect(otc_session* session) {
+    post_event(session, [session]() {
+        fake_audio_render(false);
+        if (session->callbacks.on_disconnected != nullptr) {
+            session->callbacks.on_disconnected(session, session->callbacks.user_data);
+        }
+    });
+    return OTC_SUCCESS;
+}
+
+// Publisher
+
+static void deliver(otc_publisher* publisher, const otc_video_frame* frame) {
+    otc_video_frame* delivered = publisher->delivered;
+    if (delivered == nullptr || delivered->format != frame->format ||
+        delivered->width != frame->width || delivered->height != frame->height) {
+        delete delivered;
+        delivered = publisher->delivered = fake_frame_new(frame->format, frame->width, frame->height);
+        if (delivered == nullptr) {
+            return;
+        }
+    }
+    fake_frame_convert_into(frame, delivered);
+    delivered->timestamp = frame->timestamp != 0 ? frame->timestamp : fake_now_us();
+
+    if (publisher->callbacks.on_render_frame != nullptr) {
+        publisher->callbacks.on_render_frame(publisher, publisher->callbacks.user_data, delivered);
+    }
+    if (!publisher->publish_video.load()) {
+        return;
+    }
+    // Loopback subscribers get the frame on the capturing thread, nothing is encoded
+    lock_guard<mutex> lock(loopback_mutex);
+    for (otc_subscriber* subscriber : publisher->subscribers) {
+        if (subscriber->subscribe_video.load() && subscriber->callbacks.on_render_frame != nullptr) {
+            subscriber->callbacks.on_render_frame(subscriber, subscriber->callbacks.user_data, delivered);
+        }
+    }
+}
+
+static void run_camera(otc_publisher* publisher) {
+    const FakeConfig& config = fake_config();
+    FakePicture picture(config.format, config.width, config.height, config.streams);
+    int64_t interval_us = 1000000 / config.fps;
+    int64_t next_us = fake_now_us();
+    for (uint64_t n = 0; publisher->capturing.load(); n++) {
+        deliver(publisher, picture.render(n));
+        fake_wait_next(&next_us, interval_us);
+    }
+}
+
+int otc_video_capturer_provide_frame(const otc_video_capturer* capturer, int rotation, const otc_video_frame* frame) {
+    if (capturer == nullptr || frame == nullptr) {
+        return OTC_ERROR;
+    }
+    deliver(capturer->publisher, frame);
+    return OTC_SUCCESS;
+}
+
+otc_publisher* otc_publisher_new(const char* name, const struct otc_video_capturer_callbacks* capturer,
+                                 const struct otc_publisher_callbacks* callbacks) {
+    otc_publisher* publisher = new otc_publisher();
+    publisher->name = name != nullptr ? name : "";
+    publisher->callbacks = *callbacks;
+    publisher->custom_capturer = capturer != nullptr;
+    if (capturer != nullptr) {
+        publisher->capturer_callbacks = *capturer;
+    }
+    publisher->capturer.publisher = publisher;
+    publisher->session = nullptr;
+    publisher->stream = nullptr;
+    publisher->publish_video.store(true);
+    publisher->publish_audio.store(true);
+    publisher->capturing.store(true);
+    publisher->delivered = nullptr;
+
+    // Capture starts right away, so the preview runs before publishing
+    if (publisher->custom_capturer) {
+        void* user_data = publisher->capturer_callbacks.user_data;
+        if (publisher->capturer_callbacks.init != nullptr) {
+            publisher->capturer_callbacks.init(&publisher->capturer, user_data);
+        }
+        if (publisher->capturer_callbacks.get_capture_settings != nullptr) {
+            otc_video_capturer_settings settings = {};
+            publisher->capturer_callbacks.get_capture_settings(&publisher->capturer, user_data, &settings);
+            fake_log("fake publisher capturer: %dx%d at %d fps", settings.width, settings.height, settings.fps);
+        }
+        if (publisher->capturer_callbacks.start != nullptr) {
+            publisher->capturer_callbacks.start(&publisher->capturer, user_data);
+        }
+    } else {
+        publisher->camera = std::thread(run_camera, publisher);
+    }
+    return publisher;
+}
+
+otc_status otc_publisher_delete(otc_publisher* publisher) {
+    publisher->capturing.store(false);
+    if (publisher->session != nullptr) {
+        fake_audio_capture(false);
+    }
+    if (publisher->custom_capturer) {
+        void* user_data = publisher->capturer_callbacks.user_data;
+        if (publisher->capturer_callbacks.stop != nullptr) {
+            publisher->capturer_callbacks.stop(&publisher->capturer, user_data);
+        }
+        if (publisher->capturer_callbacks.destroy != nullptr) {
+            publisher->capturer_callbacks.destroy(&publisher->capturer, user_data);
+        }
+    } else {
+        publisher->camera.join();
+    }
+    {
+        lock_guard<mutex> lock(loopback_mutex);
+        if (publisher->stream != nullptr) {
+            publisher->stream->loopback = nullptr;
+        }
+        publisher->subscribers.clear();
+    }
+    delete publisher->delivered;
+    delete publisher;
+    return OTC_SUCCESS;
+}
+
+otc_status otc_publisher_set_publish_video(otc_publisher* publisher, otc_bool publish_video) {
+    publisher->publish_video.store(publish_video != OTC_FALSE);
+    return OTC_SUCCESS;
+}
+
+otc_status otc_publisher_set_publish_audio(otc_publisher* publisher, otc_bool publish_audio) {
+    publisher->publish_audio.store(publish_audio != OTC_FALSE);
+    return OTC_SUCCESS;
+}
+
+otc_status otc_session_publish(otc_session* session, otc_publisher* publisher) {
+    if (publisher->session != nullptr) {
+        return OTC_ERROR;
+    }
+    const FakeConfig& config = fake_config();
+    publisher->session = session;
+    fake_audio_capture(true);
+
+    std::unique_ptr<otc_stream> stream(new otc_stream());
+    otc_stream* published = stream.get();
+    {
+        lock_guard<mutex> lock(session->streams_mutex);
+        char id[32];
+        snprintf(id, sizeof(id), "loopback-%d", session->next_loopback++);
+        stream->id = id;
+        stream->width = config.width;
+        stream->height = config.height;
+        stream->fps = config.fps;
+        stream->format = config.format;
+        stream->index = config.streams;
+        stream->loopback = publisher;
+        session->streams.push_back(std::move(stream));
+    }
+    {
+        lock_guard<mutex> lock(loopback_mutex);
+        publisher->stream = published;
+    }
+
+    // The app may delete the publisher before this runs, only copies go along
+    otc_publisher_callbacks callbacks = publisher->callbacks;
+    post_event(session, [session, publisher, published, callbacks]() {
+        if (callbacks.on_stream_created != nullptr) {
+            callbacks.on_stream_created(publisher, callbacks.user_data, published);
+        }
+        if (fake_config().loopback && session->callbacks.on_stream_received != nullptr) {
+            session->callbacks.on_stream_received(session, session->callbacks.user_data, published);
+        }
+    });
+    return OTC_SUCCESS;
+}
+
+otc_status otc_session_unpublish(otc_session* session, otc_publisher* publisher) {
+    if (publisher->session != session) {
+        return OTC_ERROR;
+    }
+    publisher->session = nullptr;
+    fake_audio_capture(false);
+    otc_stream* stream;
+    {
+        lock_guard<mutex> lock(loopback_mutex);
+        stream = publisher->stream;
+        publisher->stream = nullptr;
+        publisher->subscribers.clear();
+        if (stream != nullptr) {
+            stream->loopback = nullptr;
+        }
+    }
+    if (stream == nullptr) {
+        return OTC_SUCCESS;
+    }
+
+    otc_publisher_callbacks callbacks = publisher->callbacks;
+    post_event(session, [session, publisher, stream, callbacks]() {
+        if (fake_config().loopback && session->callbacks.on_stream_dropped != nullptr) {
+            session->callbacks.on_stream_dropped(session, session->callbacks.user_data, stream);
+        }
+        if (callbacks.on_stream_destroyed != nullptr) {
+            callbacks.on_stream_destroyed(publisher, callbacks.user_data, stream);
+        }
+    });
+    return OTC_SUCCESS;
+}
+
+// Subscriber
+
+float fake_audio_level(int index, int64_t now_us) {
+    // Streams take turns speaking for two seconds each
+    int streams = fake_config().streams + 1;
+    int speaker = static_cast<int>((now_us / 2000000) % streams);
+    if (speaker != index) {
+        return 0.02f;
+    }
+    return 0.5f + 0.3f * static_cast<float>((now_us / 100000) % 4) / 4.0f;
+}
+
+static void run_subscriber(otc_subscriber* subscriber) {
+    otc_stream* stream = subscriber->stream;
+    if (subscriber->callbacks.on_connected != nullptr) {
+        subscriber->callbacks.on_connected(subscriber, subscriber->callbacks.user_data, stream);
+    }
+
+    // Loopback streams get their frames from the publisher, only audio levels come from here
+    bool loopback;
+    {
+        lock_guard<mutex> lock(loopback_mutex);
+        loopback = stream->loopback != nullptr;
+        if (loopback) {
+            stream->loopback->subscribers.push_back(subscriber);
+        }
+    }
+    std::unique_ptr<FakePicture> picture;
+    if (!loopback) {
+        picture.reset(new FakePicture(stream->format, stream->width, stream->height, stream->index));
+    }
+
+    int64_t interval_us = loopback ? 100000 : 1000000 / stream->fps;
+    int64_t next_us = fake_now_us();
+    int64_t next_audio_us = next_us;
+    // Whether this subscriber is in the playout mix
+    bool audible = false;
+    for (uint64_t n = 0; subscriber->running.load(); n++) {
+        int64_t now = fake_now_us();
+        if (subscriber->subscribe_audio.load() != audible) {
+            audible = !audible;
+            fake_audio_stream(stream->index, audible ? 1 : -1);
+        }
+        if (picture && subscriber->subscribe_video.load() && subscriber->callbacks.on_render_frame != nullptr) {
+            subscriber->callbacks.on_render_frame(subscriber, subscriber->callbacks.user_data, picture->render(n));
+        }
+        if (now >= next_audio_us) {
+            next_audio_us = now + 100000;
+            if (subscriber->subscribe_audio.load() && subscriber->callbacks.on_audio_level_updated != nullptr) {
+                subscriber->callbacks.on_audio_level_updated(subscriber, subscriber->callbacks.user_data,
+                                                             fake_audio_level(stream->index, now));
+            }
+        }
+        fake_wait_next(&next_us, interval_us);
+    }
+    if (audible) {
+        fake_audio_stream(stream->index, -1);
+    }
+}
+
+otc_subscriber* otc_subscriber_new(const otc_stream* stream, const struct otc_subscriber_callbacks* callbacks) {
+    if (stream == nullptr) {
+        return nullptr;
+    }
+    otc_subscriber* subscriber = new otc_subscriber();
+    subscriber->callbacks = *callbacks;
+    subscriber->stream = const_cast<otc_stream*>(stream);
+    subscriber->session = nullptr;
+    subscriber->subscribe_video.store(true);
+    subscriber->subscribe_audio.store(true);
+    subscriber->running.store(false);
+    return subscriber;
+}
+
+otc_status otc_session_subscribe(otc_session* session, otc_subscriber* subscriber) {
+    if (subscriber->running.exchange(true)) {
+        return OTC_ERROR;
+    }
+    subscriber->session = session;
+    subscriber->thread = std::thread(run_subscriber, subscriber);
+    return OTC_SUCCESS;
+}
+
+otc_status otc_session_unsubscribe(otc_session* session, otc_subscriber* subscriber) {
+    if (!subscriber->running.exchange(false)) {
+        return OTC_ERROR;
+    }
+    subscriber->thread.join();
+    {
+        lock_guard<mutex> lock(loopback_mutex);
+        otc_publisher* publisher = subscriber->stream->loopback;
+        if (publisher != nullptr) {
+            std::vector<otc_subscriber*>& subscribers = publisher->subscribers;
+            for (size_t i = 0; i < subscribers.size(); i++) {
+                if (subscribers[i] == subscriber) {
+                    subscribers.erase(subscribers.begin() + i);
+                    break;
+                }
+            }
+        }
+    }
+    subscriber->session = nullptr;
+    return OTC_SUCCESS;
+}
+
+otc_status otc_subscriber_delete(otc_subscriber* subscriber) {
+    if (subscriber->running.load()) {
+        otc_session_unsubscribe(subscriber->session, subscriber);
+    }
+    delete subscriber;
+    return OTC_SUCCESS;
+}
+
+otc_stream* otc_subscriber_get_stream(const otc_subscriber* subscriber) {
+    return subscriber->stream;
+}
+
+otc_status otc_subscriber_set_subscribe_to_video(otc_subscriber* subscriber, otc_bool subscribe_to_video) {
+    subscriber->subscribe_video.store(subscribe_to_video != OTC_FALSE);
+    return OTC_SUCCESS;
+}
+
+otc_status otc_subscriber_set_subscribe_to_audio(otc_subscriber* subscriber, otc_bool subscribe_to_audio) {
+    subscriber->subscribe_audio.store(subscribe_to_audio != OTC_FALSE);
+    return OTC_SUCCESS;
+}
+
+void* otc_subscriber_get_user_data(const otc_subscriber* subscriber) {
+    return subscriber->callbacks.user_data;
+}
@@ -0,0 +1,71 @@
+#include "fake_internal.h"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+static const int BAR_WIDTH = 16;
+static const int BAR_STEP = 4;
+
+FakePicture::FakePicture(enum otc_video_frame_format format, int width, int height, int index)
+    : i420(fake_frame_new(OTC_VIDEO_FRAME_FORMAT_YUV420P, width, height)), output(nullptr), bar_x(-1) {
+    if (format != OTC_VIDEO_FRAME_FORMAT_YUV420P) {
+        this->output = fake_frame_new(format, width, height);
+    }
+
+    uint8_t* y = this->i420->planes[0];
+    for (int row = 0; row < height; row++) {
+        for (int x = 0; x < width; x++) {
+            y[row * this->i420->strides[0] + x] = static_cast<uint8_t>(40 + (x + row) * 150 / (width + height));
+        }
+    }
+    // Each stream gets its own tint
+    uint8_t u = static_cast<uint8_t>(128 + 48 * cos(index * 2.4));
+    uint8_t v = static_cast<uint8_t>(128 + 48 * sin(index * 2.4));
+    memset(this->i420->planes[1], u, static_cast<size_t>(this->i420->strides[1]) * this->i420->plane_heights[1]);
+    memset(this->i420->planes[2], v, static_cast<size_t>(this->i420->strides[2]) * this->i420->plane_heights[2]);
+    this->background.assign(y, y + static_cast<size_t>(this->i420->strides[0]) * height);
+}
+
+FakePicture::~FakePicture() {
+    delete this->i420;
+    delete this->output;
+}
+
+void FakePicture::draw_bar(int x, bool on) {
+    int width = std::min(BAR_WIDTH, this->i420->width - x);
+    for (int row = 0; row < this->i420->height; row++) {
+        size_t offset = static_cast<size_t>(row) * this->i420->strides[0] + x;
+        if (on) {
+            memset(this->i420->planes[0] + offset, 235, width);
+        } else {
+            memcpy(this->i420->planes[0] + offset, this->background.data() + offset, width);
+        }
+    }
+}
+
+otc_video_frame* FakePicture::render(uint64_t n) {
+    int travel = std::max(1, this->i420->width - BAR_WIDTH);
+    int x = static_cast<int>((n * BAR_STEP) % travel);
+    int previous = this->bar_x;
+    if (previous >= 0) {
+        this->draw_bar(previous, false);
+    }
+    this->draw_bar(x, true);
+    this->bar_x = x;
+
+    int64_t now = fake_now_us();
+    this->i420->timestamp = now;
+    if (this->output == nullptr) {
+        return this->i420;
+    }
+    if (previous < 0) {
+        fake_frame_convert_into(this->i420, this->output);
+    } else {
+        // The output keeps everything else from the frames before
+        fake_frame_convert_columns(this->i420, this->output, previous, BAR_WIDTH);
+        fake_frame_convert_columns(this->i420, this->output, x, BAR_WIDTH);
+    }
+    this->output->timestamp = now;
+    return this->output;
+}
@@ -0,0 +1,496 @@
+#include "fake_internal.h"
+#include "yuv_convert.h"
+
+#include <algorithm>
+#include <string.h>
+
+// Byte offsets of B, G, R and A in each 32 bit layout, the SDK names follow libyuv
+struct PixelOrder {
+    enum otc_video_frame_format format;
+    int b, g, r, a;
+};
+
+static const PixelOrder pixel_orders[] = {
+    { OTC_VIDEO_FRAME_FORMAT_ARGB32, 0, 1, 2, 3 },
+    { OTC_VIDEO_FRAME_FORMAT_BGRA32, 3, 2, 1, 0 },
+    { OTC_VIDEO_FRAME_FORMAT_ABGR32, 2, 1, 0, 3 },
+    { OTC_VIDEO_FRAME_FORMAT_RGBA32, 1, 2, 3, 0 },
+};
+
+static const PixelOrder* find_pixel_order(enum otc_video_frame_format format) {
+    for (const PixelOrder& order : pixel_orders) {
+        if (order.format == format) {
+            return &order;
+        }
+    }
+    return nullptr;
+}
+
+// Plane layout of a tightly packed frame, without any memory behind it yet
+static otc_video_frame* frame_layout(enum otc_video_frame_format format, int width, int height) {
+    if (width <= 0 || height <= 0) {
+        return nullptr;
+    }
+    int chroma_width = (width + 1) / 2;
+    int chroma_height = (height + 1) / 2;
+    otc_video_frame* frame = new otc_video_frame();
+    frame->format = format;
+    frame->width = width;
+    frame->height = height;
+    frame->timestamp = 0;
+    switch (format) {
+    case OTC_VIDEO_FRAME_FORMAT_YUV420P:
+        frame->plane_count = 3;
+        frame->strides[0] = width;
+        frame->strides[1] = frame->strides[2] = chroma_width;
+        frame->plane_heights[0] = height;
+        frame->plane_heights[1] = frame->plane_heights[2] = chroma_height;
+        break;
+    case OTC_VIDEO_FRAME_FORMAT_NV12:
+    case OTC_VIDEO_FRAME_FORMAT_NV21:
+        frame->plane_count = 2;
+        frame->strides[0] = width;
+        frame->strides[1] = 2 * chroma_width;
+        frame->plane_heights[0] = height;
+        frame->plane_heights[1] = chroma_height;
+        break;
+    case OTC_VIDEO_FRAME_FORMAT_YUY2:
+    case OTC_VIDEO_FRAME_FORMAT_UYVY:
+        frame->plane_count = 1;
+        frame->strides[0] = 4 * chroma_width;
+        frame->plane_heights[0] = height;
+        break;
+    case OTC_VIDEO_FRAME_FORMAT_RGB24:
+        frame->plane_count = 1;
+        frame->strides[0] = 3 * width;
+        frame->plane_heights[0] = height;
+        break;
+    default:
+        if (find_pixel_order(format) == nullptr) {
+            delete frame;
+            return nullptr;
+        }
+        frame->plane_count = 1;
+        frame->strides[0] = 4 * width;
+        frame->plane_heights[0] = height;
+        break;
+    }
+
+    frame->size = 0;
+    for (int i = 0; i < frame->plane_count; i++) {
+        frame->size += static_cast<size_t>(frame->strides[i]) * frame->plane_heights[i];
+    }
+    frame->buffer = nullptr;
+    return frame;
+}
+
+static void place_planes(otc_video_frame* frame, uint8_t* buffer) {
+    frame->buffer = buffer;
+    uint8_t* plane = buffer;
+    for (int i = 0; i < 3; i++) {
+        if (i < frame->plane_count) {
+            frame->planes[i] = plane;
+            plane += static_cast<size_t>(frame->strides[i]) * frame->plane_heights[i];
+        } else {
+            frame->planes[i] = nullptr;
+            frame->strides[i] = 0;
+            frame->plane_heights[i] = 0;
+        }
+    }
+}
+
+otc_video_frame* fake_frame_new(enum otc_video_frame_format format, int width, int height) {
+    otc_video_frame* frame = frame_layout(format, width, height);
+    if (frame != nullptr) {
+        frame->storage.resize(frame->size);
+        place_planes(frame, frame->storage.data());
+    }
+    return frame;
+}
+
+// Bytes that width pixels take in one row of the plane, width even unless it reaches the frame edge
+static int row_bytes(enum otc_video_frame_format format, int plane, int width) {
+    int chroma_width = (width + 1) / 2;
+    switch (format) {
+    case OTC_VIDEO_FRAME_FORMAT_YUV420P:
+        return plane == 0 ? width : chroma_width;
+    case OTC_VIDEO_FRAME_FORMAT_NV12:
+    case OTC_VIDEO_FRAME_FORMAT_NV21:
+        return plane == 0 ? width : 2 * chroma_width;
+    case OTC_VIDEO_FRAME_FORMAT_YUY2:
+    case OTC_VIDEO_FRAME_FORMAT_UYVY:
+        return 4 * chroma_width;
+    case OTC_VIDEO_FRAME_FORMAT_RGB24:
+        return 3 * width;
+    default:
+        return 4 * width;
+    }
+}
+
+static void copy_rows(const uint8_t* source, int source_stride, uint8_t* target, int target_stride,
+                      int size, int rows) {
+    for (int row = 0; row < rows; row++) {
+        memcpy(target + row * target_stride, source + row * source_stride, size);
+    }
+}
+
+static void copy_frame(const otc_video_frame* source, otc_video_frame* target) {
+    for (int i = 0; i < source->plane_count; i++) {
+        copy_rows(source->planes[i], source->strides[i], target->planes[i], target->strides[i],
+                  row_bytes(source->format, i, source->width), source->plane_heights[i]);
+    }
+}
+
+// Any 32 bit layout or RGB24 into ARGB32
+static void to_bgra(const otc_video_frame* source, otc_video_frame* target) {
+    const PixelOrder* order = find_pixel_order(source->format);
+    for (int row = 0; row < source->height; row++) {
+        const uint8_t* in = source->planes[0] + row * source->strides[0];
+        uint8_t* out = target->planes[0] + row * target->strides[0];
+        for (int x = 0; x < source->width; x++, out += 4) {
+            if (order != nullptr) {
+                out[0] = in[order->b];
+                out[1] = in[order->g];
+                out[2] = in[order->r];
+                out[3] = in[order->a];
+                in += 4;
+            } else {
+                out[0] = in[0];
+                out[1] = in[1];
+                out[2] = in[2];
+                out[3] = 255;
+                in += 3;
+            }
+        }
+    }
+}
+
+// ARGB32 into any 32 bit layout or RGB24, in place is fine for 32 bit layouts
+static void from_bgra(const otc_video_frame* source, otc_video_frame* target) {
+    const PixelOrder* order = find_pixel_order(target->format);
+    for (int row = 0; row < source->height; row++) {
+        const uint8_t* in = source->planes[0] + row * source->strides[0];
+        uint8_t* out = target->planes[0] + row * target->strides[0];
+        for (int x = 0; x < source->width; x++, in += 4) {
+            uint8_t b = in[0], g = in[1], r = in[2], a = in[3];
+            if (order != nullptr) {
+                out[order->b] = b;
+                out[order->g] = g;
+                out[order->r] = r;
+                out[order->a] = a;
+                out += 4;
+            } else {
+                out[0] = b;
+                out[1] = g;
+                out[2] = r;
+                out += 3;
+            }
+        }
+    }
+}
+
+static bool is_bgra_family(enum otc_video_frame_format format) {
+    return find_pixel_order(format) != nullptr || format == OTC_VIDEO_FRAME_FORMAT_RGB24;
+}
+
+static bool to_i420(const otc_video_frame* source, otc_video_frame* target) {
+    int chroma_width = (source->width + 1) / 2;
+    int chroma_height = (source->height + 1) / 2;
+    switch (source->format) {
+    case OTC_VIDEO_FRAME_FORMAT_YUV420P:
+        copy_frame(source, target);
+        return true;
+    case OTC_VIDEO_FRAME_FORMAT_NV12:
+    case OTC_VIDEO_FRAME_FORMAT_NV21: {
+        bool nv21 = source->format == OTC_VIDEO_FRAME_FORMAT_NV21;
+        copy_rows(source->planes[0], source->strides[0], target->planes[0], target->strides[0],
+                  source->width, source->height);
+        split_uv_plane(source->planes[1], source->strides[1],
+                       target->planes[nv21 ? 2 : 1], target->strides[1],
+                       target->planes[nv21 ? 1 : 2], target->strides[2],
+                       chroma_width, chroma_height);
+        return true;
+    }
+    case OTC_VIDEO_FRAME_FORMAT_YUY2:
+    case OTC_VIDEO_FRAME_FORMAT_UYVY: {
+        // Y0 U Y1 V, or U Y0 V Y1. Chroma comes from the even rows.
+        bool uyvy = source->format == OTC_VIDEO_FRAME_FORMAT_UYVY;
+        int y_offset = uyvy ? 1 : 0;
+        int c_offset = uyvy ? 0 : 1;
+        for (int row = 0; row < source->height; row++) {
+            const uint8_t* in = source->planes[0] + row * source->strides[0];
+            uint8_t* y = target->planes[0] + row * target->strides[0];
+            uint8_t* u = target->planes[1] + (row / 2) * target->strides[1];
+            uint8_t* v = target->planes[2] + (row / 2) * target->strides[2];
+            for (int x = 0; x < chroma_width; x++, in += 4) {
+                y[2 * x] = in[y_offset];
+                if (2 * x + 1 < source->width) {
+                    y[2 * x + 1] = in[y_offset + 2];
+                }
+                if (row % 2 == 0) {
+                    u[x] = in[c_offset];
+                    v[x] = in[c_offset + 2];
+                }
+            }
+        }
+        return true;
+    }
+    default:
+        break;
+    }
+    if (!is_bgra_family(source->format)) {
+        return false;
+    }
+    const otc_video_frame* bgra = source;
+    otc_video_frame* converted = nullptr;
+    if (source->format != OTC_VIDEO_FRAME_FORMAT_ARGB32) {
+        converted = fake_frame_new(OTC_VIDEO_FRAME_FORMAT_ARGB32, source->width, source->height);
+        to_bgra(source, converted);
+        bgra = converted;
+    }
+    bgra_to_i420(bgra->planes[0], bgra->strides[0],
+                 target->planes[0], target->strides[0],
+                 target->planes[1], target->strides[1],
+                 target->planes[2], target->strides[2],
+                 source->width, source->height);
+    delete converted;
+    return true;
+}
+
+static bool from_i420(const otc_video_frame* source, otc_video_frame* target) {
+    int chroma_width = (source->width + 1) / 2;
+    int chroma_height = (source->height + 1) / 2;
+    switch (target->format) {
+    case OTC_VIDEO_FRAME_FORMAT_NV12:
+    case OTC_VIDEO_FRAME_FORMAT_NV21: {
+        bool nv21 = target->format == OTC_VIDEO_FRAME_FORMAT_NV21;
+        copy_rows(source->planes[0], source->strides[0], target->planes[0], target->strides[0],
+                  source->width, source->height);
+        for (int row = 0; row < chroma_height; row++) {
+            const uint8_t* u = source->planes[nv21 ? 2 : 1] + row * source->strides[1];
+            const uint8_t* v = source->planes[nv21 ? 1 : 2] + row * source->strides[2];
+            uint8_t* out = target->planes[1] + row * target->strides[1];
+            for (int x = 0; x < chroma_width; x++) {
+                out[2 * x] = u[x];
+                out[2 * x + 1] = v[x];
+            }
+        }
+        return true;
+    }
+    case OTC_VIDEO_FRAME_FORMAT_YUY2:
+    case OTC_VIDEO_FRAME_FORMAT_UYVY: {
+        bool uyvy = target->format == OTC_VIDEO_FRAME_FORMAT_UYVY;
+        int y_offset = uyvy ? 1 : 0;
+        int c_offset = uyvy ? 0 : 1;
+        for (int row = 0; row < source->height; row++) {
+            const uint8_t* y = source->planes[0] + row * source->strides[0];
+            const uint8_t* u = source->planes[1] + (row / 2) * source->strides[1];
+            const uint8_t* v = source->planes[2] + (row / 2) * source->strides[2];
+            uint8_t* out = target->planes[0] + row * target->strides[0];
+            for (int x = 0; x < chroma_width; x++, out += 4) {
+                out[y_offset] = y[2 * x];
+                out[y_offset + 2] = 2 * x + 1 < source->width ? y[2 * x + 1] : y[2 * x];
+                out[c_offset] = u[x];
+                out[c_offset + 2] = v[x];
+            }
+        }
+        return true;
+    }
+    default:
+        break;
+    }
+    if (!is_bgra_family(target->format)) {
+        return false;
+    }
+    // Straight into the target when it is 32 bit, the byte order is fixed up in place
+    otc_video_frame* bgra = target;
+    if (target->format == OTC_VIDEO_FRAME_FORMAT_RGB24) {
+        bgra = fake_frame_new(OTC_VIDEO_FRAME_FORMAT_ARGB32, source->width, source->height);
+    }
+    i420_to_bgra(source->planes[0], source->strides[0],
+                 source->planes[1], source->strides[1],
+                 source->planes[2], source->strides[2],
+                 bgra->planes[0], bgra->strides[0], source->width, source->height);
+    if (target->format != OTC_VIDEO_FRAME_FORMAT_ARGB32) {
+        from_bgra(bgra, target);
+    }
+    if (bgra != target) {
+        delete bgra;
+    }
+    return true;
+}
+
+bool fake_frame_convert_into(const otc_video_frame* source, otc_video_frame* target) {
+    if (source->width != target->width || source->height != target->height) {
+        return false;
+    }
+    if (source->format == target->format) {
+        copy_frame(source, target);
+        return true;
+    }
+    if (target->format == OTC_VIDEO_FRAME_FORMAT_YUV420P) {
+        return to_i420(source, target);
+    }
+    if (source->format == OTC_VIDEO_FRAME_FORMAT_YUV420P) {
+        return from_i420(source, target);
+    }
+    if (source->format == OTC_VIDEO_FRAME_FORMAT_NV12 && target->format == OTC_VIDEO_FRAME_FORMAT_ARGB32) {
+        nv12_to_bgra(source->planes[0], source->strides[0], source->planes[1], source->strides[1],
+                     target->planes[0], target->strides[0], source->width, source->height);
+        return true;
+    }
+    if (is_bgra_family(source->format) && is_bgra_family(target->format)) {
+        otc_video_frame* bgra = fake_frame_new(OTC_VIDEO_FRAME_FORMAT_ARGB32, source->width, source->height);
+        to_bgra(source, bgra);
+        from_bgra(bgra, target);
+        delete bgra;
+        return true;
+    }
+    // Anything else goes through I420
+    otc_video_frame* i420 = fake_frame_new(OTC_VIDEO_FRAME_FORMAT_YUV420P, source->width, source->height);
+    bool converted = to_i420(source, i420) && from_i420(i420, target);
+    delete i420;
+    return converted;
+}
+
+bool fake_frame_convert_columns(const otc_video_frame* source, otc_video_frame* target, int x, int width) {
+    if (source->width != target->width || source->height != target->height) {
+        return false;
+    }
+    // Chroma is shared by pixel pairs, so the region has to start on one
+    int end = std::min(x + width, source->width);
+    x = std::max(0, x) & ~1;
+    width = end - x;
+    if (width <= 0) {
+        return true;
+    }
+    if (end < source->width) {
+        width = (width + 1) & ~1;
+    }
+    // Same planes and strides, starting at column x
+    otc_video_frame views[2];
+    const otc_video_frame* frames[2] = { source, target };
+    for (int i = 0; i < 2; i++) {
+        const otc_video_frame* frame = frames[i];
+        otc_video_frame& view = views[i];
+        view.format = frame->format;
+        view.width = width;
+        view.height = frame->height;
+        view.timestamp = frame->timestamp;
+        view.plane_count = frame->plane_count;
+        for (int plane = 0; plane < 3; plane++) {
+            view.planes[plane] = plane < frame->plane_count
+                                     ? frame->planes[plane] + row_bytes(frame->format, plane, x)
+                                     : nullptr;
+            view.strides[plane] = frame->strides[plane];
+            view.plane_heights[plane] = frame->plane_heights[plane];
+        }
+        view.buffer = nullptr;
+        view.size = 0;
+    }
+    return fake_frame_convert_into(&views[0], &views[1]);
+}
+
+otc_video_frame* otc_video_frame_new(enum otc_video_frame_format format, int width, int height,
+                                     const uint8_t* buffer) {
+    otc_video_frame* frame = fake_frame_new(format, width, height);
+    if (frame != nullptr && buffer != nullptr) {
+        memcpy(frame->buffer, buffer, frame->size);
+    }
+    return frame;
+}
+
+otc_video_frame* otc_video_frame_new_contiguous_memory_wrapper(enum otc_video_frame_format format, int width,
+                                                               int height, otc_bool is_shallow_copyable,
+                                                               const uint8_t* buffer, size_t size) {
+    otc_video_frame* frame = frame_layout(format, width, height);
+    if (frame == nullptr) {
+        return nullptr;
+    }
+    if (buffer == nullptr || size < frame->size) {
+        delete frame;
+        return nullptr;
+    }
+    // Nothing in here writes to a frame it did not allocate itself
+    place_planes(frame, const_cast<uint8_t*>(buffer));
+    return frame;
+}
+
+otc_status otc_video_frame_delete(otc_video_frame* frame) {
+    delete frame;
+    return OTC_SUCCESS;
+}
+
+otc_video_frame* otc_video_frame_copy(const otc_video_frame* frame) {
+    otc_video_frame* copy = fake_frame_new(frame->format, frame->width, frame->height);
+    if (copy != nullptr) {
+        copy_frame(frame, copy);
+        copy->timestamp = frame->timestamp;
+    }
+    return copy;
+}
+
+otc_video_frame* otc_video_frame_convert(enum otc_video_frame_format dest_format,
+                                         const otc_video_frame* input_frame) {
+    otc_video_frame* converted = fake_frame_new(dest_format, input_frame->width, input_frame->height);
+    if (converted == nullptr) {
+        return nullptr;
+    }
+    if (!fake_frame_convert_into(input_frame, converted)) {
+        delete converted;
+        return nullptr;
+    }
+    converted->timestamp = input_frame->timestamp;
+    return converted;
+}
+
+const uint8_t* otc_video_frame_get_buffer(const otc_video_frame* frame) {
+    return frame->buffer;
+}
+
+size_t otc_video_frame_get_buffer_size(const otc_video_frame* frame) {
+    return frame->size;
+}
+
+int64_t otc_video_frame_get_timestamp(const otc_video_frame* frame) {
+    return frame->timestamp;
+}
+
+void otc_video_frame_set_timestamp(otc_video_frame* frame, int64_t timestamp) {
+    frame->timestamp = timestamp;
+}
+
+int otc_video_frame_get_width(const otc_video_frame* frame) {
+    return frame->width;
+}
+
+int otc_video_frame_get_height(const otc_video_frame* frame) {
+    return frame->height;
+}
+
+enum otc_video_frame_format otc_video_frame_get_format(const otc_video_frame* frame) {
+    return frame->format;
+}
+
+const uint8_t* otc_video_frame_get_plane_binary_data(const otc_video_frame* frame, enum otc_video_frame_plane plane) {
+    return plane < frame->plane_count ? frame->planes[plane] : nullptr;
+}
+
+size_t otc_video_frame_get_plane_size(const otc_video_frame* frame, enum otc_video_frame_plane plane) {
+    return plane < frame->plane_count ? static_cast<size_t>(frame->strides[plane]) * frame->plane_heights[plane] : 0;
+}
+
+int otc_video_frame_get_plane_stride(const otc_video_frame* frame, enum otc_video_frame_plane plane) {
+    return plane < frame->plane_count ? frame->strides[plane] : 0;
+}
+
+int otc_video_frame_get_plane_width(const otc_video_frame* frame, enum otc_video_frame_plane plane) {
+    if (plane >= frame->plane_count) {
+        return 0;
+    }
+    return plane == 0 ? frame->width : (frame->width + 1) / 2;
+}
+
+int otc_video_frame_get_plane_height(const otc_video_frame* frame, enum otc_video_frame_plane plane) {
+    return plane < frame->plane_count ? frame->plane_heights[plane] : 0;
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+/**
+ * The part of the OpenTok Linux SDK API this sample uses, implemented by
+ * the offline stand-in in this directory. Declarations match the SDK's
+ * headers, so the app builds the same against either.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+typedef int otc_bool;
+#define OTC_TRUE 1
+#define OTC_FALSE 0
+typedef int otc_status;
+#define OTC_SUCCESS 0
+#define OTC_ERROR 1
+enum otc_log_level {
+  OTC_LOG_LEVEL_DISABLED = 0,
+  OTC_LOG_LEVEL_ERROR = 1,
+  OTC_LOG_LEVEL_WARN = 2,
+  OTC_LOG_LEVEL_INFO = 3,
+  OTC_LOG_LEVEL_DEBUG = 4,
+  OTC_LOG_LEVEL_MSG = 5,
+  OTC_LOG_LEVEL_TRACE = 6,
+  OTC_LOG_LEVEL_ALL = 100,
+};
+typedef void (*otc_logger_callback)(const char* message);
+void otc_log_set_logger_callback(otc_logger_callback logger);
+void otc_log_enable(int level);
+otc_status otc_init(void* reserved);
+otc_status otc_destroy();
+enum otc_video_frame_format {
+  OTC_VIDEO_FRAME_FORMAT_UNKNOWN = 0,
+  OTC_VIDEO_FRAME_FORMAT_YUV420P = 1,
+  OTC_VIDEO_FRAME_FORMAT_NV12 = 2,
+  OTC_VIDEO_FRAME_FORMAT_NV21 = 3,
+  OTC_VIDEO_FRAME_FORMAT_YUY2 = 4,
+  OTC_VIDEO_FRAME_FORMAT_UYVY = 5,
+  OTC_VIDEO_FRAME_FORMAT_ARGB32 = 6,
+  OTC_VIDEO_FRAME_FORMAT_BGRA32 = 7,
+  OTC_VIDEO_FRAME_FORMAT_RGB24 = 8,
+  OTC_VIDEO_FRAME_FORMAT_ABGR32 = 9,
+  OTC_VIDEO_FRAME_FORMAT_MJPEG = 10,
+  OTC_VIDEO_FRAME_FORMAT_RGBA32 = 11,
+  OTC_VIDEO_FRAME_FORMAT_MAX = 12,
+  OTC_VIDEO_FRAME_FORMAT_COMPRESSED = 13,
+};
+enum otc_video_frame_plane {
+  OTC_VIDEO_FRAME_PLANE_Y = 0,
+  OTC_VIDEO_FRAME_PLANE_U = 1,
+  OTC_VIDEO_FRAME_PLANE_V = 2,
+  OTC_VIDEO_FRAME_PLANE_PACKED = 0,
+  OTC_VIDEO_FRAME_PLANE_UV_INTERLEAVED = 1,
+};
+typedef struct otc_video_frame otc_video_frame;
+typedef struct otc_stream otc_stream;
+typedef struct otc_session otc_session;
+typedef struct otc_publisher otc_publisher;
+typedef struct otc_subscriber otc_subscriber;
+typedef struct otc_connection otc_connection;
+typedef struct otc_video_capturer otc_video_capturer;
+typedef struct otc_audio_device otc_audio_device;
+otc_video_frame* otc_video_frame_new(enum otc_video_frame_format format, int width, int height, const uint8_t* buffer);
+otc_video_frame* otc_video_frame_new_contiguous_memory_wrapper(enum otc_video_frame_format format, int width, int height, otc_bool is_shallow_copyable, const uint8_t* buffer, size_t size);
+otc_status otc_video_frame_delete(otc_video_frame* frame);
+otc_video_frame* otc_video_frame_copy(const otc_video_frame* frame);
+otc_video_frame* otc_video_frame_convert(enum otc_video_frame_format dest_format, const otc_video_frame* input_frame);
+const uint8_t* otc_video_frame_get_buffer(const otc_video_frame* frame);
+size_t otc_video_frame_get_buffer_size(const otc_video_frame* frame);
+int64_t otc_video_frame_get_timestamp(const otc_video_frame* frame);
+void otc_video_frame_set_timestamp(otc_video_frame* frame, int64_t timestamp);
+int otc_video_frame_get_width(const otc_video_frame* frame);
+int otc_video_frame_get_height(const otc_video_frame* frame);
+enum otc_video_frame_format otc_video_frame_get_format(const otc_video_frame* frame);
+const uint8_t* otc_video_frame_get_plane_binary_data(const otc_video_frame* frame, enum otc_video_frame_plane plane);
+size_t otc_video_frame_get_plane_size(const otc_video_frame* frame, enum otc_video_frame_plane plane);
+int otc_video_frame_get_plane_stride(const otc_video_frame* frame, enum otc_video_frame_plane plane);
+int otc_video_frame_get_plane_width(const otc_video_frame* frame, enum otc_video_frame_plane plane);
+int otc_video_frame_get_plane_height(const otc_video_frame* frame, enum otc_video_frame_plane plane);
+const char* otc_stream_get_id(const otc_stream* stream);
+otc_stream* otc_stream_copy(const otc_stream* stream);
+otc_status otc_stream_delete(otc_stream* stream);
+struct otc_video_capturer_settings {
+  int format;
+  int width;
+  int height;
+  int fps;
+  int expected_delay;
+  otc_bool mirror_on_local_render;
+};
+struct otc_video_capturer_callbacks {
+  otc_bool (*init)(const otc_video_capturer* capturer, void* user_data);
+  otc_bool (*destroy)(const otc_video_capturer* capturer, void* user_data);
+  otc_bool (*start)(const otc_video_capturer* capturer, void* user_data);
+  otc_bool (*stop)(const otc_video_capturer* capturer, void* user_data);
+  otc_bool (*get_capture_settings)(const otc_video_capturer* capturer, void* user_data, struct otc_video_capturer_settings* settings);
+  void* user_data;
+  void* reserved;
+};
+int otc_video_capturer_provide_frame(const otc_video_capturer* capturer, int rotation, const otc_video_frame* frame);
+enum otc_subscriber_error_code {
+  OTC_SUBSCRIBER_INTERNAL_ERROR = 2000,
+};
+struct otc_subscriber_callbacks {
+  void (*on_connected)(otc_subscriber* subscriber, void* user_data, const otc_stream* stream);
+  void (*on_disconnected)(otc_subscriber* subscriber, void* user_data);
+  void (*on_reconnected)(otc_subscriber* subscriber, void* user_data);
+  void (*on_render_frame)(otc_subscriber* subscriber, void* user_data, const otc_video_frame* frame);
+  void (*on_video_disabled)(otc_subscriber* subscriber, void* user_data, int reason);
+  void (*on_video_enabled)(otc_subscriber* subscriber, void* user_data, int reason);
+  void (*on_audio_disabled)(otc_subscriber* subscriber, void* user_data);
+  void (*on_audio_enabled)(otc_subscriber* subscriber, void* user_data);
+  void (*on_video_data_received)(otc_subscriber* subscriber, void* user_data);
+  void (*on_video_disable_warning)(otc_subscriber* subscriber, void* user_data);
+  void (*on_video_disable_warning_lifted)(otc_subscriber* subscriber, void* user_data);
+  void (*on_audio_stats)(otc_subscriber* subscriber, void* user_data, const void* audio_stats);
+  void (*on_video_stats)(otc_subscriber* subscriber, void* user_data, const void* video_stats);
+  void (*on_audio_level_updated)(otc_subscriber* subscriber, void* user_data, float audio_level);
+  void (*on_error)(otc_subscriber* subscriber, void* user_data, const char* error_string, enum otc_subscriber_error_code error);
+  void* user_data;
+  void* reserved;
+};
+otc_subscriber* otc_subscriber_new(const otc_stream* stream, const struct otc_subscriber_callbacks* callbacks);
+otc_status otc_subscriber_delete(otc_subscriber* subscriber);
+otc_stream* otc_subscriber_get_stream(const otc_subscriber* subscriber);
+otc_status otc_subscriber_set_subscribe_to_video(otc_subscriber* subscriber, otc_bool subscribe_to_video);
+otc_status otc_subscriber_set_subscribe_to_audio(otc_subscriber* subscriber, otc_bool subscribe_to_audio);
+void* otc_subscriber_get_user_data(const otc_subscriber* subscriber);
+enum otc_session_error_code {
+  OTC_SESSION_AUTHORIZATION_FAILURE = 1004,
+};
+struct otc_session_callbacks {
+  void (*on_connected)(otc_session* session, void* user_data);
+  void (*on_disconnected)(otc_session* session, void* user_data);
+  void (*on_connection_created)(otc_session* session, void* user_data, const otc_connection* connection);
+  void (*on_connection_dropped)(otc_session* session, void* user_data, const otc_connection* connection);
+  void (*on_stream_received)(otc_session* session, void* user_data, const otc_stream* stream);
+  void (*on_stream_dropped)(otc_session* session, void* user_data, const otc_stream* stream);
+  void (*on_stream_has_audio_changed)(otc_session* session, void* user_data, const otc_stream* stream, otc_bool has_audio);
+  void (*on_stream_has_video_changed)(otc_session* session, void* user_data, const otc_stream* stream, otc_bool has_video);
+  void (*on_stream_video_dimensions_changed)(otc_session* session, void* user_data, const otc_stream* stream, int width, int height);
+  void (*on_stream_video_type_changed)(otc_session* session, void* user_data, const otc_stream* stream, int type);
+  void (*on_signal_received)(otc_session* session, void* user_data, const char* type, const char* signal, const otc_connection* connection);
+  void (*on_reconnection_started)(otc_session* session, void* user_data);
+  void (*on_reconnected)(otc_session* session, void* user_data);
+  void (*on_archive_started)(otc_session* session, void* user_data, const char* archive_id, const char* name);
+  void (*on_archive_stopped)(otc_session* session, void* user_data, const char* archive_id);
+  void (*on_error)(otc_session* session, void* user_data, const char* error_string, enum otc_session_error_code error);
+  void* user_data;
+  void* reserved;
+};
+otc_session* otc_session_new(const char* apikey, const char* session_id, const struct otc_session_callbacks* callbacks);
+otc_status otc_session_delete(otc_session* session);
+otc_status otc_session_connect(otc_session* session, const char* token);
+otc_status otc_session_disconnect(otc_session* session);
+otc_status otc_session_publish(otc_session* session, otc_publisher* publisher);
+otc_status otc_session_unpublish(otc_session* session, otc_publisher* publisher);
+otc_status otc_session_subscribe(otc_session* session, otc_subscriber* subscriber);
+otc_status otc_session_unsubscribe(otc_session* session, otc_subscriber* subscriber);
+enum otc_publisher_error_code {
+  OTC_PUBLISHER_INTERNAL_ERROR = 2000,
+};
+struct otc_publisher_callbacks {
+  void (*on_stream_created)(otc_publisher* publisher, void* user_data, const otc_stream* stream);
+  void (*on_stream_destroyed)(otc_publisher* publisher, void* user_data, const otc_stream* stream);
+  void (*on_render_frame)(otc_publisher* publisher, void* user_data, const otc_video_frame* frame);
+  void (*on_audio_level_updated)(otc_publisher* publisher, void* user_data, float audio_level);
+  void (*on_audio_stats)(otc_publisher* publisher, void* user_data, const void* audio_stats, size_t number_of_stats);
+  void (*on_video_stats)(otc_publisher* publisher, void* user_data, const void* video_stats, size_t number_of_stats);
+  void (*on_error)(otc_publisher* publisher, void* user_data, const char* error_string, enum otc_publisher_error_code error_code);
+  void* user_data;
+  void* reserved;
+};
+otc_publisher* otc_publisher_new(const char* name, const struct otc_video_capturer_callbacks* capturer, const struct otc_publisher_callbacks* callbacks);
+otc_status otc_publisher_delete(otc_publisher* publisher);
+otc_status otc_publisher_set_publish_video(otc_publisher* publisher, otc_bool publish_video);
+otc_status otc_publisher_set_publish_audio(otc_publisher* publisher, otc_bool publish_audio);
+struct otc_audio_device_settings {
+  int number_of_channels;
+  int sampling_rate;
+};
+struct otc_audio_device_callbacks {
+  otc_bool (*init)(const otc_audio_device* audio_device, void* user_data);
+  otc_bool (*destroy)(const otc_audio_device* audio_device, void* user_data);
+  otc_bool (*init_capturer)(const otc_audio_device* audio_device, void* user_data);
+  otc_bool (*destroy_capturer)(const otc_audio_device* audio_device, void* user_data);
+  otc_bool (*start_capturer)(const otc_audio_device* audio_device, void* user_data);
+  otc_bool (*stop_capturer)(const otc_audio_device* audio_device, void* user_data);
+  otc_bool (*is_capturer_initialized)(const otc_audio_device* audio_device, void* user_data);
+  otc_bool (*is_capturer_started)(const otc_audio_device* audio_device, void* user_data);
+  int (*get_estimated_capture_delay)(const otc_audio_device* audio_device, void* user_data);
+  otc_bool (*get_capture_settings)(const otc_audio_device* audio_device, void* user_data, struct otc_audio_device_settings* settings);
+  otc_bool (*init_renderer)(const otc_audio_device* audio_device, void* user_data);
+  otc_bool (*destroy_renderer)(const otc_audio_device* audio_device, void* user_data);
+  otc_bool (*start_renderer)(const otc_audio_device* audio_device, void* user_data);
+  otc_bool (*stop_renderer)(const otc_audio_device* audio_device, void* user_data);
+  otc_bool (*is_renderer_initialized)(const otc_audio_device* audio_device, void* user_data);
+  otc_bool (*is_renderer_started)(const otc_audio_device* audio_device, void* user_data);
+  int (*get_estimated_render_delay)(const otc_audio_device* audio_device, void* user_data);
+  otc_bool (*get_render_settings)(const otc_audio_device* audio_device, void* user_data, struct otc_audio_device_settings* settings);
+  void* user_data;
+  void* reserved;
+};
+otc_status otc_set_audio_device(const struct otc_audio_device_callbacks* callbacks);
+size_t otc_audio_device_read_render_data(int16_t* buffer, size_t number_of_samples);
+otc_status otc_audio_device_write_capture_data(const int16_t* data, size_t number_of_samples);
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,153 @@
+#include "frame_pacer.h"
+
+#include <chrono>
+#include <stdlib.h>
+
+using namespace std;
+
+// Stream timestamps are in microseconds
+static const int64_t DEFAULT_FRAME_INTERVAL_US = 33333;
+static const int64_t MAX_FRAME_INTERVAL_US = 1000000;
+
+FramePacer::FramePacer(FramePool* pool)
+    : pool(pool), head(0), tail(0), current_present_us(0), last_swap_us(0), offset_us(0), have_offset(false),
+      frame_interval_us(DEFAULT_FRAME_INTERVAL_US), last_received_timestamp(0),
+      judder_ms(0), shown(0), duplicates(0), late(0), skipped(0), judder_us(0), queued(0) {
+    this->current.buffer = nullptr;
+    this->current.arrival_us = 0;
+    this->waiting.reserve(CAPACITY);
+}
+
+FramePacer::~FramePacer() {
+    this->flush();
+}
+
+int64_t FramePacer::now_us() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool FramePacer::push(VideoBuffer* buffer) {
+    uint32_t head = this->head.load(std::memory_order_relaxed);
+    if (head - this->tail.load(std::memory_order_acquire) == CAPACITY) {
+        return false;
+    }
+    Entry& entry = this->ring[head % CAPACITY];
+    entry.buffer = buffer;
+    entry.arrival_us = now_us();
+    this->head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+int64_t FramePacer::presentation_time(const Entry& entry, int depth) const {
+    return entry.buffer->timestamp + this->offset_us + depth * this->frame_interval_us;
+}
+
+void FramePacer::receive(int depth) {
+    uint32_t tail = this->tail.load(std::memory_order_relaxed);
+    uint32_t head = this->head.load(std::memory_order_acquire);
+    for (; tail != head; tail++) {
+        Entry entry = this->ring[tail % CAPACITY];
+        int64_t timestamp = entry.buffer->timestamp;
+
+        int64_t delta = timestamp - this->last_received_timestamp;
+        if (this->last_received_timestamp != 0 && delta > 0 && delta < MAX_FRAME_INTERVAL_US) {
+            this->frame_interval_us += (delta - this->frame_interval_us) / 8;
+        }
+        this->last_received_timestamp = timestamp;
+
+        // The fastest frame seen defines the mapping. It creeps up by 0.1% of a
+        // frame per frame so clock drift and route changes are followed.
+        int64_t transit = entry.arrival_us - timestamp;
+        if (!this->have_offset || transit < this->offset_us) {
+            this->offset_us = transit;
+            this->have_offset = true;
+        } else {
+            this->offset_us += this->frame_interval_us / 1000;
+        }
+
+        if (entry.arrival_us > this->presentation_time(entry, depth)) {
+            this->late++;
+        }
+        if (this->waiting.size() == CAPACITY) {
+            this->pool->release(this->waiting.front().buffer);
+            this->waiting.erase(this->waiting.begin());
+            this->skipped++;
+        }
+        this->waiting.push_back(entry);
+    }
+    this->tail.store(tail, std::memory_order_release);
+    this->queued.store(static_cast<int>(this->waiting.size()), std::memory_order_relaxed);
+}
+
+const VideoBuffer* FramePacer::select(int64_t next_swap_us, int depth) {
+    this->receive(depth);
+
+    // Newest frame due by the upcoming swap, rounding to the nearest refresh
+    int chosen = -1;
+    for (size_t i = 0; i < this->waiting.size(); i++) {
+        if (this->presentation_time(this->waiting[i], depth) <= next_swap_us + this->frame_interval_us / 2) {
+            chosen = static_cast<int>(i);
+        }
+    }
+    // Nothing on screen yet, start with the oldest instead of waiting
+    if (chosen < 0 && this->current.buffer == nullptr && !this->waiting.empty()) {
+        chosen = 0;
+    }
+
+    if (chosen < 0) {
+        if (this->current.buffer != nullptr && next_swap_us > this->current_present_us + this->frame_interval_us) {
+            this->duplicates++;
+        }
+        return this->current.buffer;
+    }
+
+    for (int i = 0; i < chosen; i++) {
+        this->pool->release(this->waiting[i].buffer);
+        this->skipped++;
+    }
+    Entry next = this->waiting[chosen];
+    this->waiting.erase(this->waiting.begin(), this->waiting.begin() + chosen + 1);
+    this->queued.store(static_cast<int>(this->waiting.size()), std::memory_order_relaxed);
+
+    if (this->current.buffer != nullptr) {
+        int64_t stream_interval = next.buffer->timestamp - this->current.buffer->timestamp;
+        int64_t shown_interval = next_swap_us - this->last_swap_us;
+        if (stream_interval > 0 && stream_interval < MAX_FRAME_INTERVAL_US) {
+            double error_ms = llabs(shown_interval - stream_interval) / 1000.0;
+            this->judder_ms += (error_ms - this->judder_ms) / 16;
+            this->judder_us.store(static_cast<int64_t>(this->judder_ms * 1000), std::memory_order_relaxed);
+        }
+        this->pool->release(this->current.buffer);
+    }
+    this->current = next;
+    this->current_present_us = this->presentation_time(next, depth);
+    this->last_swap_us = next_swap_us;
+    this->shown++;
+    return this->current.buffer;
+}
+
+void FramePacer::flush() {
+    this->receive(0);
+    for (const Entry& entry : this->waiting) {
+        this->pool->release(entry.buffer);
+    }
+    this->waiting.clear();
+    this->queued.store(0, std::memory_order_relaxed);
+    if (this->current.buffer != nullptr) {
+        this->pool->release(this->current.buffer);
+        this->current.buffer = nullptr;
+    }
+    this->have_offset = false;
+    this->last_received_timestamp = 0;
+}
+
+FramePacer::Stats FramePacer::stats() const {
+    Stats stats;
+    stats.shown = this->shown;
+    stats.duplicates = this->duplicates;
+    stats.late = this->late;
+    stats.skipped = this->skipped;
+    stats.judder_ms = this->judder_us.load(std::memory_order_relaxed) / 1000.0;
+    stats.queued = this->queued.load(std::memory_order_relaxed);
+    return stats;
+}
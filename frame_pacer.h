@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+#include "frame_pool.h"
+
+/**
+ * Per-stream presentation queue. The producer pushes frames as they are
+ * converted, the render thread asks once per refresh which frame to show
+ * for the upcoming swap.
+ *
+ * Stream timestamps are mapped onto the local clock using the lowest
+ * observed transit delay, and every frame is scheduled depth frame
+ * intervals after that. A deeper queue absorbs more network jitter at the
+ * cost of the same amount of latency.
+ */
+class FramePacer {
+public:
+    struct Stats {
+        uint64_t shown;
+        // Refreshes that repeated a frame because the next one was not there yet
+        uint64_t duplicates;
+        // Frames that arrived after the time they should have been shown
+        uint64_t late;
+        // Frames dropped without being shown
+        uint64_t skipped;
+        // Mean absolute difference between displayed and stream frame intervals
+        double judder_ms;
+        int queued;
+    };
+
+    static const int CAPACITY = 16;
+
+    FramePacer(FramePool* pool);
+    ~FramePacer();
+
+    static int64_t now_us();
+
+    // Producer side. Returns false and leaves the buffer with the caller when the queue is full.
+    bool push(VideoBuffer* buffer);
+
+    // Consumer side. Returns the frame to show at next_swap_us, which stays
+    // valid until the next call, or nullptr if nothing has been queued yet.
+    const VideoBuffer* select(int64_t next_swap_us, int depth);
+    // Gives every queued and shown frame back to the pool
+    void flush();
+
+    // Any thread
+    Stats stats() const;
+
+private:
+    struct Entry {
+        VideoBuffer* buffer;
+        int64_t arrival_us;
+    };
+
+    void receive(int depth);
+    int64_t presentation_time(const Entry& entry, int depth) const;
+
+    FramePool* pool;
+
+    // Single producer / single consumer ring
+    Entry ring[CAPACITY];
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+
+    // Everything below belongs to the consumer
+    std::vector<Entry> waiting;
+    Entry current;
+    int64_t current_present_us;
+    int64_t last_swap_us;
+    int64_t offset_us;
+    bool have_offset;
+    int64_t frame_interval_us;
+    int64_t last_received_timestamp;
+
+    double judder_ms;
+
+    // Written by the consumer, read by stats() from the UI thread
+    std::atomic<uint64_t> shown;
+    std::atomic<uint64_t> duplicates;
+    std::atomic<uint64_t> late;
+    std::atomic<uint64_t> skipped;
+    std::atomic<int64_t> judder_us;
+    std::atomic<int> queued;
+};
@@ -0,0 +1,131 @@
+#include "frame_pool.h"
+
+#include <string.h>
+
+VideoBuffer::VideoBuffer(enum otc_video_frame_format format, int width, int height)
+    : format(format), width(width), height(height), plane_count(0), timestamp(0), received_us(0), latency_stamp(-1), sequence(0) {
+    int chroma_width = (width + 1) / 2;
+    int chroma_height = (height + 1) / 2;
+
+    switch (format) {
+    case OTC_VIDEO_FRAME_FORMAT_YUV420P:
+        this->plane_count = 3;
+        this->plane_widths[0] = width;
+        this->plane_heights[0] = height;
+        this->strides[0] = width;
+        for (int i = 1; i < 3; i++) {
+            this->plane_widths[i] = chroma_width;
+            this->plane_heights[i] = chroma_height;
+            this->strides[i] = chroma_width;
+        }
+        break;
+    case OTC_VIDEO_FRAME_FORMAT_NV12:
+        this->plane_count = 2;
+        this->plane_widths[0] = width;
+        this->plane_heights[0] = height;
+        this->strides[0] = width;
+        this->plane_widths[1] = chroma_width;
+        this->plane_heights[1] = chroma_height;
+        this->strides[1] = chroma_width * 2;
+        break;
+    default:
+        this->plane_count = 1;
+        this->plane_widths[0] = width;
+        this->plane_heights[0] = height;
+        this->strides[0] = width * 4;
+        break;
+    }
+
+    size_t total = 0;
+    for (int i = 0; i < this->plane_count; i++) {
+        total += static_cast<size_t>(this->strides[i]) * this->plane_heights[i];
+    }
+    this->storage.resize(total);
+
+    uint8_t* plane = this->storage.data();
+    for (int i = 0; i < 3; i++) {
+        if (i < this->plane_count) {
+            this->planes[i] = plane;
+            plane += static_cast<size_t>(this->strides[i]) * this->plane_heights[i];
+        } else {
+            this->planes[i] = nullptr;
+            this->strides[i] = this->plane_widths[i] = this->plane_heights[i] = 0;
+        }
+    }
+}
+
+std::atomic<uint64_t> FramePool::all_pools_bytes(0);
+
+FramePool::FramePool() : format(OTC_VIDEO_FRAME_FORMAT_UNKNOWN), width(0), height(0),
+                         hits(0), misses(0), bytes_held(0) {
+}
+
+FramePool::~FramePool() {
+    for (VideoBuffer* buffer : this->free_buffers) {
+        this->free_buffer(buffer);
+    }
+}
+
+void FramePool::free_buffer(VideoBuffer* buffer) {
+    this->bytes_held -= buffer->size();
+    all_pools_bytes -= buffer->size();
+    delete buffer;
+}
+
+VideoBuffer* FramePool::acquire(enum otc_video_frame_format format, int width, int height) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    if (format != this->format || width != this->width || height != this->height) {
+        // Resolution or format change, nothing we hold is useful anymore
+        for (VideoBuffer* buffer : this->free_buffers) {
+            this->free_buffer(buffer);
+        }
+        this->free_buffers.clear();
+        this->format = format;
+        this->width = width;
+        this->height = height;
+    }
+
+    if (!this->free_buffers.empty()) {
+        VideoBuffer* buffer = this->free_buffers.back();
+        this->free_buffers.pop_back();
+        this->hits++;
+        return buffer;
+    }
+
+    VideoBuffer* buffer = new VideoBuffer(format, width, height);
+    this->bytes_held += buffer->size();
+    all_pools_bytes += buffer->size();
+    this->misses++;
+    return buffer;
+}
+
+void FramePool::release(VideoBuffer* buffer) {
+    if (buffer == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (buffer->matches(this->format, this->width, this->height)) {
+        this->free_buffers.push_back(buffer);
+    } else {
+        this->free_buffer(buffer);
+    }
+}
+
+FramePool::Stats FramePool::stats() const {
+    Stats stats;
+    stats.hits = this->hits;
+    stats.misses = this->misses;
+    stats.bytes_held = this->bytes_held;
+    return stats;
+}
+
+void copy_plane(const uint8_t* src, int src_stride, uint8_t* dst, int dst_stride, int row_size, int rows) {
+    if (src_stride == row_size && dst_stride == row_size) {
+        memcpy(dst, src, static_cast<size_t>(row_size) * rows);
+        return;
+    }
+    for (int y = 0; y < rows; y++) {
+        memcpy(dst + static_cast<size_t>(y) * dst_stride, src + static_cast<size_t>(y) * src_stride, row_size);
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <opentok.h>
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * A decoded frame owned by the application. Planes live in a single
+ * allocation with tightly packed rows. Only YUV420P, NV12 and the 32 bit
+ * RGB formats (ARGB32, BGRA32, ABGR32, RGBA32) are used.
+ */
+struct VideoBuffer {
+    enum otc_video_frame_format format;
+    int width;
+    int height;
+    int plane_count;
+    uint8_t* planes[3];
+    int strides[3];
+    // In pixels of the plane, so an NV12 UV plane is half the frame width
+    int plane_widths[3];
+    int plane_heights[3];
+    int64_t timestamp;
+    // FramePacer::now_us() when the SDK delivered the frame, for tracing
+    int64_t received_us;
+    // Capture time read from the pixels (see latency_stamp.h), -1 without one
+    int64_t latency_stamp;
+    // Per stream, increases by one for every frame delivered
+    uint64_t sequence;
+    std::vector<uint8_t> storage;
+
+    VideoBuffer(enum otc_video_frame_format format, int width, int height);
+
+    size_t size() const { return this->storage.size(); }
+    // One plane of 32 bit RGB pixels
+    bool packed() const { return this->plane_count == 1; }
+    int bytes_per_pixel(int plane) const {
+        if (this->packed()) return 4;
+        return (this->format == OTC_VIDEO_FRAME_FORMAT_NV12 && plane == 1) ? 2 : 1;
+    }
+    bool matches(enum otc_video_frame_format format, int width, int height) const {
+        return this->format == format && this->width == width && this->height == height;
+    }
+};
+
+/**
+ * Recycles VideoBuffers for one stream. Buffers are keyed by format and
+ * resolution. When a stream switches to a new key, the idle buffers of the
+ * old one are freed immediately. Buffers still in flight are freed as they
+ * are released.
+ */
+class FramePool {
+public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t bytes_held;
+    };
+
+    FramePool();
+    ~FramePool();
+
+    VideoBuffer* acquire(enum otc_video_frame_format format, int width, int height);
+    void release(VideoBuffer* buffer);
+
+    Stats stats() const;
+
+    // Bytes allocated by every pool together, for leak checks
+    static uint64_t total_bytes() { return all_pools_bytes.load(); }
+
+private:
+    void free_buffer(VideoBuffer* buffer);
+
+    std::mutex mutex;
+    std::vector<VideoBuffer*> free_buffers;
+    enum otc_video_frame_format format;
+    int width;
+    int height;
+
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+    std::atomic<uint64_t> bytes_held;
+
+    static std::atomic<uint64_t> all_pools_bytes;
+};
+
+// Copies a plane row by row, strides are in bytes
+void copy_plane(const uint8_t* src, int src_stride, uint8_t* dst, int dst_stride, int row_size, int rows);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+
+/**
+ * GL objects of streams that went away. They are collected while
+ * renderers are torn down and deleted in one go, after the frame that may
+ * still have drawn them has been submitted.
+ */
+struct GlGarbage {
+    std::vector<GLuint> textures;
+    std::vector<GLuint> buffers;
+    std::vector<GLsync> fences;
+
+    bool empty() const {
+        return this->textures.empty() && this->buffers.empty() && this->fences.empty();
+    }
+
+    // GL context must be current
+    void flush() {
+        if (!this->textures.empty()) {
+            glDeleteTextures(static_cast<GLsizei>(this->textures.size()), this->textures.data());
+            this->textures.clear();
+        }
+        if (!this->buffers.empty()) {
+            glDeleteBuffers(static_cast<GLsizei>(this->buffers.size()), this->buffers.data());
+            this->buffers.clear();
+        }
+        for (GLsync fence : this->fences) {
+            glDeleteSync(fence);
+        }
+        this->fences.clear();
+    }
+};
@@ -0,0 +1,116 @@
+#include "latency_probe.h"
+#include "imgui.h"
+#include "log.h"
+
+#include <algorithm>
+#include <float.h>
+#include <stdio.h>
+#include <time.h>
+
+using namespace std;
+
+LatencyProbe::LatencyProbe() : buckets(MAX_MS + 1, 0), samples(0), total_us(0), max_ms(0) {
+}
+
+void LatencyProbe::frame_shown(uint32_t stamp_us) {
+    this->shown.push_back(stamp_us);
+}
+
+void LatencyProbe::frame_presented(int64_t swap_us) {
+    for (uint32_t stamp_us : this->shown) {
+        // Stamps keep the low 32 bits of the clock, wrapping every 71 minutes
+        int64_t latency_us = static_cast<int32_t>(static_cast<uint32_t>(swap_us) - stamp_us);
+        if (latency_us < 0) {
+            // From another clock, or a misread stamp that still passed the checksum
+            continue;
+        }
+        int ms = static_cast<int>(min<int64_t>(latency_us / 1000, MAX_MS));
+        this->buckets[ms]++;
+        this->samples++;
+        this->total_us += latency_us;
+        this->max_ms = max(this->max_ms, ms);
+    }
+    this->shown.clear();
+}
+
+int LatencyProbe::percentile(double fraction) const {
+    uint64_t wanted = static_cast<uint64_t>(this->samples * fraction);
+    uint64_t seen = 0;
+    for (int ms = 0; ms <= MAX_MS; ms++) {
+        seen += this->buckets[ms];
+        if (seen > wanted) {
+            return ms;
+        }
+    }
+    return MAX_MS;
+}
+
+LatencyProbe::Stats LatencyProbe::stats() const {
+    Stats stats;
+    stats.samples = this->samples;
+    stats.mean_ms = this->samples > 0 ? this->total_us / 1000.0 / this->samples : 0.0;
+    stats.max_ms = this->max_ms;
+    stats.p50_ms = this->percentile(0.5);
+    stats.p90_ms = this->percentile(0.9);
+    stats.p99_ms = this->percentile(0.99);
+    stats.p999_ms = this->percentile(0.999);
+    return stats;
+}
+
+void LatencyProbe::reset() {
+    fill(this->buckets.begin(), this->buckets.end(), 0);
+    this->samples = 0;
+    this->total_us = 0;
+    this->max_ms = 0;
+}
+
+void LatencyProbe::draw() {
+    ImGui::Begin("Latency");
+    Stats stats = this->stats();
+    ImGui::Text("Capture to swap, %llu frames", (unsigned long long)stats.samples);
+    if (stats.samples > 0) {
+        ImGui::Text("Mean: %.1f ms  Max: %d ms", stats.mean_ms, stats.max_ms);
+        ImGui::Text("p50: %d ms  p90: %d ms  p99: %d ms  p99.9: %d ms",
+                    stats.p50_ms, stats.p90_ms, stats.p99_ms, stats.p999_ms);
+
+        // Up to just past p99.9 in 1 ms bars, the long tail is in the numbers above
+        int shown_ms = min(max(stats.p999_ms + 5, 20), MAX_MS + 1);
+        float bars[MAX_MS + 1];
+        for (int ms = 0; ms < shown_ms; ms++) {
+            bars[ms] = static_cast<float>(this->buckets[ms]);
+        }
+        ImGui::PlotHistogram("##latency", bars, shown_ms, 0, nullptr, 0.0f, FLT_MAX,
+                             ImVec2(ImGui::GetContentRegionAvail().x, 120));
+    }
+    if (ImGui::Button("Reset")) {
+        this->reset();
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Dump CSV")) {
+        char path[64];
+        snprintf(path, sizeof(path), "latency-%lld.csv", (long long)time(nullptr));
+        if (this->dump(path)) {
+            LOG_INFO("Latency histogram written to %s", path);
+        }
+    }
+    ImGui::End();
+}
+
+bool LatencyProbe::dump(const char* path) const {
+    FILE* file = fopen(path, "w");
+    if (file == nullptr) {
+        LOG_ERROR("Could not write latency histogram to %s", path);
+        return false;
+    }
+    Stats stats = this->stats();
+    fprintf(file, "samples,mean_ms,max_ms,p50_ms,p90_ms,p99_ms,p999_ms\n");
+    fprintf(file, "%llu,%.3f,%d,%d,%d,%d,%d\n", (unsigned long long)stats.samples, stats.mean_ms, stats.max_ms,
+            stats.p50_ms, stats.p90_ms, stats.p99_ms, stats.p999_ms);
+    fprintf(file, "\nlatency_ms,frames\n");
+    for (int ms = 0; ms <= MAX_MS; ms++) {
+        if (this->buckets[ms] > 0) {
+            fprintf(file, "%d,%llu\n", ms, (unsigned long long)this->buckets[ms]);
+        }
+    }
+    return fclose(file) == 0;
+}
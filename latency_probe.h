@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Capture to display latency of stamped frames (see latency_stamp.h).
+ * Renderers report the stamp of every new frame they draw, and once the
+ * buffer swap returns the frame counts as displayed.
+ *
+ * Latencies go into 1 ms buckets, so percentiles cost nothing to keep up
+ * to date and dumps can be compared between builds.
+ */
+class LatencyProbe {
+public:
+    struct Stats {
+        uint64_t samples;
+        double mean_ms;
+        int max_ms;
+        int p50_ms;
+        int p90_ms;
+        int p99_ms;
+        int p999_ms;
+    };
+
+    LatencyProbe();
+
+    // Main thread only, while building the frame
+    void frame_shown(uint32_t stamp_us);
+    // Main thread only, right after the buffer swap
+    void frame_presented(int64_t swap_us);
+
+    Stats stats() const;
+    void reset();
+    void draw();
+    // CSV of the percentiles and every bucket
+    bool dump(const char* path) const;
+
+private:
+    // Everything above lands in the last bucket
+    static const int MAX_MS = 1000;
+
+    int percentile(double fraction) const;
+
+    std::vector<uint32_t> shown;
+    std::vector<uint64_t> buckets;
+    uint64_t samples;
+    int64_t total_us;
+    int max_ms;
+};
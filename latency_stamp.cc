@@ -0,0 +1,51 @@
+#include "latency_stamp.h"
+
+static const uint32_t MARKER = 0xb00c;
+static const int COLUMNS = LATENCY_STAMP_WIDTH / LATENCY_STAMP_BLOCK;
+static const int BITS = 56;
+// Limited range black and white
+static const uint8_t BLACK = 16;
+static const uint8_t WHITE = 235;
+
+static uint8_t checksum(uint32_t time_us) {
+    return static_cast<uint8_t>(time_us ^ (time_us >> 8) ^ (time_us >> 16) ^ (time_us >> 24) ^ 0xa5);
+}
+
+void latency_stamp_write(uint8_t* y, int y_stride, int width, int height, uint32_t time_us) {
+    if (width < LATENCY_STAMP_WIDTH || height < LATENCY_STAMP_HEIGHT) {
+        return;
+    }
+    uint64_t bits = (static_cast<uint64_t>(MARKER) << 40) | (static_cast<uint64_t>(time_us) << 8) | checksum(time_us);
+    for (int row = 0; row < LATENCY_STAMP_HEIGHT; row++) {
+        uint8_t* line = y + row * y_stride;
+        for (int x = 0; x < LATENCY_STAMP_WIDTH; x++) {
+            int bit = (row / LATENCY_STAMP_BLOCK) * COLUMNS + x / LATENCY_STAMP_BLOCK;
+            line[x] = (bits >> (BITS - 1 - bit)) & 1 ? WHITE : BLACK;
+        }
+    }
+}
+
+bool latency_stamp_read(const uint8_t* pixels, int stride, int bytes_per_pixel, int width, int height,
+                        uint32_t* time_us) {
+    if (pixels == nullptr || width < LATENCY_STAMP_WIDTH || height < LATENCY_STAMP_HEIGHT) {
+        return false;
+    }
+    // In every 32 bit RGB layout the SDK uses byte 1 is a color, never alpha
+    int offset = bytes_per_pixel == 4 ? 1 : 0;
+    uint64_t bits = 0;
+    for (int bit = 0; bit < BITS; bit++) {
+        // Average the middle 2x2 pixels, edges blur the most
+        int x = (bit % COLUMNS) * LATENCY_STAMP_BLOCK + LATENCY_STAMP_BLOCK / 2 - 1;
+        int y = (bit / COLUMNS) * LATENCY_STAMP_BLOCK + LATENCY_STAMP_BLOCK / 2 - 1;
+        const uint8_t* top = pixels + y * stride + x * bytes_per_pixel + offset;
+        const uint8_t* bottom = top + stride;
+        int sum = top[0] + top[bytes_per_pixel] + bottom[0] + bottom[bytes_per_pixel];
+        bits = (bits << 1) | (sum > 4 * 128 ? 1 : 0);
+    }
+    uint32_t time = static_cast<uint32_t>(bits >> 8);
+    if ((bits >> 40) != MARKER || static_cast<uint8_t>(bits) != checksum(time)) {
+        return false;
+    }
+    *time_us = time;
+    return true;
+}
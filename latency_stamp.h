@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * A capture time written into the pixels of a frame, so it survives the
+ * encoder, the network and the decoder. 56 bits (a marker, the low 32 bits
+ * of FramePacer::now_us() and a checksum) are drawn as black and white
+ * blocks big enough for a video codec to keep them readable, in the top
+ * left corner of the luma plane.
+ */
+
+static const int LATENCY_STAMP_BLOCK = 16;
+static const int LATENCY_STAMP_WIDTH = 14 * LATENCY_STAMP_BLOCK;
+static const int LATENCY_STAMP_HEIGHT = 4 * LATENCY_STAMP_BLOCK;
+
+// Frames smaller than the stamp are left alone
+void latency_stamp_write(uint8_t* y, int y_stride, int width, int height, uint32_t time_us);
+
+// bytes_per_pixel is 1 for a luma plane, 4 for 32 bit RGB. Returns false
+// if the frame carries no valid stamp.
+bool latency_stamp_read(const uint8_t* pixels, int stride, int bytes_per_pixel, int width, int height,
+                        uint32_t* time_us);
@@ -0,0 +1,231 @@
+#include "log.h"
+#include "frame_pacer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+struct Record {
+    static const int MAX_TEXT = 240;
+
+    int64_t time_us;
+    uint16_t thread;
+    uint8_t level;
+    uint8_t length;
+    char text[MAX_TEXT];
+};
+
+/**
+ * Single producer, single consumer: the owning thread pushes, the writer
+ * pops. Outlives its thread until the writer has drained it.
+ */
+struct Ring {
+    static const uint32_t CAPACITY = 256;
+
+    Record records[CAPACITY];
+    // Kept on separate cache lines, the owner writes head and the writer tail
+    std::atomic<uint32_t> head;
+    char head_padding[60];
+    std::atomic<uint32_t> tail;
+    char tail_padding[60];
+    std::atomic<bool> closed;
+    uint16_t thread;
+    Ring* next;
+};
+
+std::mutex rings_mutex;
+// Only the writer walks and unlinks, threads only prepend
+Ring* rings = nullptr;
+uint16_t next_thread = 1;
+
+std::atomic<bool> running(false);
+std::atomic<bool> stopping(false);
+std::atomic<uint64_t> dropped_messages(0);
+std::thread writer;
+FILE* output = nullptr;
+int64_t start_us = FramePacer::now_us();
+
+const char LEVEL_NAMES[] = { 'D', 'I', 'W', 'E' };
+
+struct ThreadRing {
+    Ring* ring;
+
+    ThreadRing() : ring(new Ring()) {
+        this->ring->head.store(0);
+        this->ring->tail.store(0);
+        this->ring->closed.store(false);
+        lock_guard<mutex> lock(rings_mutex);
+        this->ring->thread = next_thread++;
+        this->ring->next = rings;
+        rings = this->ring;
+    }
+
+    ~ThreadRing() {
+        // The writer frees it once drained
+        this->ring->closed.store(true);
+    }
+};
+
+Ring* thread_ring() {
+    static thread_local ThreadRing ring;
+    return ring.ring;
+}
+
+void append(string& batch, const Record& record) {
+    char prefix[48];
+    int64_t elapsed = record.time_us - start_us;
+    int length = snprintf(prefix, sizeof(prefix), "[%lld.%06lld] %c %u ",
+                          (long long)(elapsed / 1000000), (long long)(elapsed % 1000000),
+                          LEVEL_NAMES[record.level], record.thread);
+    batch.append(prefix, length);
+    batch.append(record.text, record.length);
+    batch.push_back('\n');
+}
+
+// Writer thread, or the main thread once the writer is gone
+void drain(vector<Record>& pending, string& batch) {
+    Ring* head;
+    {
+        lock_guard<mutex> lock(rings_mutex);
+        head = rings;
+    }
+    // Threads only ever prepend, so everything from head on is ours to walk
+    Ring* previous = nullptr;
+    for (Ring* ring = head; ring != nullptr;) {
+        bool closed = ring->closed.load();
+        uint32_t tail = ring->tail.load(memory_order_relaxed);
+        uint32_t head_position = ring->head.load(memory_order_acquire);
+        for (; tail != head_position; tail++) {
+            pending.push_back(ring->records[tail % Ring::CAPACITY]);
+        }
+        ring->tail.store(tail, memory_order_release);
+
+        Ring* next = ring->next;
+        if (closed) {
+            lock_guard<mutex> lock(rings_mutex);
+            if (previous == nullptr && rings != ring) {
+                // Someone prepended meanwhile, find who points at us now
+                previous = rings;
+                while (previous->next != ring) {
+                    previous = previous->next;
+                }
+            }
+            if (previous == nullptr) {
+                rings = next;
+            } else {
+                previous->next = next;
+            }
+            delete ring;
+        } else {
+            previous = ring;
+        }
+        ring = next;
+    }
+
+    if (pending.empty()) {
+        return;
+    }
+    // Rings are per thread, interleave them back in time order
+    stable_sort(pending.begin(), pending.end(), [](const Record& a, const Record& b) {
+        return a.time_us < b.time_us;
+    });
+    batch.clear();
+    for (const Record& record : pending) {
+        append(batch, record);
+    }
+    pending.clear();
+    FILE* file = output != nullptr ? output : stderr;
+    fwrite(batch.data(), 1, batch.size(), file);
+    fflush(file);
+}
+
+void run() {
+    vector<Record> pending;
+    string batch;
+    while (!stopping.load()) {
+        drain(pending, batch);
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    drain(pending, batch);
+}
+
+}
+
+bool Logger::start(const char* path) {
+    if (running.load()) {
+        return true;
+    }
+    bool opened = true;
+    if (path != nullptr) {
+        output = fopen(path, "a");
+        opened = output != nullptr;
+    }
+    stopping.store(false);
+    writer = std::thread(run);
+    running.store(true);
+    if (!opened) {
+        LOG_ERROR("Could not open log file %s, logging to stderr", path);
+    }
+    return opened;
+}
+
+void Logger::stop() {
+    if (!running.load()) {
+        return;
+    }
+    // Writes keep going to the rings until running drops, the writer drains
+    // them once more on its way out
+    stopping.store(true);
+    writer.join();
+    running.store(false);
+    // Anything that slipped in between the writer's last pass and the line above
+    vector<Record> pending;
+    string batch;
+    drain(pending, batch);
+    if (output != nullptr) {
+        fclose(output);
+        output = nullptr;
+    }
+}
+
+void Logger::write(int level, const char* format, ...) {
+    va_list arguments;
+    va_start(arguments, format);
+    if (!running.load() && stopping.load()) {
+        // Stopped, nobody drains the rings anymore
+        vfprintf(stderr, format, arguments);
+        fputc('\n', stderr);
+        va_end(arguments);
+        return;
+    }
+
+    Ring* ring = thread_ring();
+    uint32_t head = ring->head.load(memory_order_relaxed);
+    if (head - ring->tail.load(memory_order_acquire) >= Ring::CAPACITY) {
+        va_end(arguments);
+        dropped_messages++;
+        return;
+    }
+    Record& record = ring->records[head % Ring::CAPACITY];
+    int length = vsnprintf(record.text, Record::MAX_TEXT, format, arguments);
+    va_end(arguments);
+    record.length = static_cast<uint8_t>(min(max(length, 0), Record::MAX_TEXT - 1));
+    record.level = static_cast<uint8_t>(min(max(level, LOG_LEVEL_DEBUG), LOG_LEVEL_ERROR));
+    record.thread = ring->thread;
+    record.time_us = FramePacer::now_us();
+    ring->head.store(head + 1, memory_order_release);
+}
+
+uint64_t Logger::dropped() {
+    return dropped_messages.load();
+}
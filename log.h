@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_ERROR 3
+
+// Messages below this level are compiled out, arguments included
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+/**
+ * Asynchronous logger. Every thread formats into its own lock free ring,
+ * a writer thread drains the rings in batches and writes them to a file or
+ * stderr, so SDK media threads never wait on a terminal or a disk. When a
+ * ring is full the message is dropped and counted instead.
+ *
+ * Use the LOG_* macros rather than write(), they honor LOG_LEVEL.
+ */
+class Logger {
+public:
+    // Main thread. A null path logs to stderr. Messages logged before start()
+    // stay queued until then.
+    static bool start(const char* path);
+    // Main thread. Writes out what is queued and stops the writer, later
+    // messages are written synchronously to stderr.
+    static void stop();
+
+    // Any thread
+    static void write(int level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+    static uint64_t dropped();
+};
+
+// Runs the logger for as long as it lives, so early returns stop it too
+class LoggerScope {
+public:
+    explicit LoggerScope(const char* path) { Logger::start(path); }
+    ~LoggerScope() { Logger::stop(); }
+
+private:
+    LoggerScope(const LoggerScope&);
+    LoggerScope& operator=(const LoggerScope&);
+};
+
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) Logger::write(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) Logger::write(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_WARNING
+#define LOG_WARNING(...) Logger::write(LOG_LEVEL_WARNING, __VA_ARGS__)
+#else
+#define LOG_WARNING(...) do {} while (0)
+#endif
+
+#define LOG_ERROR(...) Logger::write(LOG_LEVEL_ERROR, __VA_ARGS__)
@@ -6,50 +6,168 @@
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
 #include <opentok.h>
 
-#include <iostream>
-#include <map>
-#include <memory>
-
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "app_event.h"
+#include "audio_device.h"
+#include "audio_sink.h"
+#include "latency_probe.h"
+#include "log.h"
+#include "mpsc_queue.h"
+#include "recorder.h"
 #include "renderer.h"
+#include "replay_source.h"
 #include "session_info.h"
+#include "stream_registry.h"
+#include "subscriber_manager.h"
+#include "synthetic_capturer.h"
+#include "trace.h"
 #include "ui_state.h"
+#include "upload_thread.h"
+#include "yuv_converter.h"
+#include "conversion_pool.h"
 
 using namespace std;
 static void glfw_error_callback(int error, const char* description)
 {
-    fprintf(stderr, "Glfw Error %d: %s\n", error, description);
+    LOG_ERROR("Glfw Error %d: %s", error, description);
 }
 
 /**
  * Static vars
  */
-map<string, unique_ptr<Renderer>> renderer_map;
+StreamRegistry stream_registry;
 UIState ui_state;
+RendererSettings renderer_settings;
+static YuvConverter* yuv_converter = nullptr;
+static ConversionPool* conversion_pool = nullptr;
 static bool publishVideo = true;
 static bool publishAudio = true;
-static bool subscriberVideo = true;
-static bool subscriberAudio = true;
 
 static otc_session* session = nullptr;
 static otc_publisher* publisher = nullptr;
-static otc_subscriber* subscriber = nullptr;
+static SubscriberManager subscriber_manager;
+// GL objects of dropped streams, deleted once per frame after the swap
+static GlGarbage gl_garbage;
+// Publishes generated frames instead of the camera when set
+static SyntheticCapturer* synthetic_capturer = nullptr;
+// Latency mode: the publisher sends stamped frames and every renderer
+// reports the stamps it shows
+static bool latency_mode = false;
+static LatencyProbe latency_probe;
+// Plays out through our own device when --audio-sink is given, the SDK's default otherwise
+static AudioDevice audio_device;
+static const char* audio_sink_spec = nullptr;
+// Plays a recording back as one more stream, see --replay
+static ReplaySource* replay_source = nullptr;
+
+// Idle mode only redraws when input, a video frame or an SDK event asks for
+// it, otherwise the main loop sleeps in glfwWaitEventsTimeout
+static bool idle_mode = false;
+static std::atomic<bool> redraw_requested(true);
+// ImGui needs a few frames after an input event to settle hover and animations
+static const int REDRAW_FRAMES = 3;
+static int redraw_frames = REDRAW_FRAMES;
+// Stats keep updating at this rate even when nothing else happens
+static const int64_t IDLE_REDRAW_INTERVAL_US = 500000;
+
+// Any thread. Wakes the main loop up, at most one empty event is in flight.
+static void request_redraw() {
+  if (!redraw_requested.exchange(true)) {
+    glfwPostEmptyEvent();
+  }
+}
+
+// Input arrives on the main thread, inside glfwPollEvents/glfwWaitEventsTimeout
+static void on_input() { redraw_frames = REDRAW_FRAMES; }
+static void on_cursor_pos(GLFWwindow*, double, double) { on_input(); }
+static void on_mouse_button(GLFWwindow*, int, int, int) { on_input(); }
+static void on_scroll(GLFWwindow*, double, double) { on_input(); }
+static void on_key(GLFWwindow*, int, int, int, int) { on_input(); }
+static void on_char(GLFWwindow*, unsigned int) { on_input(); }
+static void on_window_refresh(GLFWwindow*) { on_input(); }
+
+// SDK callbacks never touch ui_state, they post here and the main loop applies the events.
+// A stream posts at most received, error and dropped, so with room for four
+// events per registry slot stream events alone cannot fill the queue.
+static const size_t APP_EVENTS_CAPACITY = 4 * StreamRegistry::CAPACITY;
+static MpscQueue<AppEvent, APP_EVENTS_CAPACITY> app_events;
+// Bounded slow path for a queue that is full anyway. Losing an event would
+// leak a subscriber or keep a renderer forever, so they wait here, in
+// order, instead. The storage is fixed, producers only ever lock, never
+// allocate, and only past this point are events dropped and counted. While
+// the list is not empty every event goes to it, so none overtakes an older one.
+static const size_t APP_EVENTS_OVERFLOW = 256;
+static std::mutex app_events_overflow_mutex;
+static AppEvent app_events_overflow[APP_EVENTS_OVERFLOW];
+static size_t app_events_overflow_count = 0;
+static std::atomic<bool> app_events_overflowing(false);
+static std::atomic<uint64_t> app_events_overflowed(0);
+static std::atomic<uint64_t> app_events_dropped(0);
+struct EventLatency {
+  uint64_t count;
+  int64_t total_us;
+  int64_t max_us;
+};
+static EventLatency event_latency = { 0, 0, 0 };
+
+// Callbacks carry the stream's registry handle as user_data, so frames
+// reach their renderer without looking the stream up
+static_assert(sizeof(void*) >= sizeof(StreamRegistry::Handle), "handles must fit in user_data");
+
+static void* handle_to_user_data(StreamRegistry::Handle handle) {
+  return reinterpret_cast<void*>(static_cast<uintptr_t>(handle));
+}
+
+static StreamRegistry::Handle user_data_to_handle(void* user_data) {
+  return static_cast<StreamRegistry::Handle>(reinterpret_cast<uintptr_t>(user_data));
+}
+
+static void post_event(AppEventType type,
+                       StreamRegistry::Handle handle = StreamRegistry::INVALID_HANDLE,
+                       otc_subscriber* subscriber = nullptr,
+                       const char* message = nullptr) {
+  AppEvent event;
+  event.type = type;
+  event.handle = handle;
+  event.subscriber = subscriber;
+  event.message[0] = '\0';
+  if (message != nullptr) {
+    strncpy(event.message, message, AppEvent::MAX_MESSAGE - 1);
+    event.message[AppEvent::MAX_MESSAGE - 1] = '\0';
+  }
+  event.posted_us = FramePacer::now_us();
+  if (app_events_overflowing.load() || !app_events.try_push(event)) {
+    std::lock_guard<std::mutex> lock(app_events_overflow_mutex);
+    if (app_events_overflow_count > 0 || !app_events.try_push(event)) {
+      if (app_events_overflow_count < APP_EVENTS_OVERFLOW) {
+        app_events_overflow[app_events_overflow_count++] = event;
+        app_events_overflowing = true;
+        app_events_overflowed++;
+      } else {
+        app_events_dropped++;
+      }
+    }
+  }
+  request_redraw();
+}
 
 void hidePublisherButton() {
     ui_state.showPublisherButtons = false;
     ui_state.isPublishing = false;
 }
 
-void hideSubscriberButton() {
-    ui_state.isSubscribing = false;
-    ui_state.showSubscriberButtons = false;
-}
-
 void setPublisherAudio() {
     otc_publisher_set_publish_audio(publisher, publishAudio);
 }
@@ -58,13 +176,6 @@ void setPublisherVideo() {
     otc_publisher_set_publish_video(publisher, publishVideo);
 }
 
-void setSubscriberAudio() {
-    otc_subscriber_set_subscribe_to_audio(subscriber, subscriberAudio);
-}
-
-void setSubscriberVideo() {
-    otc_subscriber_set_subscribe_to_video(subscriber, subscriberVideo);
-}
 /**
  * Subscriber Callbacks
  */
@@ -72,22 +183,28 @@ static void on_subscriber_error(otc_subscriber* subscriber,
                                 void *user_data,
                                 const char* error_string,
                                 enum otc_subscriber_error_code error) {
-  std::cout << __FUNCTION__ << " callback function" << std::endl;
-  std::cout << "Subscriber error. Error code: " << error_string << std::endl;
-  ui_state.isSubscribing = false;
+  LOG_DEBUG("%s callback function", __FUNCTION__);
+  LOG_ERROR("Subscriber error. Error code: %s", error_string);
+  post_event(AppEventType::SUBSCRIBER_ERROR, user_data_to_handle(user_data), subscriber, error_string);
 }
 
 static void on_subscriber_render_frame(otc_subscriber *subscriber,
                                        void *user_data,
                                        const otc_video_frame *frame) {
-  otc_stream* stream = otc_subscriber_get_stream(subscriber);
-  string streamId(otc_stream_get_id(stream));
-
-  renderer_map[streamId]->set_frame(frame);
+  StreamRegistry::Reference renderer(&stream_registry, user_data_to_handle(user_data));
+  if (renderer) {
+    renderer->set_frame(frame);
+  }
 }
 
 static void on_subscriber_reconnected(otc_subscriber * subscriber, void *user_data) {
-  std::cout << __FUNCTION__ << " callback function" << std::endl;
+  LOG_DEBUG("%s callback function", __FUNCTION__);
+}
+
+static void on_subscriber_audio_level_updated(otc_subscriber* subscriber,
+                                              void *user_data,
+                                              float audio_level) {
+  subscriber_manager.set_audio_level(user_data_to_handle(user_data), audio_level);
 }
 
 
@@ -95,72 +212,74 @@ static void on_subscriber_reconnected(otc_subscriber * subscriber, void *user_da
  * Session Callbacks
  */
 static void on_session_connected(otc_session *session, void *user_data) {
-  std::cout << __FUNCTION__ << " callback function" << std::endl;
-  ui_state.isSessionConnected = true;
-  ui_state.showPublisherButtons = true;
+  LOG_DEBUG("%s callback function", __FUNCTION__);
+  post_event(AppEventType::SESSION_CONNECTED);
 }
 
 static void on_session_connection_created(otc_session *session,
                                           void *user_data,
                                           const otc_connection *connection) {
-  std::cout << __FUNCTION__ << " callback function" << std::endl;
+  LOG_DEBUG("%s callback function", __FUNCTION__);
 }
 
 static void on_session_connection_dropped(otc_session *session,
                                           void *user_data,
                                           const otc_connection *connection) {
-  std::cout << __FUNCTION__ << " callback function" << std::endl;
+  LOG_DEBUG("%s callback function", __FUNCTION__);
 }
 
 static void on_session_stream_received(otc_session *session,
                                        void *user_data,
                                        const otc_stream *stream) {
-  std::cout << __FUNCTION__ << " callback function" << std::endl;
+  LOG_DEBUG("%s callback function", __FUNCTION__);
   otc_subscriber_callbacks subscriber_callbacks = {0};
   subscriber_callbacks.on_render_frame = on_subscriber_render_frame;
   subscriber_callbacks.on_reconnected = on_subscriber_reconnected;
+  subscriber_callbacks.on_audio_level_updated = on_subscriber_audio_level_updated;
+  subscriber_callbacks.on_error = on_subscriber_error;
 
-  string streamId(otc_stream_get_id(stream));
-  // Create an empty placeholder for the renderer
+  // Register the stream, this is the only time its ID is looked at
   // This callback is not called in the main thread so we cannot
   // create the renderer here
   // The main loop will create a renderer for the stream
-  unique_ptr<Renderer> ptr;
-  renderer_map[streamId] = std::move(ptr);
+  StreamRegistry::Handle handle = stream_registry.add(otc_stream_get_id(stream));
+  subscriber_callbacks.user_data = handle_to_user_data(handle);
 
-  subscriber = otc_subscriber_new(stream, &subscriber_callbacks);
-  ui_state.showSubscriberButtons = true;
+  otc_subscriber* new_subscriber = otc_subscriber_new(stream, &subscriber_callbacks);
+  post_event(AppEventType::STREAM_RECEIVED, handle, new_subscriber, otc_stream_get_id(stream));
 }
 
 static void on_session_stream_dropped(otc_session *session,
                                       void *user_data,
                                       const otc_stream *stream) {
-  std::cout << __FUNCTION__ << " callback function" << std::endl;
+  LOG_DEBUG("%s callback function", __FUNCTION__);
+  // Frames stop reaching the renderer right away, the main loop frees it
+  // once nothing uses it anymore
+  StreamRegistry::Handle handle = stream_registry.find(otc_stream_get_id(stream));
+  stream_registry.remove(handle);
+  post_event(AppEventType::STREAM_DROPPED, handle);
 }
 
 static void on_session_disconnected(otc_session *session, void *user_data) {
-  std::cout << __FUNCTION__ << " callback function" << std::endl;
-  ui_state.isSessionConnected = false;
-  hidePublisherButton();
-  hideSubscriberButton();
+  LOG_DEBUG("%s callback function", __FUNCTION__);
+  post_event(AppEventType::SESSION_DISCONNECTED);
 }
 
 static void on_session_error(otc_session *session,
                              void *user_data,
                              const char *error_string,
                              enum otc_session_error_code error) {
-  std::cout << __FUNCTION__ << " callback function" << std::endl;
-  std::cout << "Session error. Error : " << error_string << std::endl;
-  hidePublisherButton();
-  hideSubscriberButton();
+  LOG_DEBUG("%s callback function", __FUNCTION__);
+  LOG_ERROR("Session error. Error : %s", error_string);
+  post_event(AppEventType::SESSION_ERROR, StreamRegistry::INVALID_HANDLE, nullptr, error_string);
 }
 
 static void on_session_reconnection_started(otc_session *session, void *user_data) {
-  std::cout << __FUNCTION__ << " callback function" << std::endl;
+  LOG_DEBUG("%s callback function", __FUNCTION__);
 }
 
 static void on_session_reconnected(otc_session *session, void *user_data) {
-  std::cout << __FUNCTION__ << " callback function" << std::endl;
+  LOG_DEBUG("%s callback function", __FUNCTION__);
 }
 
 
@@ -170,7 +289,7 @@ static void on_session_reconnected(otc_session *session, void *user_data) {
 static void on_publisher_stream_created(otc_publisher *publisher,
                                         void *user_data,
                                         const otc_stream *stream) {
-  std::cout << __FUNCTION__ << " callback function" << std::endl;
+  LOG_DEBUG("%s callback function", __FUNCTION__);
 }
 
 
@@ -178,42 +297,50 @@ static void on_publisher_render_frame(otc_publisher *publisher,
                                       void *user_data,
 
                                       const otc_video_frame *frame) {
-  if (renderer_map["PUBLISHER"] != nullptr) {
-    renderer_map["PUBLISHER"]->set_frame(frame);
+  StreamRegistry::Reference renderer(&stream_registry, user_data_to_handle(user_data));
+  if (renderer) {
+    renderer->set_frame(frame);
   }
 }
 
 static void on_publisher_stream_destroyed(otc_publisher *publisher,
                                           void *user_data,
                                           const otc_stream *stream) {
-  std::cout << __FUNCTION__ << " callback function" << std::endl;
-  ui_state.isPublishing = false;
+  LOG_DEBUG("%s callback function", __FUNCTION__);
+  post_event(AppEventType::PUBLISHER_STREAM_DESTROYED, user_data_to_handle(user_data));
 }
 
 static void on_publisher_error(otc_publisher *publisher,
                                void *user_data,
                                const char* error_string,
                                enum otc_publisher_error_code error_code) {
-  std::cout << __FUNCTION__ << " callback function" << std::endl;
-  std::cout << "Publisher error. Error code: " << error_string << std::endl;
-  ui_state.isPublishing = false;
+  LOG_DEBUG("%s callback function", __FUNCTION__);
+  LOG_ERROR("Publisher error. Error code: %s", error_string);
+  post_event(AppEventType::PUBLISHER_ERROR, user_data_to_handle(user_data), nullptr, error_string);
 }
 
 /**
  * Utility OT functions
  */
 static void on_otc_log_message(const char* message) {
-  std::cout <<  __FUNCTION__ << ":" << message << std::endl;
+  LOG_INFO("otc: %s", message);
 }
 
 static void init_ot() {
   if (otc_init(nullptr) != OTC_SUCCESS) {
-      std::cout << "Could not init OpenTok library" << std::endl;
+      LOG_ERROR("Could not init OpenTok library");
       return;
     }
     otc_log_set_logger_callback(on_otc_log_message);
     otc_log_enable(OTC_LOG_LEVEL_INFO);
 
+    if (audio_sink_spec != nullptr) {
+      AudioSink* sink = AudioSink::create(audio_sink_spec);
+      if (sink != nullptr) {
+        audio_device.install(sink);
+      }
+    }
+
     struct otc_session_callbacks session_callbacks = {0};
     session_callbacks.on_connected = on_session_connected;
     session_callbacks.on_connection_created = on_session_connection_created;
@@ -226,7 +353,7 @@ static void init_ot() {
     session_callbacks.on_reconnected = on_session_reconnected;
     session = otc_session_new(API_KEY, SESSION_ID, &session_callbacks);
     if (session == nullptr) {
-      cout << "ERROR creatng session" << endl;
+      LOG_ERROR("ERROR creatng session");
     }
 }
 
@@ -237,41 +364,194 @@ void create_publisher() {
     publisher_callbacks.on_stream_destroyed = on_publisher_stream_destroyed;
     publisher_callbacks.on_error = on_publisher_error;
 
-    // Create an empty placeholder for the renderer
+    // Register the stream
     // This callback is not called in the main thread so we cannot
     // create the renderer here
     // The main loop will create a renderer for the stream
-    unique_ptr<Renderer> ptr;
-    renderer_map["PUBLISHER"] = std::move(ptr);
+    publisher_callbacks.user_data = handle_to_user_data(stream_registry.add("PUBLISHER"));
 
+    // Without a capturer of our own WebRTC's camera capturer is used
     publisher = otc_publisher_new("name",
-                                  nullptr, /* Use WebRTC's video capturer. */
+                                  synthetic_capturer != nullptr ? synthetic_capturer->callbacks() : nullptr,
                                   &publisher_callbacks);
 
 
 
     if (publisher == nullptr) {
-      std::cout << "Error building publisher" << std::endl;
+      LOG_ERROR("Error building publisher");
     }
 }
 
 void publish() {
   if(publisher != nullptr && session != nullptr) {
-      std::cout << "Publishing" << endl;
+      LOG_INFO("Publishing");
       otc_session_publish(session, publisher);
   }
 }
 
 void unpublish() {
   if(publisher != nullptr && session != nullptr) {
-      std::cout << "Unpublishing" << endl;
+      LOG_INFO("Unpublishing");
       otc_session_unpublish(session, publisher);
   }
 }
 
+static bool retire_renderer(Renderer* renderer) {
+  if (!renderer->is_idle()) {
+    return false;
+  }
+  renderer->release_gl(&gl_garbage);
+  delete renderer;
+  return true;
+}
+
+/**
+ * Applies one event, main thread only
+ */
+static void apply_event(const AppEvent& event, int64_t now) {
+  int64_t latency = now - event.posted_us;
+  event_latency.count++;
+  event_latency.total_us += latency;
+  event_latency.max_us = std::max(event_latency.max_us, latency);
+
+  switch (event.type) {
+  case AppEventType::SESSION_CONNECTED:
+    ui_state.isSessionConnected = true;
+    ui_state.showPublisherButtons = true;
+    break;
+  case AppEventType::SESSION_DISCONNECTED:
+    ui_state.isSessionConnected = false;
+    hidePublisherButton();
+    subscriber_manager.clear(session, &stream_registry);
+    break;
+  case AppEventType::SESSION_ERROR:
+    ui_state.lastError = event.message;
+    hidePublisherButton();
+    break;
+  case AppEventType::STREAM_RECEIVED:
+    subscriber_manager.add(session, event.handle, event.message, event.subscriber);
+    break;
+  case AppEventType::STREAM_DROPPED:
+    subscriber_manager.remove(session, event.handle);
+    break;
+  case AppEventType::SUBSCRIBER_ERROR:
+    ui_state.lastError = event.message;
+    subscriber_manager.subscriber_failed(event.handle);
+    break;
+  case AppEventType::PUBLISHER_STREAM_DESTROYED:
+    ui_state.isPublishing = false;
+    break;
+  case AppEventType::PUBLISHER_ERROR:
+    ui_state.lastError = event.message;
+    ui_state.isPublishing = false;
+    break;
+  }
+}
+
+/**
+ * Applies what the SDK callbacks posted, main thread only
+ */
+static void handle_events() {
+  AppEvent event;
+  int64_t now = FramePacer::now_us();
+  while (app_events.try_pop(&event)) {
+    apply_event(event, now);
+  }
+  if (!app_events_overflowing.load()) {
+    return;
+  }
+  std::vector<AppEvent> overflow;
+  {
+    // Whatever reached the queue before the overflow started is older than
+    // the list, take it first. Events are applied outside the lock, they
+    // may call into the SDK, which may post again.
+    std::lock_guard<std::mutex> lock(app_events_overflow_mutex);
+    while (app_events.try_pop(&event)) {
+      overflow.push_back(event);
+    }
+    overflow.insert(overflow.end(), app_events_overflow, app_events_overflow + app_events_overflow_count);
+    app_events_overflow_count = 0;
+    app_events_overflowing = false;
+  }
+  for (const AppEvent& overflowed : overflow) {
+    apply_event(overflowed, now);
+  }
+}
+
+/**
+ * Stops every SDK thread that delivers frames, renderers and the conversion
+ * pool can only go once nothing calls into them anymore
+ */
+static void stop_ot() {
+  if (session != nullptr && ui_state.isSessionConnected) {
+    otc_session_disconnect(session);
+  }
+  subscriber_manager.clear(session, &stream_registry);
+  if (publisher != nullptr) {
+    if (ui_state.isPublishing) {
+      unpublish();
+    }
+    otc_publisher_delete(publisher);
+    publisher = nullptr;
+  }
+  if (session != nullptr) {
+    otc_session_delete(session);
+    session = nullptr;
+  }
+  // Streams received meanwhile come with a subscriber of their own
+  handle_events();
+  subscriber_manager.clear(session, &stream_registry);
+}
+
+static UploadThread* upload_thread = nullptr;
+
+static void wake_upload_thread() {
+  upload_thread->wake();
+}
 
-int main(int, char**)
+int main(int argc, char** argv)
 {
+    bool use_upload_thread = false;
+    const char* log_path = nullptr;
+    const char* capture_mode = nullptr;
+    SyntheticCapturer::Pattern capture_pattern = SyntheticCapturer::GRADIENT;
+    ReplaySource::Settings replay_settings = { "", false, true, 0, 0, 0 };
+    for (int i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "--upload-thread") == 0) {
+        use_upload_thread = true;
+      } else if (strcmp(argv[i], "--latency-probe") == 0) {
+        latency_mode = true;
+      } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+        capture_mode = argv[++i];
+      } else if (strcmp(argv[i], "--capture-pattern") == 0 && i + 1 < argc) {
+        i++;
+        capture_pattern = strcmp(argv[i], "noise") == 0 ? SyntheticCapturer::NOISE : SyntheticCapturer::GRADIENT;
+      } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+        replay_settings.path = argv[++i];
+      } else if (strcmp(argv[i], "--replay-fast") == 0) {
+        replay_settings.fast = true;
+      } else if (strcmp(argv[i], "--replay-once") == 0) {
+        replay_settings.loop = false;
+      } else if (strcmp(argv[i], "--replay-size") == 0 && i + 1 < argc) {
+        sscanf(argv[++i], "%dx%d@%d", &replay_settings.width, &replay_settings.height, &replay_settings.fps);
+      } else if (strcmp(argv[i], "--record-direct") == 0) {
+        renderer_settings.record_direct_io = true;
+      } else if (strcmp(argv[i], "--audio-sink") == 0 && i + 1 < argc) {
+        audio_sink_spec = argv[++i];
+      } else if (strcmp(argv[i], "--log-file") == 0 && i + 1 < argc) {
+        log_path = argv[++i];
+      }
+    }
+    LoggerScope logger(log_path);
+    if (capture_mode != nullptr || latency_mode) {
+      SyntheticCapturer::Settings capture_settings = { 640, 480, 30, capture_pattern, latency_mode };
+      if (capture_mode != nullptr && !SyntheticCapturer::parse_mode(capture_mode, &capture_settings)) {
+        LOG_WARNING("Bad capture mode %s, expected WIDTHxHEIGHT@FPS", capture_mode);
+      }
+      synthetic_capturer = new SyntheticCapturer(capture_settings);
+    }
+    Trace::set_thread_name("main");
+
     // Setup window
     glfwSetErrorCallback(glfw_error_callback);
     if (!glfwInit())
@@ -307,7 +587,7 @@ int main(int, char**)
     bool err = glewInit() != GLEW_OK;
     if (err)
     {
-        fprintf(stderr, "Failed to initialize OpenGL loader!\n");
+        LOG_ERROR("Failed to initialize OpenGL loader!");
         return 1;
     }
 
@@ -317,17 +597,100 @@ int main(int, char**)
     ImGui::StyleColorsDark();
     //ImGui::StyleColorsClassic();
 
+    // Installed before ImGui, which chains to them from its own callbacks
+    glfwSetCursorPosCallback(window, on_cursor_pos);
+    glfwSetMouseButtonCallback(window, on_mouse_button);
+    glfwSetScrollCallback(window, on_scroll);
+    glfwSetKeyCallback(window, on_key);
+    glfwSetCharCallback(window, on_char);
+    glfwSetWindowRefreshCallback(window, on_window_refresh);
+
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init(glsl_version);
 
     ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
+    yuv_converter = new YuvConverter(glsl_version);
+    if (!yuv_converter->is_valid()) {
+      LOG_WARNING("GPU YUV conversion not available, falling back to CPU conversion");
+    }
+    conversion_pool = new ConversionPool();
+    renderer_settings.conversion_pool = conversion_pool;
+    renderer_settings.frame_ready = request_redraw;
+    if (latency_mode) {
+      renderer_settings.latency_probe = &latency_probe;
+    }
+
+    // Fences across contexts need ARB_sync, without it uploads stay on this thread
+    GLFWwindow* upload_window = NULL;
+    if (use_upload_thread && !GLEW_ARB_sync) {
+      LOG_WARNING("GL_ARB_sync not available, uploading on the main thread");
+    } else if (use_upload_thread) {
+      glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+      upload_window = glfwCreateWindow(1, 1, "", NULL, window);
+      glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+      if (upload_window == NULL) {
+        LOG_WARNING("Could not create the upload context, uploading on the main thread");
+      } else {
+        upload_thread = new UploadThread(upload_window, glsl_version, &renderer_settings, &stream_registry,
+                                         request_redraw);
+      }
+      // Renderers pick planar output by the main converter, the upload
+      // thread's has to work as well
+      if (upload_thread != nullptr && !upload_thread->converter_valid()) {
+        LOG_WARNING("Upload thread has no YUV shader, uploading on the main thread");
+        delete upload_thread;
+        upload_thread = nullptr;
+        glfwDestroyWindow(upload_window);
+        upload_window = NULL;
+      }
+      if (upload_thread != nullptr) {
+        renderer_settings.upload_thread = true;
+        renderer_settings.frame_ready = wake_upload_thread;
+      }
+    }
+
     init_ot();
 
+    if (!replay_settings.path.empty()) {
+      replay_source = new ReplaySource(replay_settings, &stream_registry);
+      if (!replay_source->start()) {
+        delete replay_source;
+        replay_source = nullptr;
+      }
+    }
+
+    // Swap times, so renderers can pick the frame that matches the next one
+    int64_t last_swap_us = FramePacer::now_us();
+    int64_t refresh_interval_us = 16667;
+
     // Main loop
     while (!glfwWindowShouldClose(window))
     {
-      glfwPollEvents();
+      if (idle_mode && redraw_frames == 0) {
+        // Paced streams need a refresh when their next frame is due
+        int64_t timeout_us = renderer_settings.jitter_depth > 0 ? refresh_interval_us : IDLE_REDRAW_INTERVAL_US;
+        int64_t wait_us = last_swap_us + timeout_us - FramePacer::now_us();
+        if (wait_us > 0 && !redraw_requested.load()) {
+          glfwWaitEventsTimeout(wait_us / 1e6);
+        } else {
+          glfwPollEvents();
+        }
+        bool timer_due = FramePacer::now_us() >= last_swap_us + timeout_us;
+        if (!redraw_requested.load() && !timer_due && redraw_frames == 0) {
+          continue;
+        }
+      } else {
+        glfwPollEvents();
+      }
+      // A new frame or event needs this one redraw, input a few
+      redraw_requested.store(false);
+      if (redraw_frames > 0) {
+        redraw_frames--;
+      }
+      handle_events();
+      subscriber_manager.update(FramePacer::now_us());
+      int64_t build_start_us = FramePacer::now_us();
       ImGui_ImplOpenGL3_NewFrame();
       ImGui_ImplGlfw_NewFrame();
       ImGui::NewFrame();
@@ -338,10 +701,10 @@ int main(int, char**)
       ImGui::Begin("Control Panel");
       if (ImGui::Button(ui_state.connectButtonText().c_str())) {
         if (ui_state.isSessionConnected) {
-          cout << "Disconnecting Session" << endl;
+          LOG_INFO("Disconnecting Session");
           otc_session_disconnect(session);
         } else {
-          cout << "Connecting Session" << endl;
+          LOG_INFO("Connecting Session");
           otc_session_connect(session, TOKEN);
           create_publisher();
         }
@@ -349,7 +712,7 @@ int main(int, char**)
 
       if (ui_state.showPublisherButtons && ImGui::Button(ui_state.publishButtonText().c_str())) {
         if(!ui_state.isPublishing) {
-          cout << "Creating Publisher" << endl;
+          LOG_INFO("Creating Publisher");
           publish();
           ui_state.isPublishing = true;
         } else {
@@ -366,50 +729,168 @@ int main(int, char**)
         setPublisherVideo();
       }
 
-      if (ui_state.showSubscriberButtons && ImGui::Button(ui_state.subscriberButtonText().c_str())) {
-        if(!ui_state.isSubscribing) {
-          cout << "Creating Subscriber" << endl;
-          otc_session_subscribe(session, subscriber);
-          ui_state.isSubscribing = true;
+      int render_mode = renderer_settings.mode;
+      if (ImGui::Combo("Video rendering", &render_mode, "CPU ARGB conversion\0GPU YUV shader\0")) {
+        renderer_settings.mode = render_mode;
+      }
+      int color_space = renderer_settings.color_space;
+      if (ImGui::Combo("Color space", &color_space, "BT.601\0BT.709\0")) {
+        renderer_settings.color_space = color_space;
+      }
+      int color_range = renderer_settings.color_range;
+      if (ImGui::Combo("Color range", &color_range, "Limited\0Full\0")) {
+        renderer_settings.color_range = color_range;
+      }
+      bool downscale = renderer_settings.downscale;
+      if (ImGui::Checkbox("Downscale to window size", &downscale)) {
+        renderer_settings.downscale = downscale;
+      }
+      ImGui::Checkbox("Idle mode (redraw only on changes)", &idle_mode);
+      bool use_conversion_pool = renderer_settings.use_conversion_pool;
+      if (ImGui::Checkbox("Convert on worker threads", &use_conversion_pool)) {
+        renderer_settings.use_conversion_pool = use_conversion_pool;
+      }
+      int jitter_depth = renderer_settings.jitter_depth;
+      if (ImGui::SliderInt("Jitter buffer (frames)", &jitter_depth, 0, 8)) {
+        renderer_settings.jitter_depth = jitter_depth;
+      }
+      ConversionPool::Stats pool_stats = conversion_pool->stats();
+      ImGui::Text("Workers: %d  Queued: %d  Converted: %llu",
+                  pool_stats.threads, pool_stats.queued, (unsigned long long)pool_stats.processed);
+      if (event_latency.count > 0) {
+        ImGui::Text("Callback to UI: avg %lld us  max %lld us  (%llu events, %llu overflowed, %llu dropped)",
+                    (long long)(event_latency.total_us / (int64_t)event_latency.count),
+                    (long long)event_latency.max_us, (unsigned long long)event_latency.count,
+                    (unsigned long long)app_events_overflowed.load(),
+                    (unsigned long long)app_events_dropped.load());
+      }
+      bool tracing = Trace::recording();
+      if (ImGui::Checkbox("Record trace", &tracing)) {
+        if (tracing) {
+          Trace::start();
         } else {
-          cout << "Unsubscribing" << endl;
-          otc_session_unsubscribe(session, subscriber);
-          ui_state.isSubscribing = false;
+          Trace::stop();
         }
       }
-
-      if(ui_state.showSubscriberButtons && ImGui::Checkbox("Subscriber Audio", &subscriberAudio)) {
-        setSubscriberAudio();
+      ImGui::SameLine();
+      if (ImGui::Button("Dump trace")) {
+        char trace_path[64];
+        snprintf(trace_path, sizeof(trace_path), "trace-%lld.json", (long long)time(nullptr));
+        if (Trace::dump(trace_path)) {
+          LOG_INFO("Trace written to %s", trace_path);
+        }
       }
-
-      if(ui_state.showSubscriberButtons && ImGui::Checkbox("Subscriber Video", &subscriberVideo)) {
-        setSubscriberVideo();
+      ImGui::SameLine();
+      ImGui::Text("%llu events, %llu dropped",
+                  (unsigned long long)Trace::events(), (unsigned long long)Trace::dropped());
+      if (Logger::dropped() > 0) {
+        ImGui::Text("Log messages dropped: %llu", (unsigned long long)Logger::dropped());
+      }
+      if (!ui_state.lastError.empty()) {
+        ImGui::TextWrapped("Last error: %s", ui_state.lastError.c_str());
+      }
+      StreamRegistry::Stats stream_stats = stream_registry.stats();
+      ImGui::Text("Streams: %d  Pending: %d  Removed: %d",
+                  stream_stats.live, stream_stats.pending, stream_stats.dead);
+      ImGui::Text("Live renderers: %d  Textures: %d  PBOs: %d  Frame memory: %llu KB",
+                  Renderer::live_count(), Renderer::live_textures() + TextureUploader::live_textures(),
+                  TextureUploader::live_buffers(), (unsigned long long)FramePool::total_bytes() / 1024);
+      if (upload_thread != nullptr) {
+        UploadThread::Stats upload_stats = upload_thread->stats();
+        ImGui::Text("Upload thread: %llu uploads  %llu passes  last pass %lld us",
+                    (unsigned long long)upload_stats.uploads, (unsigned long long)upload_stats.passes,
+                    (long long)upload_stats.last_pass_us);
+      }
+      if (synthetic_capturer != nullptr) {
+        const SyntheticCapturer::Settings& capture = synthetic_capturer->settings();
+        SyntheticCapturer::Stats capture_stats = synthetic_capturer->stats();
+        ImGui::Text("Capture %dx%d@%d: %llu frames  %llu late  last draw %lld us",
+                    capture.width, capture.height, capture.fps,
+                    (unsigned long long)capture_stats.frames, (unsigned long long)capture_stats.late,
+                    (long long)capture_stats.last_draw_us);
+      }
+      if (replay_source != nullptr) {
+        ReplaySource::Stats replay_stats = replay_source->stats();
+        ImGui::Text("Replay %dx%d: %llu frames  %.1f fps  %.1f MB/s  %llu loops  %llu late",
+                    replay_source->width(), replay_source->height(),
+                    (unsigned long long)replay_stats.frames, replay_stats.fps, replay_stats.megabytes_per_second,
+                    (unsigned long long)replay_stats.loops, (unsigned long long)replay_stats.late);
       }
       ImGui::End();
 
+      subscriber_manager.draw(session);
+      if (latency_mode) {
+        latency_probe.draw();
+      }
+      if (audio_device.installed()) {
+        audio_device.draw();
+      }
+
       // Render Pub and Subs
-      for (auto const& el : renderer_map) {
-        if (el.second == nullptr) {
-          unique_ptr<Renderer> ptr(new Renderer(el.first));
-          renderer_map[el.first] = std::move(ptr);
-        } else {
-          el.second->render();
-        }
+      int64_t next_swap_us = last_swap_us + refresh_interval_us;
+      if (upload_thread != nullptr) {
+        upload_thread->set_next_swap(next_swap_us);
       }
+      stream_registry.activate_pending([](const char* name) {
+        return new Renderer(name, &renderer_settings, yuv_converter);
+      });
+      stream_registry.for_each_live([next_swap_us](Renderer* renderer) {
+        renderer->render(next_swap_us);
+      });
 
       // Rendering
       ImGui::Render();
+      Trace::complete("ImGui build", Trace::NO_STREAM, build_start_us, FramePacer::now_us());
       int display_w, display_h;
       glfwGetFramebufferSize(window, &display_w, &display_h);
       glViewport(0, 0, display_w, display_h);
       glClearColor(clear_color.x, clear_color.y, clear_color.z, clear_color.w);
       glClear(GL_COLOR_BUFFER_BIT);
-      ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-
-      glfwSwapBuffers(window);
+      {
+        TraceSpan span("RenderDrawData");
+        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+      }
+      {
+        TraceSpan span("SwapBuffers");
+        glfwSwapBuffers(window);
+      }
+      if (latency_mode) {
+        // Returning from the swap is as close to the glass as we can see
+        latency_probe.frame_presented(FramePacer::now_us());
+      }
+      // This frame is submitted, renderers of dropped streams can go now
+      stream_registry.collect(retire_renderer);
+      gl_garbage.flush();
+      int64_t swap_us = FramePacer::now_us();
+      // Gaps where idle mode slept say nothing about the display rate
+      if (swap_us - last_swap_us < 4 * refresh_interval_us) {
+        refresh_interval_us += (swap_us - last_swap_us - refresh_interval_us) / 16;
+      }
+      last_swap_us = swap_us;
     }
 
     // Cleanup
+    // Its thread delivers into a renderer, stop it before anything goes
+    delete replay_source;
+    replay_source = nullptr;
+    stop_ot();
+    // Converts what is still queued, so every renderer ends up idle
+    renderer_settings.conversion_pool = nullptr;
+    delete conversion_pool;
+    // Stops visiting renderers and releases its context before they go
+    delete upload_thread;
+    upload_thread = nullptr;
+    if (upload_window != NULL) {
+      glfwDestroyWindow(upload_window);
+    }
+    // Renderers own GL objects, they must go while the context still exists
+    stream_registry.remove_all();
+    stream_registry.collect(retire_renderer);
+    gl_garbage.flush();
+    // Recordings that were stopped or whose renderer went are still being written
+    Recorder::wait_finished();
+    delete yuv_converter;
+    delete synthetic_capturer;
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Bounded lock-free multi producer / single consumer queue of plain
+ * values, after Dmitry Vyukov's bounded queue.
+ *
+ * Every cell carries a sequence number telling producers and the consumer
+ * whose turn it is, so producers only contend on one counter and never
+ * wait for each other. All storage lives in the object, pushing never
+ * allocates.
+ */
+template <typename T, size_t Capacity>
+class MpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    MpscQueue() : enqueue_position(0), dequeue_position(0) {
+        for (size_t i = 0; i < Capacity; i++) {
+            this->cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Any thread. Returns false when the queue is full.
+    bool try_push(const T& value) {
+        Cell* cell;
+        size_t position = this->enqueue_position.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &this->cells[position & MASK];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (difference == 0) {
+                if (this->enqueue_position.compare_exchange_weak(position, position + 1,
+                                                                 std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = this->enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = value;
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Returns false when there is nothing to take.
+    bool try_pop(T* value) {
+        Cell* cell = &this->cells[this->dequeue_position & MASK];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(sequence) - static_cast<intptr_t>(this->dequeue_position + 1) < 0) {
+            return false;
+        }
+        *value = cell->value;
+        cell->sequence.store(this->dequeue_position + Capacity, std::memory_order_release);
+        this->dequeue_position++;
+        return true;
+    }
+
+private:
+    static const size_t MASK = Capacity - 1;
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    Cell cells[Capacity];
+    // Producers and the consumer each get their own cache line
+    alignas(64) std::atomic<size_t> enqueue_position;
+    alignas(64) size_t dequeue_position;
+};
@@ -0,0 +1,379 @@
+#include "recorder.h"
+#include "frame_pacer.h"
+#include "log.h"
+#include "renderer.h"
+#include "trace.h"
+#include "yuv_convert.h"
+
+#include <algorithm>
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Byte offsets of blue, green and red in each 32 bit RGB layout, libyuv naming
+struct PackedLayout {
+    enum otc_video_frame_format format;
+    int blue;
+    int green;
+    int red;
+};
+
+static const PackedLayout packed_layouts[] = {
+    { OTC_VIDEO_FRAME_FORMAT_ARGB32, 0, 1, 2 },
+    { OTC_VIDEO_FRAME_FORMAT_BGRA32, 3, 2, 1 },
+    { OTC_VIDEO_FRAME_FORMAT_ABGR32, 2, 1, 0 },
+    { OTC_VIDEO_FRAME_FORMAT_RGBA32, 1, 2, 3 },
+};
+
+// Recorders handed to finish(), deleted one after the other by finisher
+static mutex finisher_mutex;
+static condition_variable finisher_wake;
+static vector<Recorder*> finishing;
+static bool finisher_stopping = false;
+static std::thread finisher;
+
+static void run_finisher() {
+    Trace::set_thread_name("recorder finisher");
+    unique_lock<mutex> lock(finisher_mutex);
+    for (;;) {
+        if (!finishing.empty()) {
+            Recorder* recorder = finishing.back();
+            finishing.pop_back();
+            lock.unlock();
+            delete recorder;
+            lock.lock();
+            continue;
+        }
+        if (finisher_stopping) {
+            break;
+        }
+        finisher_wake.wait(lock);
+    }
+}
+
+void Recorder::finish(Recorder* recorder) {
+    if (recorder == nullptr) {
+        return;
+    }
+    lock_guard<mutex> lock(finisher_mutex);
+    finishing.push_back(recorder);
+    if (!finisher.joinable()) {
+        finisher_stopping = false;
+        finisher = std::thread(run_finisher);
+    }
+    finisher_wake.notify_one();
+}
+
+void Recorder::wait_finished() {
+    {
+        lock_guard<mutex> lock(finisher_mutex);
+        if (!finisher.joinable()) {
+            return;
+        }
+        finisher_stopping = true;
+        finisher_wake.notify_one();
+    }
+    finisher.join();
+    finisher = std::thread();
+}
+
+Recorder::Recorder(const std::string& prefix, bool direct_io)
+    : running(true), frames_written(0), frames_dropped(0), bytes_written(0), bytes_per_second(0),
+      direct_active(false), files(0), prefix(prefix), direct_io(direct_io), file(-1), failed(false),
+      file_width(0), file_height(0), chunk(nullptr), chunk_used(0), rate_start_us(0), rate_start_bytes(0) {
+    // O_DIRECT wants the memory aligned as well as the sizes
+    void* memory = nullptr;
+    if (posix_memalign(&memory, ALIGNMENT, CHUNK_SIZE) != 0) {
+        LOG_ERROR("Could not allocate the recording buffer");
+        this->failed = true;
+    }
+    this->chunk = static_cast<uint8_t*>(memory);
+    this->thread = std::thread(&Recorder::run, this);
+}
+
+Recorder::~Recorder() {
+    this->running.store(false);
+    this->wake.notify_one();
+    this->thread.join();
+    free(this->chunk);
+}
+
+void Recorder::push(const SourceFrame& source) {
+    if (this->queue.size() >= QUEUE_SIZE) {
+        this->frames_dropped++;
+        return;
+    }
+    VideoBuffer* buffer = this->pool.acquire(source.format, source.width, source.height);
+    for (int i = 0; i < buffer->plane_count; i++) {
+        copy_plane(source.planes[i], source.strides[i],
+                   buffer->planes[i], buffer->strides[i],
+                   buffer->plane_widths[i] * buffer->bytes_per_pixel(i),
+                   buffer->plane_heights[i]);
+    }
+    buffer->timestamp = source.timestamp;
+    this->queue.write(&buffer, 1);
+    this->wake.notify_one();
+}
+
+Recorder::Stats Recorder::stats() const {
+    Stats stats;
+    stats.frames = this->frames_written;
+    stats.dropped = this->frames_dropped;
+    stats.bytes = this->bytes_written;
+    stats.queued = static_cast<int>(this->queue.size());
+    stats.megabytes_per_second = this->bytes_per_second / 1e6;
+    stats.direct_io = this->direct_active;
+    stats.files = this->files;
+    return stats;
+}
+
+void Recorder::run() {
+    Trace::set_thread_name("recorder");
+    this->rate_start_us = FramePacer::now_us();
+    for (;;) {
+        VideoBuffer* frame;
+        if (this->queue.read(&frame, 1) == 1) {
+            {
+                TraceSpan span("record");
+                this->write_frame(frame);
+            }
+            this->pool.release(frame);
+            this->update_rate();
+            continue;
+        }
+        this->update_rate();
+        // Drains the queue before leaving
+        if (!this->running.load()) {
+            break;
+        }
+        unique_lock<mutex> lock(this->wake_mutex);
+        this->wake.wait_for(lock, chrono::milliseconds(10));
+    }
+    this->close_file();
+}
+
+void Recorder::update_rate() {
+    int64_t now = FramePacer::now_us();
+    if (now - this->rate_start_us >= 1000000) {
+        uint64_t bytes = this->bytes_written;
+        this->bytes_per_second = (bytes - this->rate_start_bytes) * 1000000 / (now - this->rate_start_us);
+        this->rate_start_us = now;
+        this->rate_start_bytes = bytes;
+    }
+}
+
+void Recorder::write_frame(const VideoBuffer* frame) {
+    if (this->failed) {
+        this->frames_dropped++;
+        return;
+    }
+    int width = frame->width;
+    int height = frame->height;
+    if (this->file < 0 || width != this->file_width || height != this->file_height) {
+        this->close_file();
+        if (!this->open_file(width, height)) {
+            this->failed = true;
+            this->frames_dropped++;
+            return;
+        }
+    }
+
+    char header[48];
+    int length = snprintf(header, sizeof(header), "FRAME XTS=%lld\n", (long long)frame->timestamp);
+    this->append(header, length);
+
+    int chroma_width = (width + 1) / 2;
+    int chroma_height = (height + 1) / 2;
+    size_t luma_size = static_cast<size_t>(width) * height;
+    size_t chroma_size = static_cast<size_t>(chroma_width) * chroma_height;
+    if (frame->format == OTC_VIDEO_FRAME_FORMAT_YUV420P) {
+        this->append_plane(frame->planes[0], frame->strides[0], width, height);
+        this->append_plane(frame->planes[1], frame->strides[1], chroma_width, chroma_height);
+        this->append_plane(frame->planes[2], frame->strides[2], chroma_width, chroma_height);
+    } else if (frame->format == OTC_VIDEO_FRAME_FORMAT_NV12) {
+        this->converted.resize(2 * chroma_size);
+        uint8_t* u = this->converted.data();
+        uint8_t* v = u + chroma_size;
+        split_uv_plane(frame->planes[1], frame->strides[1], u, chroma_width, v, chroma_width,
+                       chroma_width, chroma_height);
+        this->append_plane(frame->planes[0], frame->strides[0], width, height);
+        this->append(u, 2 * chroma_size);
+    } else {
+        const PackedLayout* layout = nullptr;
+        for (const PackedLayout& packed : packed_layouts) {
+            if (packed.format == frame->format) {
+                layout = &packed;
+            }
+        }
+        if (layout == nullptr) {
+            this->frames_dropped++;
+            return;
+        }
+        size_t i420_size = luma_size + 2 * chroma_size;
+        bool swizzle = layout->format != OTC_VIDEO_FRAME_FORMAT_ARGB32;
+        this->converted.resize(i420_size + (swizzle ? luma_size * 4 : 0));
+        uint8_t* y = this->converted.data();
+        uint8_t* u = y + luma_size;
+        uint8_t* v = u + chroma_size;
+        const uint8_t* bgra = frame->planes[0];
+        int bgra_stride = frame->strides[0];
+        if (swizzle) {
+            // bgra_to_i420 reads B, G, R, A
+            uint8_t* reordered = y + i420_size;
+            for (int row = 0; row < height; row++) {
+                const uint8_t* in = frame->planes[0] + row * frame->strides[0];
+                uint8_t* out = reordered + static_cast<size_t>(row) * width * 4;
+                for (int x = 0; x < width; x++, in += 4, out += 4) {
+                    out[0] = in[layout->blue];
+                    out[1] = in[layout->green];
+                    out[2] = in[layout->red];
+                    out[3] = 255;
+                }
+            }
+            bgra = reordered;
+            bgra_stride = width * 4;
+        }
+        bgra_to_i420(bgra, bgra_stride, y, width, u, chroma_width, v, chroma_width, width, height);
+        this->append(y, i420_size);
+    }
+    // A write error on the way leaves the frame incomplete
+    if (this->failed) {
+        this->frames_dropped++;
+        return;
+    }
+    this->frames_written++;
+}
+
+bool Recorder::open_file(int width, int height) {
+    int number = ++this->files;
+    char suffix[16] = "";
+    if (number > 1) {
+        snprintf(suffix, sizeof(suffix), "-%d", number);
+    }
+    std::string path = this->prefix + suffix + ".y4m";
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    this->file = -1;
+#if defined(O_DIRECT)
+    if (this->direct_io) {
+        this->file = open(path.c_str(), flags | O_DIRECT, 0644);
+        if (this->file < 0) {
+            LOG_WARNING("O_DIRECT not available for %s, writing through the page cache", path.c_str());
+        }
+    }
+#endif
+    this->direct_active = this->file >= 0;
+    if (this->file < 0) {
+        this->file = open(path.c_str(), flags, 0644);
+    }
+    if (this->file < 0) {
+        LOG_ERROR("Could not create %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    this->file_width = width;
+    this->file_height = height;
+    this->chunk_used = 0;
+
+    // The rate is nominal, the real timing is in each frame's XTS
+    char header[96];
+    int length = snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F30:1 Ip A1:1 C420jpeg\n", width, height);
+    this->append(header, length);
+    LOG_INFO("Recording %dx%d to %s", width, height, path.c_str());
+    return true;
+}
+
+void Recorder::close_file() {
+    if (this->file < 0) {
+        return;
+    }
+    if (this->chunk_used > 0 && !this->failed) {
+        size_t tail = this->chunk_used;
+        size_t padded = tail;
+        if (this->direct_active) {
+            // O_DIRECT only writes whole blocks, the padding is cut off again
+            padded = (tail + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+            memset(this->chunk + tail, 0, padded - tail);
+        }
+        if (this->write_all(this->chunk, padded) && padded > tail) {
+            off_t end = lseek(this->file, 0, SEEK_CUR);
+            if (end < 0 || ftruncate(this->file, end - (padded - tail)) != 0) {
+                LOG_ERROR("Could not trim the padding off %s: %s", this->prefix.c_str(), strerror(errno));
+            }
+            this->bytes_written -= padded - tail;
+        }
+    }
+    this->chunk_used = 0;
+    close(this->file);
+    this->file = -1;
+}
+
+void Recorder::append(const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while (size > 0 && !this->failed) {
+        size_t part = min(size, CHUNK_SIZE - this->chunk_used);
+        memcpy(this->chunk + this->chunk_used, bytes, part);
+        this->chunk_used += part;
+        bytes += part;
+        size -= part;
+        if (this->chunk_used == CHUNK_SIZE) {
+            this->failed = !this->flush_chunk();
+        }
+    }
+}
+
+void Recorder::append_plane(const uint8_t* plane, int stride, int row_size, int rows) {
+    if (stride == row_size) {
+        this->append(plane, static_cast<size_t>(row_size) * rows);
+        return;
+    }
+    for (int row = 0; row < rows; row++) {
+        this->append(plane + row * stride, row_size);
+    }
+}
+
+bool Recorder::flush_chunk() {
+    size_t size = this->chunk_used;
+    if (this->direct_active) {
+        size &= ~(ALIGNMENT - 1);
+    }
+    if (!this->write_all(this->chunk, size)) {
+        return false;
+    }
+    // Whatever is not a whole block yet goes out with the next chunk
+    memmove(this->chunk, this->chunk + size, this->chunk_used - size);
+    this->chunk_used -= size;
+    return true;
+}
+
+bool Recorder::write_all(const uint8_t* data, size_t size) {
+    TraceSpan span("disk write");
+    while (size > 0) {
+        ssize_t written = write(this->file, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("Recording %s stopped: %s", this->prefix.c_str(), strerror(errno));
+            return false;
+        }
+        data += written;
+        size -= written;
+        this->bytes_written += written;
+#if defined(O_DIRECT)
+        if (this->direct_active && size > 0 && written % ALIGNMENT != 0) {
+            // Neither the rest of the data nor the file offset is block aligned
+            // anymore, O_DIRECT would refuse every later write
+            LOG_WARNING("Short write to %s, writing through the page cache from here", this->prefix.c_str());
+            fcntl(this->file, F_SETFL, fcntl(this->file, F_GETFL) & ~O_DIRECT);
+            this->direct_active = false;
+        }
+#endif
+    }
+    return true;
+}
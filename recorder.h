@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame_pool.h"
+#include "spsc_ring.h"
+
+struct SourceFrame;
+
+/**
+ * Records the frames one stream delivers into a Y4M file, for offline
+ * quality analysis.
+ *
+ * The delivering thread only copies the frame into a pooled buffer and
+ * queues it; when the queue is full the frame is dropped from the
+ * recording, never from the display. A writer thread converts frames to
+ * I420, stages them in a large page aligned buffer and writes whole
+ * chunks, with O_DIRECT when asked for and the filesystem allows it.
+ *
+ * Frame headers carry the SDK timestamp as XTS=, in microseconds. A size
+ * change starts a new file, Y4M has one size per file.
+ */
+class Recorder {
+public:
+    struct Stats {
+        uint64_t frames;
+        uint64_t dropped;
+        uint64_t bytes;
+        int queued;
+        // Over the last second
+        double megabytes_per_second;
+        bool direct_io;
+        // Files written so far, more than one after size changes
+        int files;
+    };
+
+    // Writes <prefix>.y4m, then <prefix>-2.y4m and so on after size changes
+    Recorder(const std::string& prefix, bool direct_io);
+    // Writes out what is still queued before returning
+    ~Recorder();
+
+    // Deletes the recorder on a background thread, so whoever stops a
+    // recording never waits for the disk. Nothing may push() anymore.
+    static void finish(Recorder* recorder);
+    // Waits for every finish() so far, before the process exits
+    static void wait_finished();
+
+    // One thread at a time. Copies the frame, never blocks on the disk.
+    void push(const SourceFrame& frame);
+
+    Stats stats() const;
+    const std::string& name() const { return this->prefix; }
+
+private:
+    static const size_t QUEUE_SIZE = 16;
+    static const size_t CHUNK_SIZE = 4 << 20;
+    static const size_t ALIGNMENT = 4096;
+
+    void run();
+    void write_frame(const VideoBuffer* frame);
+    bool open_file(int width, int height);
+    void close_file();
+    void append(const void* data, size_t size);
+    void append_plane(const uint8_t* plane, int stride, int row_size, int rows);
+    // Writes what is in chunk, only whole blocks with O_DIRECT
+    bool flush_chunk();
+    bool write_all(const uint8_t* data, size_t size);
+    void update_rate();
+
+    FramePool pool;
+    SpscRing<VideoBuffer*, QUEUE_SIZE> queue;
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    std::atomic<bool> running;
+    std::thread thread;
+
+    std::atomic<uint64_t> frames_written;
+    std::atomic<uint64_t> frames_dropped;
+    std::atomic<uint64_t> bytes_written;
+    std::atomic<uint64_t> bytes_per_second;
+    std::atomic<bool> direct_active;
+    std::atomic<int> files;
+
+    const std::string prefix;
+    const bool direct_io;
+    // Writer thread only
+    int file;
+    // Set after a write error, later frames are dropped
+    bool failed;
+    int file_width;
+    int file_height;
+    uint8_t* chunk;
+    size_t chunk_used;
+    std::vector<uint8_t> converted;
+    int64_t rate_start_us;
+    uint64_t rate_start_bytes;
+};
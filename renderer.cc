@@ -1,47 +1,788 @@
 #include "renderer.h"
+#include "conversion_pool.h"
 #include "imgui.h"
+#include "latency_probe.h"
+#include "latency_stamp.h"
+#include "recorder.h"
+#include "trace.h"
+#include "yuv_convert.h"
 
+#include <algorithm>
 #include <iostream>
 
+#include <ctype.h>
+#include <math.h>
 #include <stdlib.h>
+#include <thread>
+#include <time.h>
 
 using namespace std;
 
-Renderer::Renderer(const std::string name) : last_frame(nullptr), name(name), image_texture(0) {
+std::atomic<int> Renderer::renderers_alive(0);
+std::atomic<int> Renderer::textures_alive(0);
+
+Renderer::Renderer(const std::string name, const RendererSettings* settings, YuvConverter* yuv_converter)
+    : producer_busy(false), pending(nullptr), active_workers(0), pacer(&pool), frames_received(0), frames_dropped(0), next_sequence(0), name(name), trace_stream(Trace::intern(name.c_str())), image_texture(0),
+      settings(settings), yuv_converter(yuv_converter), display_texture(0), image_width(0), image_height(0),
+      uploaded_sequence(0), uploaded_width(0), uploaded_height(0), converted_color_space(-1), converted_color_range(-1), uploads_saved(0),
+      display_width(0), display_height(0), recorder(nullptr), recorder_users(0), thread_uploads(0), thread_stalls(0) {
     // OpenGL initialization
     // THIS MUST HAPPEN IN THE MAIN THREAD!
+    // (and so does the construction of plane_uploaders)
     glGenTextures(1, &this->image_texture);
     glBindTexture(GL_TEXTURE_2D, this->image_texture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
     glBindTexture(GL_TEXTURE_2D, 0);
+    textures_alive++;
+
+    if (settings->upload_thread) {
+        for (int i = 0; i < 3; i++) {
+            OutputTexture& output = this->outputs.slot(i);
+            glGenTextures(1, &output.texture);
+            glBindTexture(GL_TEXTURE_2D, output.texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            textures_alive++;
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        // The upload thread's context only sees these once they are flushed
+        glFlush();
+    }
+    renderers_alive++;
+}
+
+Renderer::~Renderer() {
+    // Frames no longer arrive, so nobody else can be using it
+    Recorder::finish(this->recorder.exchange(nullptr));
+    // Buffers go back to their pools, which free them on destruction
+    for (int i = 0; i < 3; i++) {
+        this->pool.release(this->frames.slot(i));
+    }
+    this->pending_pool.release(this->pending.exchange(nullptr));
+    this->pacer.flush();
+    GlGarbage garbage;
+    this->release_gl(&garbage);
+    garbage.flush();
+    Trace::release(this->trace_stream);
+    renderers_alive--;
+}
+
+bool Renderer::is_idle() const {
+    // A queued renderer keeps producer_busy set, and a worker that just cleared
+    // it is still counted in active_workers until it is done with us
+    return !this->producer_busy.load() && this->active_workers.load() == 0 && this->pending.load() == nullptr;
+}
+
+void Renderer::release_gl(GlGarbage* garbage) {
+    if (this->image_texture != 0) {
+        garbage->textures.push_back(this->image_texture);
+        this->image_texture = 0;
+        textures_alive--;
+    }
+    for (int i = 0; i < 3; i++) {
+        OutputTexture& output = this->outputs.slot(i);
+        if (output.texture != 0) {
+            garbage->textures.push_back(output.texture);
+            output.texture = 0;
+            textures_alive--;
+        }
+        if (output.ready_fence != nullptr) {
+            garbage->fences.push_back(output.ready_fence);
+            output.ready_fence = nullptr;
+        }
+        if (output.consumer_fence != nullptr) {
+            garbage->fences.push_back(output.consumer_fence);
+            output.consumer_fence = nullptr;
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        this->plane_uploaders[i].release(garbage);
+    }
+    this->display_texture = 0;
+}
+
+// How each 32 bit RGB layout is handed to GL as is. The SDK names follow
+// libyuv, where ARGB32 means B, G, R, A in memory.
+struct PackedFormat {
+    enum otc_video_frame_format format;
+    GLenum gl_format;
+    GLenum type;
+};
+
+static const PackedFormat packed_formats[] = {
+    { OTC_VIDEO_FRAME_FORMAT_ARGB32, GL_BGRA, GL_UNSIGNED_BYTE },
+    { OTC_VIDEO_FRAME_FORMAT_BGRA32, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8 },
+    { OTC_VIDEO_FRAME_FORMAT_ABGR32, GL_RGBA, GL_UNSIGNED_BYTE },
+    { OTC_VIDEO_FRAME_FORMAT_RGBA32, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8 },
+};
+
+static const PackedFormat* find_packed_format(enum otc_video_frame_format format) {
+    for (const PackedFormat& packed : packed_formats) {
+        if (packed.format == format) {
+            return &packed;
+        }
+    }
+    return nullptr;
 }
 
-void Renderer::render() {
-    if (this->last_frame == nullptr) {
+const VideoBuffer* Renderer::next_frame(int64_t next_swap_us, int depth) {
+    const VideoBuffer* frame = nullptr;
+    if (depth > 0) {
+        frame = this->pacer.select(next_swap_us, depth);
+    } else {
+        this->pacer.flush();
+    }
+    if (frame == nullptr) {
+        this->frames.acquire();
+        frame = this->frames.front();
+    }
+    // Sequences only grow. Whatever frames holds after the pacer was in use
+    // is older than what is on screen, showing it would jump back in time.
+    if (frame != nullptr && frame->sequence < this->uploaded_sequence) {
+        return nullptr;
+    }
+    return frame;
+}
+
+void Renderer::render(int64_t next_swap_us) {
+    int depth = this->settings->jitter_depth;
+    if (this->settings->upload_thread) {
+        this->render_output(depth);
         return;
     }
+
+    const VideoBuffer* frame = this->next_frame(next_swap_us, depth);
+    if (frame == nullptr) {
+        // Keep showing what the textures hold, if anything
+        if (this->uploaded_sequence == 0) {
+            return;
+        }
+    } else if (frame->sequence == this->uploaded_sequence) {
+        // Nothing new since the last vsync, the textures are still good
+        this->uploads_saved++;
+        if (!frame->packed()) {
+            this->convert_yuv(frame, frame->width, frame->height);
+        }
+    } else {
+        int64_t upload_start = FramePacer::now_us();
+        Trace::async("queued", this->trace_stream, frame->received_us, upload_start);
+        if (frame->packed()) {
+            this->upload_packed(frame);
+        } else {
+            this->upload_yuv(frame, frame->width, frame->height);
+        }
+        Trace::complete("upload", this->trace_stream, upload_start, FramePacer::now_us());
+        if (frame->latency_stamp >= 0 && this->settings->latency_probe != nullptr) {
+            this->settings->latency_probe->frame_shown(static_cast<uint32_t>(frame->latency_stamp));
+        }
+    }
+    if (frame != nullptr) {
+        this->uploaded_sequence = frame->sequence;
+        this->uploaded_width = frame->width;
+        this->uploaded_height = frame->height;
+    }
+
+    uint64_t uploads = 0, stalls = 0;
+    for (int i = 0; i < 3; i++) {
+        uploads += this->plane_uploaders[i].stats().uploads;
+        stalls += this->plane_uploaders[i].stats().stalls;
+    }
+    this->draw_window(this->display_texture, this->uploaded_width, this->uploaded_height, depth, uploads, stalls);
+}
+
+void Renderer::render_output(int depth) {
+    if (this->outputs.has_new()) {
+        // The texture we showed so far goes back to the upload thread, which
+        // must not draw into it before our last frame using it is done
+        OutputTexture& previous = this->outputs.front();
+        if (previous.width > 0) {
+            previous.consumer_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+        }
+        this->outputs.acquire();
+        OutputTexture& current = this->outputs.front();
+        if (current.ready_fence != nullptr) {
+            // Waits on the GPU, not here
+            glWaitSync(current.ready_fence, 0, GL_TIMEOUT_IGNORED);
+            glDeleteSync(current.ready_fence);
+            current.ready_fence = nullptr;
+        }
+        if (current.latency_stamp >= 0 && this->settings->latency_probe != nullptr) {
+            this->settings->latency_probe->frame_shown(static_cast<uint32_t>(current.latency_stamp));
+        }
+    }
+    const OutputTexture& current = this->outputs.front();
+    if (current.width == 0) {
+        return;
+    }
+    this->draw_window(current.texture, current.width, current.height, depth,
+                      this->thread_uploads.load(), this->thread_stalls.load());
+}
+
+void Renderer::draw_window(GLuint texture, int w, int h, int depth, uint64_t uploads, uint64_t stalls) {
+    // Native size the first time, after that the user decides and frames
+    // are downscaled to whatever the window has room for
+    ImGui::SetNextWindowSize(ImVec2(w + 16, h + 100), ImGuiCond_FirstUseEver);
     ImGui::Begin(this->name.c_str());
     {
-        this->mutex.lock();
-        const uint8_t* pixels = otc_video_frame_get_plane_binary_data(this->last_frame, static_cast<enum otc_video_frame_plane>(0));
-        auto w = otc_video_frame_get_width(this->last_frame);
-        auto h = otc_video_frame_get_height(this->last_frame);
+        ImVec2 available = ImGui::GetContentRegionAvail();
+        available.y -= (depth > 0 ? 6 : 5) * ImGui::GetTextLineHeightWithSpacing();
+        float scale = std::min(available.x / w, available.y / h);
+        ImVec2 size(std::max(1.0f, w * scale), std::max(1.0f, h * scale));
+        ImGui::Image((void *)(intptr_t)texture, size);
 
-        glBindTexture(GL_TEXTURE_2D, this->image_texture);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_BGRA, GL_UNSIGNED_BYTE, pixels);
-        ImGui::Image((void *)(intptr_t)this->image_texture, ImVec2(w, h));
-        this->mutex.unlock();
+        ImVec2 framebuffer_scale = ImGui::GetIO().DisplayFramebufferScale;
+        this->display_width.store(static_cast<int>(size.x * framebuffer_scale.x), std::memory_order_relaxed);
+        this->display_height.store(static_cast<int>(size.y * framebuffer_scale.y), std::memory_order_relaxed);
+
+        ImGui::Text("Uploads: %llu  PBO stalls: %llu",
+                    (unsigned long long)uploads, (unsigned long long)stalls);
+        ImGui::Text("Frames: %llu  Dropped: %llu  Uploads saved: %llu",
+                    (unsigned long long)this->frames_received.load(),
+                    (unsigned long long)this->frames_dropped.load(),
+                    (unsigned long long)this->uploads_saved);
+        ImGui::Text("Uploaded: %dx%d  Shown: %dx%d", w, h, (int)size.x, (int)size.y);
+        FramePool::Stats pool_stats = this->pool.stats();
+        ImGui::Text("Pool hits: %llu  misses: %llu  held: %llu KB",
+                    (unsigned long long)pool_stats.hits, (unsigned long long)pool_stats.misses,
+                    (unsigned long long)pool_stats.bytes_held / 1024);
+        if (depth > 0) {
+            FramePacer::Stats pacer_stats = this->pacer.stats();
+            ImGui::Text("Queued: %d  Judder: %.1f ms  Duplicates: %llu  Late: %llu  Skipped: %llu",
+                        pacer_stats.queued, pacer_stats.judder_ms,
+                        (unsigned long long)pacer_stats.duplicates, (unsigned long long)pacer_stats.late,
+                        (unsigned long long)pacer_stats.skipped);
+        }
+
+        Recorder* recorder = this->recorder.load();
+        bool record = recorder != nullptr;
+        if (ImGui::Checkbox("Record", &record)) {
+            if (record) {
+                this->start_recording();
+            } else {
+                this->stop_recording();
+            }
+        }
+        if (recorder != nullptr && this->recorder.load() == recorder) {
+            Recorder::Stats record_stats = recorder->stats();
+            ImGui::SameLine();
+            ImGui::Text("%llu frames  %llu dropped  Queued: %d  %.1f MB/s%s",
+                        (unsigned long long)record_stats.frames, (unsigned long long)record_stats.dropped,
+                        record_stats.queued, record_stats.megabytes_per_second,
+                        record_stats.direct_io ? "  O_DIRECT" : "");
+        }
     }
     ImGui::End();
 }
 
+void Renderer::start_recording() {
+    if (this->recorder.load() != nullptr) {
+        return;
+    }
+    std::string prefix = "record-";
+    for (char c : this->name) {
+        prefix += isalnum(static_cast<unsigned char>(c)) || c == '-' ? c : '_';
+    }
+    prefix += "-" + std::to_string(static_cast<long long>(time(nullptr)));
+    this->recorder.store(new Recorder(prefix, this->settings->record_direct_io));
+}
+
+void Renderer::stop_recording() {
+    Recorder* recorder = this->recorder.exchange(nullptr);
+    if (recorder == nullptr) {
+        return;
+    }
+    // set_frame() checks in before looking at the recorder, so once this
+    // drops to zero no one can still hold it
+    while (this->recorder_users.load() != 0) {
+        std::this_thread::yield();
+    }
+    // The queued frames go to disk in the background
+    Recorder::finish(recorder);
+}
+
+bool Renderer::upload_to_output(YuvConverter* converter, int64_t next_swap_us) {
+    const VideoBuffer* frame = this->next_frame(next_swap_us, this->settings->jitter_depth);
+    if (frame == nullptr) {
+        return false;
+    }
+    int color_space = this->settings->color_space;
+    int color_range = this->settings->color_range;
+    bool fresh = frame->sequence != this->uploaded_sequence;
+    bool recolor = !frame->packed() &&
+        (color_space != this->converted_color_space || color_range != this->converted_color_range);
+    if (!fresh && !recolor) {
+        return false;
+    }
+
+    int64_t upload_start = FramePacer::now_us();
+    if (fresh) {
+        Trace::async("queued", this->trace_stream, frame->received_us, upload_start);
+    }
+    TraceSpan span("upload", this->trace_stream);
+
+    OutputTexture& output = this->outputs.back();
+    if (output.consumer_fence != nullptr) {
+        // The UI may still be drawing this texture
+        if (glClientWaitSync(output.consumer_fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            this->thread_stalls++;
+            glClientWaitSync(output.consumer_fence, 0, 1000000000);
+        }
+        glDeleteSync(output.consumer_fence);
+        output.consumer_fence = nullptr;
+    }
+    if (output.ready_fence != nullptr) {
+        // Published before but never shown
+        glDeleteSync(output.ready_fence);
+        output.ready_fence = nullptr;
+    }
+
+    int w = frame->width;
+    int h = frame->height;
+    glBindTexture(GL_TEXTURE_2D, output.texture);
+    if (w != output.allocated_width || h != output.allocated_height) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        output.allocated_width = w;
+        output.allocated_height = h;
+    }
+
+    if (frame->packed()) {
+        // Off the UI thread a plain synchronous upload is fine, and it lands
+        // straight in the output texture
+        const PackedFormat* packed = find_packed_format(frame->format);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, frame->strides[0] / 4);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, packed->gl_format, packed->type, frame->planes[0]);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    } else {
+        glBindTexture(GL_TEXTURE_2D, 0);
+        if (fresh) {
+            for (int i = 0; i < frame->plane_count; i++) {
+                this->upload_plane(frame, i);
+            }
+        }
+        GLuint planes[3];
+        for (int i = 0; i < 3; i++) {
+            planes[i] = this->plane_uploaders[i].texture();
+        }
+        converter->convert(planes, frame->format == OTC_VIDEO_FRAME_FORMAT_NV12,
+                           static_cast<ColorSpace>(color_space), static_cast<ColorRange>(color_range),
+                           output.texture, w, h);
+        this->converted_color_space = color_space;
+        this->converted_color_range = color_range;
+    }
+    output.width = w;
+    output.height = h;
+    // A new color conversion of the same frame is not a new sample
+    output.latency_stamp = fresh ? frame->latency_stamp : -1;
+    output.ready_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // Makes the fence visible to the UI context
+    glFlush();
+    this->outputs.publish();
+
+    this->uploaded_sequence = frame->sequence;
+    this->thread_uploads++;
+    return true;
+}
+
+void Renderer::upload_plane(const VideoBuffer* frame, int index) {
+    static const GLenum internal_formats[] = { GL_R8, GL_RG8 };
+    static const GLenum formats[] = { GL_RED, GL_RG };
+
+    int bytes_per_pixel = frame->bytes_per_pixel(index);
+    this->plane_uploaders[index].upload(frame->planes[index],
+                                        frame->strides[index],
+                                        frame->plane_widths[index],
+                                        frame->plane_heights[index],
+                                        bytes_per_pixel,
+                                        internal_formats[bytes_per_pixel - 1],
+                                        formats[bytes_per_pixel - 1],
+                                        GL_UNSIGNED_BYTE);
+}
+
+void Renderer::upload_packed(const VideoBuffer* frame) {
+    const PackedFormat* packed = find_packed_format(frame->format);
+    this->plane_uploaders[0].upload(frame->planes[0], frame->strides[0], frame->width, frame->height, 4,
+                                    GL_RGBA8, packed->gl_format, packed->type);
+    this->display_texture = this->plane_uploaders[0].texture();
+}
+
+void Renderer::upload_yuv(const VideoBuffer* frame, int w, int h) {
+    for (int i = 0; i < frame->plane_count; i++) {
+        this->upload_plane(frame, i);
+    }
+    // New planes always need a new conversion
+    this->converted_color_space = -1;
+    this->convert_yuv(frame, w, h);
+}
+
+void Renderer::convert_yuv(const VideoBuffer* frame, int w, int h) {
+    int color_space = this->settings->color_space;
+    int color_range = this->settings->color_range;
+    if (color_space == this->converted_color_space && color_range == this->converted_color_range) {
+        return;
+    }
+
+    if (w != this->image_width || h != this->image_height) {
+        glBindTexture(GL_TEXTURE_2D, this->image_texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        this->image_width = w;
+        this->image_height = h;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLuint planes[3];
+    for (int i = 0; i < 3; i++) {
+        planes[i] = this->plane_uploaders[i].texture();
+    }
+    this->yuv_converter->convert(planes, frame->format == OTC_VIDEO_FRAME_FORMAT_NV12,
+                                 static_cast<ColorSpace>(color_space),
+                                 static_cast<ColorRange>(color_range),
+                                 this->image_texture, w, h);
+    this->display_texture = this->image_texture;
+    this->converted_color_space = color_space;
+    this->converted_color_range = color_range;
+}
+
+// Index into YuvMatrix is color_space * 2 + color_range
+static YuvMatrix yuv_matrix(const RendererSettings* settings) {
+    return static_cast<YuvMatrix>(settings->color_space * 2 + settings->color_range);
+}
+
+static bool is_planar(enum otc_video_frame_format format) {
+    return format == OTC_VIDEO_FRAME_FORMAT_YUV420P || format == OTC_VIDEO_FRAME_FORMAT_NV12;
+}
+
+enum otc_video_frame_format Renderer::target_format_for(enum otc_video_frame_format format) {
+    // 32 bit RGB goes to the GPU untouched in either mode
+    if (find_packed_format(format) != nullptr) {
+        return format;
+    }
+    // In shader mode YUV planes are kept as they come and converted on the GPU,
+    // anything else ends up as ARGB32
+    if (static_cast<RenderMode>(this->settings->mode.load()) == RenderMode::YUV_SHADER &&
+        this->yuv_converter->is_valid()) {
+        return is_planar(format) ? format : OTC_VIDEO_FRAME_FORMAT_YUV420P;
+    }
+    return OTC_VIDEO_FRAME_FORMAT_ARGB32;
+}
+
 void Renderer::set_frame(const otc_video_frame* frame) {
-    this->mutex.lock();
-    if (this->last_frame != nullptr) {
-        otc_video_frame_delete(this->last_frame);
+    int64_t received_us = FramePacer::now_us();
+    TraceSpan span("frame callback", this->trace_stream);
+    this->frames_received++;
+
+    enum otc_video_frame_format format = otc_video_frame_get_format(frame);
+    enum otc_video_frame_format target_format = this->target_format_for(format);
+
+    // The SDK converter is only a fallback for formats neither our kernels
+    // nor the GPU take directly, e.g. YUY2 or RGB24
+    otc_video_frame* converted = nullptr;
+    const otc_video_frame* source = frame;
+    if (target_format != format && !is_planar(format)) {
+        converted = otc_video_frame_convert(target_format, frame);
+        if (converted == nullptr) {
+            return;
+        }
+        source = converted;
+    }
+
+    SourceFrame planes;
+    planes.format = otc_video_frame_get_format(source);
+    planes.width = otc_video_frame_get_width(source);
+    planes.height = otc_video_frame_get_height(source);
+    for (int i = 0; i < 3; i++) {
+        enum otc_video_frame_plane plane = static_cast<enum otc_video_frame_plane>(i);
+        planes.planes[i] = otc_video_frame_get_plane_binary_data(source, plane);
+        planes.strides[i] = otc_video_frame_get_plane_stride(source, plane);
+    }
+    planes.timestamp = otc_video_frame_get_timestamp(frame);
+    planes.received_us = received_us;
+    planes.latency_stamp = -1;
+    uint32_t stamp_us;
+    if (this->settings->latency_probe != nullptr &&
+        latency_stamp_read(planes.planes[0], planes.strides[0], find_packed_format(planes.format) != nullptr ? 4 : 1,
+                           planes.width, planes.height, &stamp_us)) {
+        planes.latency_stamp = stamp_us;
+    }
+    this->deliver(planes, target_format);
+
+    if (converted != nullptr) {
+        otc_video_frame_delete(converted);
+    }
+}
+
+void Renderer::set_planes(const SourceFrame& source) {
+    TraceSpan span("frame callback", this->trace_stream);
+    this->frames_received++;
+    SourceFrame planes = source;
+    planes.received_us = FramePacer::now_us();
+    this->deliver(planes, this->target_format_for(planes.format));
+}
+
+void Renderer::deliver(const SourceFrame& planes, enum otc_video_frame_format target_format) {
+    this->recorder_users++;
+    Recorder* recorder = this->recorder.load();
+    if (recorder != nullptr) {
+        recorder->push(planes);
+    }
+    this->recorder_users--;
+
+    // Plain copies stay on this thread, conversion and scaling go to the pool
+    int width = planes.width;
+    int height = planes.height;
+    bool expensive = is_planar(planes.format) &&
+        (target_format == OTC_VIDEO_FRAME_FORMAT_ARGB32 ||
+         (this->settings->downscale && this->fit_to_display(&width, &height)));
+    bool offload = expensive && this->settings->conversion_pool.load() != nullptr && this->settings->use_conversion_pool;
+
+    if (!offload && this->claim_producer()) {
+        this->ingest(planes, target_format);
+        this->release_producer();
+    } else {
+        // Either wanted, or a worker is still busy with an earlier frame of ours
+        this->queue_pending(planes);
+    }
+}
+
+bool Renderer::claim_producer() {
+    return !this->producer_busy.exchange(true, std::memory_order_acquire);
+}
+
+void Renderer::release_producer() {
+    this->producer_busy.store(false, std::memory_order_release);
+    // A frame may have been queued while we held the producer side. Without
+    // the fence this load can pass the store above while queue_pending() sees
+    // us still busy, and the frame sits there until the next one arrives.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (this->pending.load(std::memory_order_acquire) != nullptr && this->claim_producer()) {
+        ConversionPool* pool = this->settings->conversion_pool.load();
+        if (pool != nullptr) {
+            pool->schedule(this);
+        } else {
+            this->convert_pending(nullptr);
+        }
+    }
+}
+
+void Renderer::queue_pending(const SourceFrame& source) {
+    TraceSpan span("stage for worker", this->trace_stream);
+    VideoBuffer* raw = this->pending_pool.acquire(source.format, source.width, source.height);
+    for (int i = 0; i < raw->plane_count; i++) {
+        copy_plane(source.planes[i], source.strides[i],
+                   raw->planes[i], raw->strides[i],
+                   raw->plane_widths[i] * raw->bytes_per_pixel(i),
+                   raw->plane_heights[i]);
+    }
+    raw->timestamp = source.timestamp;
+    raw->received_us = source.received_us;
+    raw->latency_stamp = source.latency_stamp;
+
+    VideoBuffer* previous = this->pending.exchange(raw, std::memory_order_acq_rel);
+    if (previous != nullptr) {
+        // Latest frame wins, the workers did not get to this one in time
+        this->pending_pool.release(previous);
+        this->frames_dropped++;
+    }
+
+    // Pairs with the fence in release_producer(), one of us sees the other
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (this->claim_producer()) {
+        ConversionPool* pool = this->settings->conversion_pool.load();
+        if (pool != nullptr) {
+            pool->schedule(this);
+        } else {
+            this->convert_pending(nullptr);
+        }
+    }
+}
+
+void Renderer::convert_pending(ConversionPool* pool) {
+    // The caller holds the producer side
+    this->active_workers++;
+    VideoBuffer* raw = this->pending.exchange(nullptr, std::memory_order_acq_rel);
+    if (raw != nullptr) {
+        SourceFrame source;
+        source.format = raw->format;
+        source.width = raw->width;
+        source.height = raw->height;
+        for (int i = 0; i < 3; i++) {
+            source.planes[i] = raw->planes[i];
+            source.strides[i] = raw->strides[i];
+        }
+        source.timestamp = raw->timestamp;
+        source.received_us = raw->received_us;
+        source.latency_stamp = raw->latency_stamp;
+        this->ingest(source, is_planar(raw->format) ? this->target_format_for(raw->format) : raw->format);
+        this->pending_pool.release(raw);
+    }
+
+    if (pool != nullptr && this->pending.load(std::memory_order_acquire) != nullptr) {
+        // More work already, but let other streams go first
+        pool->schedule(this);
+    } else {
+        this->release_producer();
+    }
+    this->active_workers--;
+}
+
+bool Renderer::fit_to_display(int* width, int* height) {
+    int display_w = this->display_width.load(std::memory_order_relaxed);
+    int display_h = this->display_height.load(std::memory_order_relaxed);
+    if (display_w <= 0 || display_h <= 0 || (display_w >= *width && display_h >= *height)) {
+        return false;
+    }
+
+    double scale = std::min(display_w / static_cast<double>(*width), display_h / static_cast<double>(*height));
+    // Round up to a multiple of 16 so resizing the window does not reallocate on every pixel
+    int w = (static_cast<int>(ceil(*width * scale)) + 15) & ~15;
+    // Below 2x the texture filter does as well for free, scaling on the CPU
+    // would only cost more than the smaller upload saves
+    if (w * 2 > *width) {
+        return false;
+    }
+    int h = (static_cast<int>(lround(w * static_cast<double>(*height) / *width)) + 1) & ~1;
+    *width = w;
+    *height = std::max(h, 2);
+    return true;
+}
+
+uint8_t* Renderer::scratch(size_t size) {
+    if (this->scratch_memory.size() < size) {
+        this->scratch_memory.resize(size);
+    }
+    return this->scratch_memory.data();
+}
+
+void Renderer::ingest(const SourceFrame& source, enum otc_video_frame_format target_format) {
+    bool planar = is_planar(source.format);
+    int width = source.width;
+    int height = source.height;
+    if (planar && this->settings->downscale) {
+        this->fit_to_display(&width, &height);
+    }
+    bool scaled = width != source.width || height != source.height;
+    if (scaled && target_format == OTC_VIDEO_FRAME_FORMAT_NV12) {
+        // Scaling works on separate planes, so scaled NV12 comes out as I420
+        target_format = OTC_VIDEO_FRAME_FORMAT_YUV420P;
+    }
+
+    // The back slot is only ever touched by this thread, give its buffer
+    // back first so a steady stream keeps cycling through the same ones
+    bool paced = this->settings->jitter_depth > 0;
+    VideoBuffer* back;
+    if (paced) {
+        back = this->pool.acquire(target_format, width, height);
+    } else {
+        VideoBuffer*& slot = this->frames.back();
+        this->pool.release(slot);
+        back = slot = this->pool.acquire(target_format, width, height);
+    }
+
+    if (planar && (scaled || target_format == OTC_VIDEO_FRAME_FORMAT_ARGB32)) {
+        TraceSpan span("convert", this->trace_stream);
+        this->convert_planar(source, back);
+    } else {
+        TraceSpan span("copy", this->trace_stream);
+        for (int i = 0; i < back->plane_count; i++) {
+            copy_plane(source.planes[i], source.strides[i],
+                       back->planes[i], back->strides[i],
+                       back->plane_widths[i] * back->bytes_per_pixel(i),
+                       back->plane_heights[i]);
+        }
+    }
+    back->timestamp = source.timestamp;
+    back->received_us = source.received_us;
+    back->latency_stamp = source.latency_stamp;
+    back->sequence = ++this->next_sequence;
+
+    if (paced) {
+        if (!this->pacer.push(back)) {
+            this->pool.release(back);
+            this->frames_dropped++;
+        }
+    } else if (this->frames.publish()) {
+        this->frames_dropped++;
+    }
+    if (this->settings->frame_ready != nullptr) {
+        this->settings->frame_ready();
+    }
+}
+
+void Renderer::convert_planar(const SourceFrame& source, VideoBuffer* target) {
+    bool nv12 = source.format == OTC_VIDEO_FRAME_FORMAT_NV12;
+    bool scaled = target->width != source.width || target->height != source.height;
+    YuvMatrix matrix = yuv_matrix(this->settings);
+
+    if (!scaled) {
+        // Straight conversion into the pooled BGRA buffer
+        if (nv12) {
+            nv12_to_bgra(source.planes[0], source.strides[0], source.planes[1], source.strides[1],
+                         target->planes[0], target->strides[0], target->width, target->height, matrix);
+        } else {
+            i420_to_bgra(source.planes[0], source.strides[0], source.planes[1], source.strides[1],
+                         source.planes[2], source.strides[2],
+                         target->planes[0], target->strides[0], target->width, target->height, matrix);
+        }
+        return;
+    }
+
+    int chroma_w = (source.width + 1) / 2;
+    int chroma_h = (source.height + 1) / 2;
+    int target_chroma_w = (target->width + 1) / 2;
+    int target_chroma_h = (target->height + 1) / 2;
+    bool argb = target->format == OTC_VIDEO_FRAME_FORMAT_ARGB32;
+
+    size_t split_size = nv12 ? 2 * static_cast<size_t>(chroma_w) * chroma_h : 0;
+    size_t planes_size = argb
+        ? static_cast<size_t>(target->width) * target->height + 2 * static_cast<size_t>(target_chroma_w) * target_chroma_h
+        : 0;
+    // fit_to_display() only scales by 2x or more, so the planes are box
+    // filtered first and bilinear only covers what is left
+    size_t kernel_size = scale_plane_scratch_size(source.width, source.height, target->width);
+    uint8_t* memory = this->scratch(split_size + planes_size + kernel_size);
+    uint8_t* kernel_scratch = memory + split_size + planes_size;
+
+    const uint8_t* u = source.planes[1];
+    const uint8_t* v = source.planes[2];
+    int u_stride = source.strides[1];
+    int v_stride = source.strides[2];
+    if (nv12) {
+        uint8_t* split = memory;
+        split_uv_plane(source.planes[1], source.strides[1],
+                       split, chroma_w, split + chroma_w * chroma_h, chroma_w, chroma_w, chroma_h);
+        u = split;
+        v = split + chroma_w * chroma_h;
+        u_stride = v_stride = chroma_w;
+    }
+
+    uint8_t* scaled_planes[3];
+    int scaled_strides[3];
+    if (argb) {
+        scaled_planes[0] = memory + split_size;
+        scaled_planes[1] = scaled_planes[0] + target->width * target->height;
+        scaled_planes[2] = scaled_planes[1] + target_chroma_w * target_chroma_h;
+        scaled_strides[0] = target->width;
+        scaled_strides[1] = scaled_strides[2] = target_chroma_w;
+    } else {
+        for (int i = 0; i < 3; i++) {
+            scaled_planes[i] = target->planes[i];
+            scaled_strides[i] = target->strides[i];
+        }
+    }
+
+    scale_plane(source.planes[0], source.strides[0], source.width, source.height,
+                scaled_planes[0], scaled_strides[0], target->width, target->height, kernel_scratch);
+    scale_plane(u, u_stride, chroma_w, chroma_h,
+                scaled_planes[1], scaled_strides[1], target_chroma_w, target_chroma_h, kernel_scratch);
+    scale_plane(v, v_stride, chroma_w, chroma_h,
+                scaled_planes[2], scaled_strides[2], target_chroma_w, target_chroma_h, kernel_scratch);
+
+    if (argb) {
+        i420_to_bgra(scaled_planes[0], scaled_strides[0], scaled_planes[1], scaled_strides[1],
+                     scaled_planes[2], scaled_strides[2],
+                     target->planes[0], target->strides[0], target->width, target->height, matrix);
     }
-    this->last_frame = otc_video_frame_convert(OTC_VIDEO_FRAME_FORMAT_ARGB32, frame);
-    this->mutex.unlock();
 }
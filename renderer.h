@@ -1,19 +1,191 @@
 #include <opentok.h>
+#include <atomic>
+#include <stdint.h>
 #include <string>
-#include <mutex>
+#include <vector>
 
 #include <GL/glew.h>
 
+#include "frame_pacer.h"
+#include "frame_pool.h"
+#include "gl_garbage.h"
+#include "texture_uploader.h"
+#include "triple_buffer.h"
+#include "yuv_converter.h"
+
+class ConversionPool;
+class LatencyProbe;
+class Recorder;
+
+enum class RenderMode { ARGB = 0, YUV_SHADER = 1 };
+
+/**
+ * Rendering options shared by every renderer. They are edited from the UI
+ * and read from the SDK threads delivering frames.
+ */
+struct RendererSettings {
+    std::atomic<int> mode;
+    std::atomic<int> color_space;
+    std::atomic<int> color_range;
+    // Scale incoming frames down to the size they are shown at
+    std::atomic<bool> downscale;
+    // Hand conversion and scaling to conversion_pool instead of doing it on the SDK thread
+    std::atomic<bool> use_conversion_pool;
+    // Cleared before the pool goes away, while frames may still be arriving
+    std::atomic<ConversionPool*> conversion_pool;
+    // Frames of delay in each stream's presentation queue, 0 shows frames as soon as they arrive
+    std::atomic<int> jitter_depth;
+    // Called from whichever thread produced a frame, once it can be rendered
+    void (*frame_ready)();
+    // Textures are filled by an UploadThread, render() only draws them. Fixed at startup.
+    bool upload_thread;
+    // Set to read latency stamps off incoming frames and report them when shown. Fixed at startup.
+    LatencyProbe* latency_probe;
+    // Recordings bypass the page cache when the filesystem allows it. Fixed at startup.
+    bool record_direct_io;
+
+    RendererSettings() : mode(static_cast<int>(RenderMode::YUV_SHADER)),
+                         color_space(static_cast<int>(ColorSpace::BT601)),
+                         color_range(static_cast<int>(ColorRange::LIMITED)),
+                         downscale(true), use_conversion_pool(true), conversion_pool(nullptr),
+                         jitter_depth(0), frame_ready(nullptr), upload_thread(false),
+                         latency_probe(nullptr), record_direct_io(false) {}
+};
+
+/**
+ * Planes of an incoming frame, owned by whoever delivered it.
+ */
+struct SourceFrame {
+    enum otc_video_frame_format format;
+    int width;
+    int height;
+    const uint8_t* planes[3];
+    int strides[3];
+    int64_t timestamp;
+    int64_t received_us;
+    int64_t latency_stamp;
+};
+
 class Renderer {
 public:
-    Renderer(const std::string name);
+    Renderer(const std::string name, const RendererSettings* settings, YuvConverter* yuv_converter);
+    ~Renderer();
 
-    void render();
+    // next_swap_us is when the frame being built will reach the screen, see FramePacer::now_us()
+    void render(int64_t next_swap_us);
     void set_frame(const otc_video_frame* frame);
+    // Same as set_frame() for frames that do not come from the SDK, in
+    // YUV420P, NV12 or 32 bit RGB. The planes only need to stay valid
+    // during the call.
+    void set_planes(const SourceFrame& frame);
+
+    // Called by ConversionPool workers for the frame left by set_frame()
+    void convert_pending(ConversionPool* pool);
+
+    // True once no thread is converting or queued for this renderer. Only
+    // meaningful after set_frame() can no longer be called.
+    bool is_idle() const;
+    // Hands the GL objects over to garbage instead of deleting them one by one
+    void release_gl(GlGarbage* garbage);
+
+    // Upload thread only, with its own GL context current. Uploads and
+    // converts the newest frame into the next output texture, returns false
+    // if there was nothing new.
+    bool upload_to_output(YuvConverter* converter, int64_t next_swap_us);
+
+    // Main thread only. Records incoming frames to record-<name>-<time>.y4m.
+    void start_recording();
+    void stop_recording();
+
+    static int live_count() { return renderers_alive.load(); }
+    static int live_textures() { return textures_alive.load(); }
 
 private:
-    otc_video_frame* last_frame;
+    /**
+     * A finished RGBA texture handed from the upload thread to the UI.
+     * ready_fence is set by the upload thread when it is filled,
+     * consumer_fence by the UI when it stops showing it.
+     */
+    struct OutputTexture {
+        GLuint texture;
+        int width;
+        int height;
+        int allocated_width;
+        int allocated_height;
+        GLsync ready_fence;
+        GLsync consumer_fence;
+        int64_t latency_stamp;
+    };
+
+    const VideoBuffer* next_frame(int64_t next_swap_us, int depth);
+    void render_output(int depth);
+    void draw_window(GLuint texture, int w, int h, int depth, uint64_t uploads, uint64_t stalls);
+    void upload_packed(const VideoBuffer* frame);
+    void upload_yuv(const VideoBuffer* frame, int w, int h);
+    void convert_yuv(const VideoBuffer* frame, int w, int h);
+    void upload_plane(const VideoBuffer* frame, int index);
+
+    enum otc_video_frame_format target_format_for(enum otc_video_frame_format format);
+    void deliver(const SourceFrame& source, enum otc_video_frame_format target_format);
+    void ingest(const SourceFrame& source, enum otc_video_frame_format target_format);
+    void queue_pending(const SourceFrame& source);
+    bool claim_producer();
+    void release_producer();
+    bool fit_to_display(int* width, int* height);
+    void convert_planar(const SourceFrame& source, VideoBuffer* target);
+    uint8_t* scratch(size_t size);
+
+    // Written by the SDK thread in set_frame(), read by render() without locking.
+    // Whoever holds producer_busy (the SDK thread or a conversion worker) is
+    // the only one allowed to touch the producer side of frames.
+    std::atomic<bool> producer_busy;
+    // Latest raw frame waiting for a conversion worker, newer frames replace it
+    std::atomic<VideoBuffer*> pending;
+    // Workers inside convert_pending(), which may touch us after giving up producer_busy
+    std::atomic<int> active_workers;
+    FramePool pending_pool;
+    FramePool pool;
+    TripleBuffer<VideoBuffer*> frames;
+    // Used instead of frames while jitter_depth is set
+    FramePacer pacer;
+    std::atomic<uint64_t> frames_received;
+    std::atomic<uint64_t> frames_dropped;
+    uint64_t next_sequence;
+    std::vector<uint8_t> scratch_memory;
     std::string name;
-    std::mutex mutex;
+    uint16_t trace_stream;
     GLuint image_texture;
+
+    const RendererSettings* settings;
+    YuvConverter* yuv_converter;
+    // Plane 0 also holds the BGRA pixels in ARGB mode
+    TextureUploader plane_uploaders[3];
+    GLuint display_texture;
+    int image_width;
+    int image_height;
+
+    // What is currently in the textures, so render() only uploads new frames
+    uint64_t uploaded_sequence;
+    int uploaded_width;
+    int uploaded_height;
+    int converted_color_space;
+    int converted_color_range;
+    uint64_t uploads_saved;
+
+    // Size the image took on screen last frame, read by the SDK thread
+    std::atomic<int> display_width;
+    std::atomic<int> display_height;
+
+    // Set while recording. set_frame() counts itself in recorder_users while
+    // it uses the recorder, so stop_recording() knows when it may go.
+    std::atomic<Recorder*> recorder;
+    std::atomic<int> recorder_users;
+
+    // Only used with an upload thread
+    TripleBuffer<OutputTexture> outputs;
+    std::atomic<uint64_t> thread_uploads;
+    std::atomic<uint64_t> thread_stalls;
+
+    static std::atomic<int> renderers_alive;
+    static std::atomic<int> textures_alive;
 };
@@ -0,0 +1,262 @@
+#include "replay_source.h"
+#include "frame_pacer.h"
+#include "log.h"
+#include "renderer.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Frame headers are short, anything longer means this is not a Y4M file
+static const size_t MAX_HEADER = 256;
+
+ReplaySource::ReplaySource(const Settings& settings, StreamRegistry* registry)
+    : settings(settings), registry(registry), handle(StreamRegistry::INVALID_HANDLE), mapping(nullptr),
+      mapping_size(0), frame_width(0), frame_height(0), frame_size(0), running(false), frames_sent(0), loops(0),
+      frames_late(0), frames_per_second_x100(0) {}
+
+ReplaySource::~ReplaySource() {
+    if (this->running.exchange(false)) {
+        this->thread.join();
+    }
+    if (this->handle != StreamRegistry::INVALID_HANDLE) {
+        this->registry->remove(this->handle);
+    }
+    if (this->mapping != nullptr) {
+        munmap(const_cast<uint8_t*>(this->mapping), this->mapping_size);
+    }
+}
+
+bool ReplaySource::start() {
+    const char* path = this->settings.path.c_str();
+    int file = open(path, O_RDONLY);
+    if (file < 0) {
+        LOG_ERROR("Could not open %s for replay", path);
+        return false;
+    }
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size == 0) {
+        LOG_ERROR("Nothing to replay in %s", path);
+        close(file);
+        return false;
+    }
+    void* memory = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    // The mapping keeps the file open on its own
+    close(file);
+    if (memory == MAP_FAILED) {
+        LOG_ERROR("Could not map %s", path);
+        return false;
+    }
+    this->mapping = static_cast<const uint8_t*>(memory);
+    this->mapping_size = info.st_size;
+
+    // Indexing only touches frame headers, read-ahead would pull in the whole file
+    madvise(memory, this->mapping_size, MADV_RANDOM);
+    bool y4m = this->mapping_size > 10 && memcmp(this->mapping, "YUV4MPEG2 ", 10) == 0;
+    if (!(y4m ? this->parse_y4m() : this->parse_raw()) || this->index.empty()) {
+        return false;
+    }
+    madvise(memory, this->mapping_size, MADV_SEQUENTIAL);
+
+    const char* slash = strrchr(path, '/');
+    std::string name = std::string("replay-") + (slash != nullptr ? slash + 1 : path);
+    this->handle = this->registry->add(name.substr(0, StreamRegistry::MAX_NAME - 1).c_str());
+    LOG_INFO("Replaying %zu frames of %dx%d from %s%s", this->index.size(), this->frame_width,
+             this->frame_height, path, this->settings.fast ? " as fast as possible" : "");
+
+    this->running.store(true);
+    this->thread = std::thread(&ReplaySource::run, this);
+    return true;
+}
+
+bool ReplaySource::parse_y4m() {
+    const char* data = reinterpret_cast<const char*>(this->mapping);
+    const char* end = static_cast<const char*>(memchr(data, '\n', min(this->mapping_size, MAX_HEADER)));
+    if (end == nullptr) {
+        LOG_ERROR("Y4M header of %s is cut short", this->settings.path.c_str());
+        return false;
+    }
+    std::string header(data, end);
+    int rate_num = 30, rate_den = 1;
+    size_t position = 0;
+    while (position < header.size()) {
+        size_t next = header.find(' ', position);
+        if (next == std::string::npos) {
+            next = header.size();
+        }
+        std::string token = header.substr(position, next - position);
+        position = next + 1;
+        if (token.empty()) {
+            continue;
+        }
+        const char* value = token.c_str() + 1;
+        switch (token[0]) {
+        case 'W': this->frame_width = atoi(value); break;
+        case 'H': this->frame_height = atoi(value); break;
+        case 'F': sscanf(value, "%d:%d", &rate_num, &rate_den); break;
+        case 'C':
+            // 420, 420jpeg, 420mpeg2 and 420paldv only differ in chroma siting
+            if (strncmp(value, "420", 3) != 0) {
+                LOG_ERROR("Only 4:2:0 Y4M files replay, %s is C%s", this->settings.path.c_str(), value);
+                return false;
+            }
+            break;
+        }
+    }
+    if (this->frame_width <= 0 || this->frame_height <= 0 || rate_num <= 0 || rate_den <= 0) {
+        LOG_ERROR("Bad Y4M header in %s", this->settings.path.c_str());
+        return false;
+    }
+    int chroma_width = (this->frame_width + 1) / 2;
+    int chroma_height = (this->frame_height + 1) / 2;
+    this->frame_size = static_cast<size_t>(this->frame_width) * this->frame_height +
+                       2 * static_cast<size_t>(chroma_width) * chroma_height;
+
+    size_t offset = end - data + 1;
+    while (offset + 5 <= this->mapping_size && memcmp(data + offset, "FRAME", 5) == 0) {
+        const char* line = data + offset;
+        const char* line_end = static_cast<const char*>(memchr(line, '\n', min(this->mapping_size - offset, MAX_HEADER)));
+        if (line_end == nullptr) {
+            break;
+        }
+        Frame frame;
+        frame.offset = line_end - data + 1;
+        if (frame.offset + this->frame_size > this->mapping_size) {
+            // A recording that was cut off mid frame
+            break;
+        }
+        // Recordings carry the SDK timestamp, anything else gets the nominal rate
+        std::string parameters(line, line_end);
+        size_t xts = parameters.find(" XTS=");
+        frame.timestamp = xts != std::string::npos
+            ? strtoll(parameters.c_str() + xts + 5, nullptr, 10)
+            : static_cast<int64_t>(this->index.size()) * 1000000 * rate_den / rate_num;
+        this->index.push_back(frame);
+        offset = frame.offset + this->frame_size;
+    }
+    return true;
+}
+
+bool ReplaySource::parse_raw() {
+    if (this->settings.width <= 0 || this->settings.height <= 0 || this->settings.fps <= 0) {
+        LOG_ERROR("%s is not Y4M, raw I420 needs --replay-size WIDTHxHEIGHT@FPS", this->settings.path.c_str());
+        return false;
+    }
+    this->frame_width = this->settings.width;
+    this->frame_height = this->settings.height;
+    int chroma_width = (this->frame_width + 1) / 2;
+    int chroma_height = (this->frame_height + 1) / 2;
+    this->frame_size = static_cast<size_t>(this->frame_width) * this->frame_height +
+                       2 * static_cast<size_t>(chroma_width) * chroma_height;
+    size_t count = this->mapping_size / this->frame_size;
+    for (size_t i = 0; i < count; i++) {
+        Frame frame;
+        frame.offset = i * this->frame_size;
+        frame.timestamp = static_cast<int64_t>(i) * 1000000 / this->settings.fps;
+        this->index.push_back(frame);
+    }
+    return true;
+}
+
+ReplaySource::Stats ReplaySource::stats() const {
+    Stats stats;
+    stats.frames = this->frames_sent;
+    stats.loops = this->loops;
+    stats.late = this->frames_late;
+    stats.fps = this->frames_per_second_x100 / 100.0;
+    stats.megabytes_per_second = stats.fps * this->frame_size / 1e6;
+    return stats;
+}
+
+void ReplaySource::run() {
+    Trace::set_thread_name("replay");
+    // Frames only count once the main loop has created the renderer
+    while (this->running.load()) {
+        StreamRegistry::Reference renderer(this->registry, this->handle);
+        if (renderer) {
+            break;
+        }
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+
+    int width = this->frame_width;
+    int height = this->frame_height;
+    int chroma_width = (width + 1) / 2;
+    size_t luma_size = static_cast<size_t>(width) * height;
+    size_t chroma_size = static_cast<size_t>(chroma_width) * ((height + 1) / 2);
+
+    // Timestamps keep increasing across loops, one frame interval apart
+    int64_t first = this->index.front().timestamp;
+    int64_t last = this->index.back().timestamp;
+    int64_t interval = this->index.size() > 1 ? (last - first) / static_cast<int64_t>(this->index.size() - 1) : 33333;
+    int64_t loop_offset = 0;
+    int64_t start_us = FramePacer::now_us();
+    int64_t window_start_us = start_us;
+    uint64_t window_frames = 0;
+
+    size_t next = 0;
+    while (this->running.load()) {
+        if (next == this->index.size()) {
+            if (!this->settings.loop) {
+                break;
+            }
+            next = 0;
+            loop_offset += last - first + interval;
+            this->loops++;
+        }
+        const Frame& frame = this->index[next++];
+        int64_t timestamp = frame.timestamp - first + loop_offset;
+
+        if (!this->settings.fast) {
+            int64_t due_us = start_us + timestamp;
+            int64_t now = FramePacer::now_us();
+            if (due_us > now) {
+                this_thread::sleep_for(chrono::microseconds(due_us - now));
+            } else if (now - due_us > 20000) {
+                this->frames_late++;
+                if (now - due_us > 500000) {
+                    // Stalled, carry on from here rather than rushing to catch up
+                    start_us += now - due_us;
+                }
+            }
+        }
+
+        SourceFrame planes;
+        planes.format = OTC_VIDEO_FRAME_FORMAT_YUV420P;
+        planes.width = width;
+        planes.height = height;
+        planes.planes[0] = this->mapping + frame.offset;
+        planes.planes[1] = planes.planes[0] + luma_size;
+        planes.planes[2] = planes.planes[1] + chroma_size;
+        planes.strides[0] = width;
+        planes.strides[1] = planes.strides[2] = chroma_width;
+        planes.timestamp = frame.timestamp + loop_offset;
+        planes.received_us = 0;
+        planes.latency_stamp = -1;
+        {
+            StreamRegistry::Reference renderer(this->registry, this->handle);
+            if (!renderer) {
+                break;
+            }
+            renderer->set_planes(planes);
+        }
+        this->frames_sent++;
+
+        window_frames++;
+        int64_t now = FramePacer::now_us();
+        if (now - window_start_us >= 1000000) {
+            this->frames_per_second_x100 = window_frames * 100000000 / (now - window_start_us);
+            window_start_us = now;
+            window_frames = 0;
+        }
+    }
+    this->frames_per_second_x100 = 0;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "stream_registry.h"
+
+/**
+ * Plays a Y4M file (see Recorder) or raw I420 back as a stream of its own,
+ * for a workload that is the same on every run.
+ *
+ * The file is mapped read only with sequential read-ahead and frames go to
+ * Renderer::set_planes() straight from the mapping, so replay costs no
+ * copies and little I/O beyond what the renderer itself does. Frames go
+ * out at their recorded timestamps, or back to back with fast set.
+ */
+class ReplaySource {
+public:
+    struct Settings {
+        std::string path;
+        // Back to back instead of at the recorded pace
+        bool fast;
+        // Start over at the end of the file instead of stopping
+        bool loop;
+        // Raw files only, Y4M files carry their own
+        int width;
+        int height;
+        int fps;
+    };
+
+    struct Stats {
+        uint64_t frames;
+        uint64_t loops;
+        // Over the last second
+        double fps;
+        double megabytes_per_second;
+        // Frames that went out later than their timestamp asked for
+        uint64_t late;
+    };
+
+    ReplaySource(const Settings& settings, StreamRegistry* registry);
+    ~ReplaySource();
+
+    // Maps and indexes the file, then starts playing. False if the file is
+    // missing or not a format we play.
+    bool start();
+
+    Stats stats() const;
+    int width() const { return this->frame_width; }
+    int height() const { return this->frame_height; }
+    size_t frame_count() const { return this->index.size(); }
+
+private:
+    struct Frame {
+        size_t offset;
+        int64_t timestamp;
+    };
+
+    bool parse_y4m();
+    bool parse_raw();
+    void run();
+
+    Settings settings;
+    StreamRegistry* registry;
+    StreamRegistry::Handle handle;
+
+    const uint8_t* mapping;
+    size_t mapping_size;
+    int frame_width;
+    int frame_height;
+    size_t frame_size;
+    std::vector<Frame> index;
+
+    std::atomic<bool> running;
+    std::thread thread;
+    std::atomic<uint64_t> frames_sent;
+    std::atomic<uint64_t> loops;
+    std::atomic<uint64_t> frames_late;
+    std::atomic<uint64_t> frames_per_second_x100;
+};
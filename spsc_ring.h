@@ -0,0 +1,69 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * Bounded lock-free single producer / single consumer ring of plain
+ * values, moved in runs rather than one at a time.
+ *
+ * Each side owns one counter and only reads the other's, so neither ever
+ * waits. Counters run freely and are masked on use, which keeps a full
+ * ring apart from an empty one without wasting a slot. All storage lives
+ * in the object, nothing is allocated after construction.
+ */
+template <typename T, size_t Capacity>
+class SpscRing {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    SpscRing() : write_position(0), read_position(0) {}
+
+    // Producer only. Copies as many of count values as fit, returns how many.
+    size_t write(const T* values, size_t count) {
+        size_t position = this->write_position.load(std::memory_order_relaxed);
+        size_t used = position - this->read_position.load(std::memory_order_acquire);
+        count = std::min(count, Capacity - used);
+        size_t start = position & MASK;
+        size_t first = std::min(count, Capacity - start);
+        memcpy(this->values + start, values, first * sizeof(T));
+        memcpy(this->values, values + first, (count - first) * sizeof(T));
+        this->write_position.store(position + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer only. Takes up to count values, returns how many.
+    size_t read(T* values, size_t count) {
+        size_t position = this->read_position.load(std::memory_order_relaxed);
+        size_t used = this->write_position.load(std::memory_order_acquire) - position;
+        count = std::min(count, used);
+        size_t start = position & MASK;
+        size_t first = std::min(count, Capacity - start);
+        memcpy(values, this->values + start, first * sizeof(T));
+        memcpy(values + first, this->values, (count - first) * sizeof(T));
+        this->read_position.store(position + count, std::memory_order_release);
+        return count;
+    }
+
+    // Either side, a snapshot that may be stale by the time it is used
+    size_t size() const {
+        return this->write_position.load(std::memory_order_acquire) -
+               this->read_position.load(std::memory_order_acquire);
+    }
+
+    static size_t capacity() { return Capacity; }
+
+private:
+    static const size_t MASK = Capacity - 1;
+
+    T values[Capacity];
+    // Producer and consumer each get their own cache line. Padding rather
+    // than alignas, so rings can live in heap allocated objects.
+    char padding_before[64];
+    std::atomic<size_t> write_position;
+    char padding_between[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> read_position;
+    char padding_after[64 - sizeof(std::atomic<size_t>)];
+};
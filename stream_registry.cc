@@ -0,0 +1,179 @@
+#include "stream_registry.h"
+#include "log.h"
+
+#include <string.h>
+
+using namespace std;
+
+StreamRegistry::Reference::Reference(StreamRegistry* registry, Handle handle)
+    : registry(registry), index(registry->pin(handle, false)), renderer(nullptr) {
+    if (this->index >= 0) {
+        this->renderer = registry->slots[this->index].renderer.load();
+    }
+}
+
+StreamRegistry::Reference::~Reference() {
+    if (this->index >= 0) {
+        this->registry->unpin(this->index);
+    }
+}
+
+StreamRegistry::StreamRegistry() {
+    for (int i = 0; i < CAPACITY; i++) {
+        Slot& slot = this->slots[i];
+        slot.state.store(EMPTY);
+        slot.generation.store(1);
+        slot.readers.store(0);
+        slot.renderer.store(nullptr);
+        slot.hash = 0;
+        slot.name[0] = '\0';
+    }
+    for (int i = 0; i < INDEX_SIZE; i++) {
+        this->index[i].store(INDEX_EMPTY);
+    }
+}
+
+uint64_t StreamRegistry::hash_name(const char* name) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (; *name != '\0'; name++) {
+        hash = (hash ^ static_cast<uint8_t>(*name)) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+StreamRegistry::Handle StreamRegistry::make_handle(int index, uint32_t generation) {
+    return (static_cast<Handle>(generation) << 32) | static_cast<uint32_t>(index);
+}
+
+int StreamRegistry::pin(Handle handle, bool pending_ok) {
+    uint32_t index = static_cast<uint32_t>(handle);
+    if (handle == INVALID_HANDLE || index >= CAPACITY) {
+        return -1;
+    }
+    Slot& slot = this->slots[index];
+    // Pin first, then check: collect() marks slots dead before looking at
+    // the reader count, so either it sees us or we see it.
+    slot.readers.fetch_add(1);
+    uint32_t state = slot.state.load();
+    bool usable = state == LIVE || (pending_ok && state == PENDING);
+    if (!usable || slot.generation.load() != static_cast<uint32_t>(handle >> 32)) {
+        slot.readers.fetch_sub(1);
+        return -1;
+    }
+    return static_cast<int>(index);
+}
+
+void StreamRegistry::unpin(int index) {
+    this->slots[index].readers.fetch_sub(1);
+}
+
+int StreamRegistry::find_slot(const char* name, uint64_t hash) {
+    for (int probe = 0; probe < INDEX_SIZE; probe++) {
+        uint32_t entry = this->index[(hash + probe) % INDEX_SIZE].load();
+        if (entry == INDEX_EMPTY) {
+            return -1;
+        }
+        if (entry == INDEX_REMOVED) {
+            continue;
+        }
+        int candidate = static_cast<int>(entry - 1);
+        Slot& slot = this->slots[candidate];
+        slot.readers.fetch_add(1);
+        uint32_t state = slot.state.load();
+        bool found = (state == PENDING || state == LIVE) && slot.hash == hash && strcmp(slot.name, name) == 0;
+        slot.readers.fetch_sub(1);
+        if (found) {
+            return candidate;
+        }
+    }
+    return -1;
+}
+
+StreamRegistry::Handle StreamRegistry::find(const char* name) {
+    int found = this->find_slot(name, hash_name(name));
+    return found < 0 ? INVALID_HANDLE : make_handle(found, this->slots[found].generation.load());
+}
+
+StreamRegistry::Handle StreamRegistry::add(const char* name) {
+    lock_guard<mutex> lock(this->write_mutex);
+    uint64_t hash = hash_name(name);
+    int existing = this->find_slot(name, hash);
+    if (existing >= 0) {
+        return make_handle(existing, this->slots[existing].generation.load());
+    }
+
+    int free_slot = -1;
+    for (int i = 0; i < CAPACITY && free_slot < 0; i++) {
+        if (this->slots[i].state.load() == EMPTY) {
+            free_slot = i;
+        }
+    }
+    if (free_slot < 0) {
+        LOG_WARNING("Stream registry full, not rendering %s", name);
+        return INVALID_HANDLE;
+    }
+
+    // Nobody reads an empty slot's name, so it can be written before publishing the state
+    Slot& slot = this->slots[free_slot];
+    strncpy(slot.name, name, MAX_NAME - 1);
+    slot.name[MAX_NAME - 1] = '\0';
+    slot.hash = hash;
+    slot.renderer.store(nullptr);
+    slot.state.store(PENDING);
+
+    for (int probe = 0; probe < INDEX_SIZE; probe++) {
+        std::atomic<uint32_t>& entry = this->index[(hash + probe) % INDEX_SIZE];
+        uint32_t value = entry.load();
+        if (value == INDEX_EMPTY || value == INDEX_REMOVED) {
+            entry.store(free_slot + 1);
+            break;
+        }
+    }
+    return make_handle(free_slot, slot.generation.load());
+}
+
+void StreamRegistry::remove(Handle handle) {
+    lock_guard<mutex> lock(this->write_mutex);
+    int found = this->pin(handle, true);
+    if (found < 0) {
+        return;
+    }
+    Slot& slot = this->slots[found];
+    slot.state.store(DEAD);
+    for (int probe = 0; probe < INDEX_SIZE; probe++) {
+        std::atomic<uint32_t>& entry = this->index[(slot.hash + probe) % INDEX_SIZE];
+        uint32_t value = entry.load();
+        if (value == INDEX_EMPTY) {
+            break;
+        }
+        if (value == static_cast<uint32_t>(found + 1)) {
+            entry.store(INDEX_REMOVED);
+            break;
+        }
+    }
+    this->unpin(found);
+}
+
+void StreamRegistry::remove_all() {
+    for (int i = 0; i < CAPACITY; i++) {
+        Slot& slot = this->slots[i];
+        uint32_t state = slot.state.load();
+        if (state == PENDING || state == LIVE) {
+            this->remove(make_handle(i, slot.generation.load()));
+        }
+    }
+}
+
+StreamRegistry::Stats StreamRegistry::stats() {
+    Stats stats = { 0, 0, 0 };
+    for (int i = 0; i < CAPACITY; i++) {
+        switch (this->slots[i].state.load()) {
+        case PENDING: stats.pending++; break;
+        case LIVE: stats.live++; break;
+        case DEAD: stats.dead++; break;
+        default: break;
+        }
+    }
+    return stats;
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+
+class Renderer;
+
+/**
+ * Fixed capacity slot map of every stream we render, keyed by stream ID.
+ *
+ * Streams are added and removed from SDK threads, looked up from the frame
+ * callbacks and iterated by the main loop. Handles combine a slot index
+ * with the slot's generation, so a stale handle never reaches a newer
+ * stream that reused the slot.
+ *
+ * Reads never lock. A reader pins a slot by bumping its reader count and
+ * then checks the slot is still live; removal only marks a slot dead and
+ * the main loop frees it in collect() once no reader holds it. Adding and
+ * removing take a mutex, they happen a few times per session.
+ *
+ * The registry never deletes a Renderer on its own, collect() hands them
+ * to the caller, which knows when GL objects can go.
+ */
+class StreamRegistry {
+public:
+    typedef uint64_t Handle;
+    static const Handle INVALID_HANDLE = 0;
+    static const int CAPACITY = 512;
+    static const int MAX_NAME = 128;
+
+    enum State : uint32_t {
+        EMPTY = 0,
+        // Added, waiting for the main loop to create its Renderer
+        PENDING,
+        LIVE,
+        // Removed, freed once no reader holds it
+        DEAD,
+    };
+
+    struct Stats {
+        int pending;
+        int live;
+        int dead;
+    };
+
+    /**
+     * Pins a live stream for as long as it is in scope.
+     */
+    class Reference {
+    public:
+        Reference(StreamRegistry* registry, Handle handle);
+        ~Reference();
+
+        explicit operator bool() const { return this->renderer != nullptr; }
+        Renderer* operator->() const { return this->renderer; }
+        Renderer* get() const { return this->renderer; }
+
+    private:
+        Reference(const Reference&);
+        Reference& operator=(const Reference&);
+
+        StreamRegistry* registry;
+        int index;
+        Renderer* renderer;
+    };
+
+    StreamRegistry();
+
+    // Slot a valid handle points at, for per-stream arrays of CAPACITY entries
+    static int slot_index(Handle handle) { return static_cast<int>(static_cast<uint32_t>(handle)); }
+
+    // Any thread. Returns the existing handle if the name is already registered.
+    Handle add(const char* name);
+    // Any thread. Marks the stream dead, collect() frees it later.
+    void remove(Handle handle);
+    void remove_all();
+    // Any thread, lock free
+    Handle find(const char* name);
+
+    // Main thread only. Creates renderers for pending streams.
+    template <typename F>
+    void activate_pending(F create) {
+        for (int i = 0; i < CAPACITY; i++) {
+            Slot& slot = this->slots[i];
+            if (slot.state.load() == PENDING) {
+                slot.renderer.store(create(slot.name));
+                uint32_t expected = PENDING;
+                slot.state.compare_exchange_strong(expected, LIVE);
+            }
+        }
+    }
+
+    // Main thread only, in slot order so windows keep a stable order
+    template <typename F>
+    void for_each_live(F visit) {
+        for (int i = 0; i < CAPACITY; i++) {
+            Slot& slot = this->slots[i];
+            if (slot.state.load() == LIVE) {
+                visit(slot.renderer.load());
+            }
+        }
+    }
+
+    // Any thread. Pins each live stream while visit(Renderer*) runs on it.
+    template <typename F>
+    void visit_live(F visit) {
+        for (int i = 0; i < CAPACITY; i++) {
+            Slot& slot = this->slots[i];
+            if (slot.state.load() != LIVE) {
+                continue;
+            }
+            Reference reference(this, make_handle(i, slot.generation.load()));
+            if (reference) {
+                visit(reference.get());
+            }
+        }
+    }
+
+    // Main thread only. Offers every dead stream no reader holds anymore to
+    // retire(Renderer*), which returns false if it cannot be freed yet. Returns
+    // how many slots were freed.
+    template <typename F>
+    int collect(F retire) {
+        int freed = 0;
+        for (int i = 0; i < CAPACITY; i++) {
+            Slot& slot = this->slots[i];
+            if (slot.state.load() != DEAD || slot.readers.load() != 0) {
+                continue;
+            }
+            Renderer* renderer = slot.renderer.load();
+            if (renderer != nullptr && !retire(renderer)) {
+                continue;
+            }
+            slot.renderer.store(nullptr);
+            // Outdates every handle to this stream before the slot can be reused
+            slot.generation.fetch_add(1);
+            slot.state.store(EMPTY);
+            freed++;
+        }
+        return freed;
+    }
+
+    Stats stats();
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> state;
+        std::atomic<uint32_t> generation;
+        std::atomic<uint32_t> readers;
+        std::atomic<Renderer*> renderer;
+        uint64_t hash;
+        char name[MAX_NAME];
+    };
+
+    // Open addressed index from name hash to slot, twice the capacity so probes stay short
+    static const int INDEX_SIZE = CAPACITY * 2;
+    static const uint32_t INDEX_EMPTY = 0;
+    static const uint32_t INDEX_REMOVED = 0xffffffff;
+
+    static uint64_t hash_name(const char* name);
+    static Handle make_handle(int index, uint32_t generation);
+    // Returns the slot index if the handle is current and the slot pinned, -1 otherwise
+    int pin(Handle handle, bool pending_ok);
+    void unpin(int index);
+    int find_slot(const char* name, uint64_t hash);
+
+    Slot slots[CAPACITY];
+    std::atomic<uint32_t> index[INDEX_SIZE];
+    std::mutex write_mutex;
+};
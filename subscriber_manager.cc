@@ -0,0 +1,209 @@
+#include "subscriber_manager.h"
+#include "imgui.h"
+#include "log.h"
+
+#include <algorithm>
+
+using namespace std;
+
+SubscriberManager::SubscriberManager()
+    : positions(StreamRegistry::CAPACITY, -1), auto_subscribe(false), max_video(0), next_policy_us(0) {
+    for (int i = 0; i < StreamRegistry::CAPACITY; i++) {
+        this->audio_levels[i].store(0.0f);
+    }
+}
+
+void SubscriberManager::add(otc_session* session, StreamRegistry::Handle handle, const char* stream_id,
+                            otc_subscriber* subscriber) {
+    if (subscriber == nullptr) {
+        return;
+    }
+    if (handle == StreamRegistry::INVALID_HANDLE) {
+        // The registry is full, nowhere to render it
+        otc_subscriber_delete(subscriber);
+        return;
+    }
+    int slot = StreamRegistry::slot_index(handle);
+    this->audio_levels[slot].store(0.0f);
+
+    Entry entry;
+    entry.handle = handle;
+    entry.subscriber = subscriber;
+    entry.stream_id = stream_id;
+    entry.subscribed = false;
+    entry.want_audio = true;
+    entry.want_video = true;
+    entry.video_on = true;
+    entry.speaking = 0.0f;
+    this->positions[slot] = static_cast<int>(this->entries.size());
+    this->entries.push_back(entry);
+
+    if (this->auto_subscribe) {
+        this->subscribe(session, this->entries.back(), true);
+        this->apply_policy();
+    }
+}
+
+void SubscriberManager::subscriber_failed(StreamRegistry::Handle handle) {
+    int position = this->positions[StreamRegistry::slot_index(handle)];
+    if (position >= 0 && this->entries[position].handle == handle) {
+        this->entries[position].subscribed = false;
+        // Its video slot goes to the next loudest stream
+        this->apply_policy();
+    }
+}
+
+void SubscriberManager::remove(otc_session* session, StreamRegistry::Handle handle) {
+    int slot = StreamRegistry::slot_index(handle);
+    int position = this->positions[slot];
+    if (position < 0 || this->entries[position].handle != handle) {
+        return;
+    }
+    // Deleting a subscriber that is still subscribed is not allowed
+    this->subscribe(session, this->entries[position], false);
+    otc_subscriber_delete(this->entries[position].subscriber);
+    this->positions[slot] = -1;
+
+    // Order does not matter, move the last entry into the hole
+    if (position != this->size() - 1) {
+        this->entries[position] = this->entries.back();
+        this->positions[StreamRegistry::slot_index(this->entries[position].handle)] = position;
+    }
+    this->entries.pop_back();
+}
+
+void SubscriberManager::clear(otc_session* session, StreamRegistry* registry) {
+    for (Entry& entry : this->entries) {
+        this->subscribe(session, entry, false);
+        otc_subscriber_delete(entry.subscriber);
+        registry->remove(entry.handle);
+        this->positions[StreamRegistry::slot_index(entry.handle)] = -1;
+    }
+    this->entries.clear();
+}
+
+void SubscriberManager::set_audio_level(StreamRegistry::Handle handle, float level) {
+    this->audio_levels[StreamRegistry::slot_index(handle)].store(level, std::memory_order_relaxed);
+}
+
+void SubscriberManager::subscribe(otc_session* session, Entry& entry, bool subscribe) {
+    if (subscribe == entry.subscribed || session == nullptr) {
+        return;
+    }
+    if (subscribe) {
+        LOG_INFO("Subscribing to %s", entry.stream_id.c_str());
+        if (otc_session_subscribe(session, entry.subscriber) != OTC_SUCCESS) {
+            return;
+        }
+        // A new subscription starts with both audio and video
+        entry.video_on = true;
+        if (!entry.want_audio) {
+            otc_subscriber_set_subscribe_to_audio(entry.subscriber, OTC_FALSE);
+        }
+    } else {
+        LOG_INFO("Unsubscribing from %s", entry.stream_id.c_str());
+        otc_session_unsubscribe(session, entry.subscriber);
+    }
+    entry.subscribed = subscribe;
+}
+
+void SubscriberManager::set_video(Entry& entry, bool on) {
+    if (entry.video_on != on) {
+        otc_subscriber_set_subscribe_to_video(entry.subscriber, on ? OTC_TRUE : OTC_FALSE);
+        entry.video_on = on;
+    }
+}
+
+void SubscriberManager::apply_policy() {
+    vector<Entry*> candidates;
+    for (Entry& entry : this->entries) {
+        if (!entry.subscribed) {
+            continue;
+        }
+        if (entry.want_video && this->max_video > 0) {
+            candidates.push_back(&entry);
+        } else {
+            this->set_video(entry, entry.want_video);
+        }
+    }
+    if (candidates.empty()) {
+        return;
+    }
+
+    // Loudest first, streams that already have video get a small head
+    // start so two similar speakers do not keep swapping
+    std::sort(candidates.begin(), candidates.end(), [](const Entry* a, const Entry* b) {
+        return a->speaking + (a->video_on ? 0.05f : 0.0f) > b->speaking + (b->video_on ? 0.05f : 0.0f);
+    });
+    for (size_t i = 0; i < candidates.size(); i++) {
+        this->set_video(*candidates[i], static_cast<int>(i) < this->max_video);
+    }
+}
+
+void SubscriberManager::update(int64_t now_us) {
+    if (now_us < this->next_policy_us) {
+        return;
+    }
+    this->next_policy_us = now_us + POLICY_INTERVAL_US;
+
+    for (Entry& entry : this->entries) {
+        // Rises immediately, fades over a couple of seconds
+        float level = this->audio_levels[StreamRegistry::slot_index(entry.handle)].load(std::memory_order_relaxed);
+        entry.speaking = std::max(level, entry.speaking * 0.7f);
+    }
+    this->apply_policy();
+}
+
+void SubscriberManager::draw(otc_session* session) {
+    ImGui::Begin("Subscribers");
+    ImGui::Checkbox("Subscribe automatically", &this->auto_subscribe);
+    if (ImGui::SliderInt("Max video streams", &this->max_video, 0, 64, this->max_video == 0 ? "No limit" : "%d")) {
+        this->apply_policy();
+    }
+    bool subscribe_all = ImGui::Button("Subscribe all");
+    ImGui::SameLine();
+    bool unsubscribe_all = ImGui::Button("Unsubscribe all");
+    if (subscribe_all || unsubscribe_all) {
+        for (Entry& entry : this->entries) {
+            this->subscribe(session, entry, subscribe_all);
+        }
+        this->apply_policy();
+    }
+    ImGui::Text("Streams: %d", this->size());
+    ImGui::Separator();
+
+    bool changed = false;
+    ImGui::BeginChild("streams");
+    ImGuiListClipper clipper(this->size());
+    while (clipper.Step()) {
+        for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+            Entry& entry = this->entries[i];
+            ImGui::PushID(i);
+            if (ImGui::SmallButton(entry.subscribed ? "Unsubscribe" : "Subscribe")) {
+                this->subscribe(session, entry, !entry.subscribed);
+                changed = true;
+            }
+            ImGui::SameLine();
+            if (ImGui::Checkbox("Audio", &entry.want_audio) && entry.subscribed) {
+                otc_subscriber_set_subscribe_to_audio(entry.subscriber, entry.want_audio ? OTC_TRUE : OTC_FALSE);
+            }
+            ImGui::SameLine();
+            changed |= ImGui::Checkbox("Video", &entry.want_video);
+            ImGui::SameLine();
+            ImGui::ProgressBar(entry.speaking, ImVec2(60, 0), "");
+            ImGui::SameLine();
+            if (entry.subscribed && entry.want_video && !entry.video_on) {
+                ImGui::TextDisabled("%s (audio only)", entry.stream_id.c_str());
+            } else {
+                ImGui::TextUnformatted(entry.stream_id.c_str());
+            }
+            ImGui::PopID();
+        }
+    }
+    ImGui::EndChild();
+    ImGui::End();
+
+    if (changed) {
+        this->apply_policy();
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <opentok.h>
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "stream_registry.h"
+
+/**
+ * Every remote stream in the session and what we do with it: subscribed
+ * or not, audio and video wanted or not.
+ *
+ * With a video limit set, only the streams that spoke most recently get
+ * video, the rest keep audio only. Audio levels arrive on SDK threads and
+ * are only stored; the policy runs on the main thread twice a second, and
+ * the stream list only draws the rows on screen, so idle streams cost
+ * close to nothing per frame.
+ */
+class SubscriberManager {
+public:
+    SubscriberManager();
+
+    // Main thread only, the subscriber was created for the stream behind handle
+    void add(otc_session* session, StreamRegistry::Handle handle, const char* stream_id, otc_subscriber* subscriber);
+    void subscriber_failed(StreamRegistry::Handle handle);
+    // Unsubscribes and deletes the stream's subscriber, the stream is gone
+    void remove(otc_session* session, StreamRegistry::Handle handle);
+    // Unsubscribes and deletes every subscriber and removes their streams, e.g. after the session disconnected
+    void clear(otc_session* session, StreamRegistry* registry);
+
+    // Any thread
+    void set_audio_level(StreamRegistry::Handle handle, float level);
+
+    // Main thread only, once per frame
+    void update(int64_t now_us);
+    void draw(otc_session* session);
+
+    int size() const { return static_cast<int>(this->entries.size()); }
+
+private:
+    struct Entry {
+        StreamRegistry::Handle handle;
+        otc_subscriber* subscriber;
+        std::string stream_id;
+        bool subscribed;
+        bool want_audio;
+        bool want_video;
+        // What the SDK was last told
+        bool video_on;
+        float speaking;
+    };
+
+    static const int64_t POLICY_INTERVAL_US = 500000;
+
+    void subscribe(otc_session* session, Entry& entry, bool subscribe);
+    void set_video(Entry& entry, bool on);
+    void apply_policy();
+
+    std::vector<Entry> entries;
+    // Position in entries by registry slot, -1 for streams we do not know
+    std::vector<int> positions;
+    std::atomic<float> audio_levels[StreamRegistry::CAPACITY];
+
+    bool auto_subscribe;
+    // 0 means no limit
+    int max_video;
+    int64_t next_policy_us;
+};
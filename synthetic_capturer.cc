@@ -0,0 +1,190 @@
+#include "synthetic_capturer.h"
+#include "frame_pacer.h"
+#include "latency_stamp.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+using namespace std;
+
+SyntheticCapturer::SyntheticCapturer(const Settings& settings)
+    : capturer(nullptr), capture_settings(settings), gradient(nullptr), noise_state(0x9e3779b97f4a7c15ULL),
+      running(false), frames_sent(0), frames_late(0), last_draw_us(0) {
+    memset(&this->capturer_callbacks, 0, sizeof(this->capturer_callbacks));
+    this->capturer_callbacks.init = on_init;
+    this->capturer_callbacks.destroy = on_destroy;
+    this->capturer_callbacks.start = on_start;
+    this->capturer_callbacks.stop = on_stop;
+    this->capturer_callbacks.get_capture_settings = on_get_capture_settings;
+    this->capturer_callbacks.user_data = this;
+
+    int width = settings.width;
+    int height = settings.height;
+    int chroma_width = (width + 1) / 2;
+    int chroma_height = (height + 1) / 2;
+    size_t luma_size = static_cast<size_t>(width) * height;
+    size_t chroma_size = static_cast<size_t>(chroma_width) * chroma_height;
+
+    // Chroma never changes: blue to red across, green to purple down
+    for (int i = 0; i < RING_SIZE; i++) {
+        vector<uint8_t>& image = this->images[i];
+        image.resize(luma_size + 2 * chroma_size);
+        uint8_t* u = image.data() + luma_size;
+        uint8_t* v = u + chroma_size;
+        for (int row = 0; row < chroma_height; row++) {
+            for (int x = 0; x < chroma_width; x++) {
+                u[row * chroma_width + x] = static_cast<uint8_t>(64 + 128 * x / chroma_width);
+                v[row * chroma_width + x] = static_cast<uint8_t>(64 + 128 * row / chroma_height);
+            }
+        }
+        // Not shallow copyable, the SDK copies what it keeps since we redraw the image
+        this->ring[i] = otc_video_frame_new_contiguous_memory_wrapper(OTC_VIDEO_FRAME_FORMAT_YUV420P, width, height,
+                                                                      OTC_FALSE, image.data(), image.size());
+    }
+
+    int period = 2 * (width + height);
+    this->gradient = new uint8_t[period + width];
+    for (int i = 0; i < period + width; i++) {
+        // Up and down again, so scrolling never shows a seam
+        int phase = i % period;
+        int ramp = phase < period / 2 ? phase : period - phase;
+        this->gradient[i] = static_cast<uint8_t>(16 + 219 * ramp / (period / 2));
+    }
+}
+
+SyntheticCapturer::~SyntheticCapturer() {
+    this->stop();
+    for (int i = 0; i < RING_SIZE; i++) {
+        if (this->ring[i] != nullptr) {
+            otc_video_frame_delete(this->ring[i]);
+        }
+    }
+    delete[] this->gradient;
+}
+
+bool SyntheticCapturer::parse_mode(const char* mode, Settings* settings) {
+    int width, height, fps;
+    if (sscanf(mode, "%dx%d@%d", &width, &height, &fps) != 3 || width < 16 || height < 16 || fps < 1 || fps > 1000) {
+        return false;
+    }
+    // Even sizes keep the chroma planes exact
+    settings->width = width & ~1;
+    settings->height = height & ~1;
+    settings->fps = fps;
+    return true;
+}
+
+SyntheticCapturer::Stats SyntheticCapturer::stats() const {
+    Stats stats;
+    stats.frames = this->frames_sent;
+    stats.late = this->frames_late;
+    stats.last_draw_us = this->last_draw_us;
+    return stats;
+}
+
+otc_bool SyntheticCapturer::on_init(const otc_video_capturer* capturer, void* user_data) {
+    static_cast<SyntheticCapturer*>(user_data)->capturer = capturer;
+    return OTC_TRUE;
+}
+
+otc_bool SyntheticCapturer::on_destroy(const otc_video_capturer* capturer, void* user_data) {
+    SyntheticCapturer* self = static_cast<SyntheticCapturer*>(user_data);
+    self->stop();
+    self->capturer = nullptr;
+    return OTC_TRUE;
+}
+
+otc_bool SyntheticCapturer::on_start(const otc_video_capturer* capturer, void* user_data) {
+    SyntheticCapturer* self = static_cast<SyntheticCapturer*>(user_data);
+    if (!self->running.exchange(true)) {
+        self->thread = std::thread(&SyntheticCapturer::run, self);
+    }
+    return OTC_TRUE;
+}
+
+otc_bool SyntheticCapturer::on_stop(const otc_video_capturer* capturer, void* user_data) {
+    static_cast<SyntheticCapturer*>(user_data)->stop();
+    return OTC_TRUE;
+}
+
+otc_bool SyntheticCapturer::on_get_capture_settings(const otc_video_capturer* capturer, void* user_data,
+                                                    otc_video_capturer_settings* settings) {
+    SyntheticCapturer* self = static_cast<SyntheticCapturer*>(user_data);
+    settings->format = OTC_VIDEO_FRAME_FORMAT_YUV420P;
+    settings->width = self->capture_settings.width;
+    settings->height = self->capture_settings.height;
+    settings->fps = self->capture_settings.fps;
+    settings->expected_delay = 0;
+    settings->mirror_on_local_render = OTC_FALSE;
+    return OTC_TRUE;
+}
+
+void SyntheticCapturer::stop() {
+    if (this->running.exchange(false)) {
+        this->thread.join();
+    }
+}
+
+void SyntheticCapturer::draw(uint8_t* y, uint64_t n) {
+    int width = this->capture_settings.width;
+    int height = this->capture_settings.height;
+    int stride = width;
+
+    if (this->capture_settings.pattern == NOISE) {
+        uint64_t state = this->noise_state;
+        for (int row = 0; row < height; row++) {
+            uint8_t* line = y + row * stride;
+            for (int x = 0; x < width; x += 8) {
+                // xorshift64
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                memcpy(line + x, &state, min(8, width - x));
+            }
+        }
+        this->noise_state = state;
+    } else {
+        int period = 2 * (width + height);
+        for (int row = 0; row < height; row++) {
+            memcpy(y + row * stride, this->gradient + (row + n) % period, width);
+        }
+    }
+
+    if (this->capture_settings.stamp) {
+        latency_stamp_write(y, stride, width, height, static_cast<uint32_t>(FramePacer::now_us()));
+    }
+}
+
+void SyntheticCapturer::run() {
+    Trace::set_thread_name("synthetic capturer");
+    int64_t interval_us = 1000000 / this->capture_settings.fps;
+    int64_t next_us = FramePacer::now_us();
+    for (uint64_t n = 0; this->running.load(); n++) {
+        otc_video_frame* frame = this->ring[n % RING_SIZE];
+        if (frame == nullptr || this->capturer == nullptr) {
+            break;
+        }
+        int64_t start = FramePacer::now_us();
+        {
+            TraceSpan span("capture");
+            this->draw(this->images[n % RING_SIZE].data(), n);
+            otc_video_frame_set_timestamp(frame, FramePacer::now_us());
+            otc_video_capturer_provide_frame(this->capturer, 0, frame);
+        }
+        this->frames_sent++;
+        int64_t now = FramePacer::now_us();
+        this->last_draw_us = now - start;
+
+        next_us += interval_us;
+        if (next_us <= now) {
+            // Behind, skip the ticks that passed rather than bursting to catch up
+            this->frames_late++;
+            next_us = now + interval_us;
+        }
+        this_thread::sleep_for(chrono::microseconds(next_us - now));
+    }
+}
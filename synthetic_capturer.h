@@ -0,0 +1,84 @@
+#pragma once
+
+#include <opentok.h>
+
+#include <atomic>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+/**
+ * Publisher video source that needs no camera: test patterns at any size
+ * and rate, for load testing the publish path and the local preview.
+ *
+ * Frames come from a ring of images allocated once, each wrapped by an SDK
+ * frame; each tick redraws the oldest image in place, so nothing is
+ * allocated per frame. With stamps
+ * on, every frame carries its capture time for the latency probe (see
+ * latency_stamp.h).
+ */
+class SyntheticCapturer {
+public:
+    enum Pattern {
+        // Diagonal gradient scrolling one pixel per frame
+        GRADIENT,
+        // New random luma every frame, the worst case for an encoder
+        NOISE,
+    };
+
+    struct Settings {
+        int width;
+        int height;
+        int fps;
+        Pattern pattern;
+        bool stamp;
+    };
+
+    struct Stats {
+        uint64_t frames;
+        // Ticks that were already due when the previous frame was done
+        uint64_t late;
+        int64_t last_draw_us;
+    };
+
+    explicit SyntheticCapturer(const Settings& settings);
+    ~SyntheticCapturer();
+
+    // Valid for as long as the capturer, pass to otc_publisher_new()
+    const otc_video_capturer_callbacks* callbacks() const { return &this->capturer_callbacks; }
+
+    const Settings& settings() const { return this->capture_settings; }
+    Stats stats() const;
+
+    // Parses WIDTHxHEIGHT@FPS, e.g. 1920x1080@60
+    static bool parse_mode(const char* mode, Settings* settings);
+
+private:
+    static const int RING_SIZE = 3;
+
+    static otc_bool on_init(const otc_video_capturer* capturer, void* user_data);
+    static otc_bool on_destroy(const otc_video_capturer* capturer, void* user_data);
+    static otc_bool on_start(const otc_video_capturer* capturer, void* user_data);
+    static otc_bool on_stop(const otc_video_capturer* capturer, void* user_data);
+    static otc_bool on_get_capture_settings(const otc_video_capturer* capturer, void* user_data,
+                                            otc_video_capturer_settings* settings);
+
+    void run();
+    void stop();
+    void draw(uint8_t* y, uint64_t n);
+
+    otc_video_capturer_callbacks capturer_callbacks;
+    const otc_video_capturer* capturer;
+    Settings capture_settings;
+    // I420 images, each wrapped by the frame of the same index
+    std::vector<uint8_t> images[RING_SIZE];
+    otc_video_frame* ring[RING_SIZE];
+    // Luma of one scrolling gradient row, long enough for any offset
+    uint8_t* gradient;
+    uint64_t noise_state;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> frames_sent;
+    std::atomic<uint64_t> frames_late;
+    std::atomic<int64_t> last_draw_us;
+    std::thread thread;
+};
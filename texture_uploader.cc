@@ -0,0 +1,166 @@
+#include "texture_uploader.h"
+
+#include <algorithm>
+#include <string.h>
+
+std::atomic<int> TextureUploader::textures_alive(0);
+std::atomic<int> TextureUploader::buffers_alive(0);
+
+// How long we are willing to block on a busy PBO before giving up on it
+static const GLuint64 FENCE_TIMEOUT_NS = 1000000000;
+
+static void init_texture_parameters() {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+TextureUploader::TextureUploader() : texture_id(0), width(0), height(0), internal_format(0), next_slot(0) {
+    memset(&this->upload_stats, 0, sizeof(this->upload_stats));
+
+    GLuint buffers[RING_SIZE];
+    glGenBuffers(RING_SIZE, buffers);
+    for (int i = 0; i < RING_SIZE; i++) {
+        this->ring[i].buffer = buffers[i];
+        this->ring[i].size = 0;
+        this->ring[i].fence = nullptr;
+    }
+
+    glGenTextures(1, &this->texture_id);
+    glBindTexture(GL_TEXTURE_2D, this->texture_id);
+    init_texture_parameters();
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    textures_alive++;
+    buffers_alive += RING_SIZE;
+}
+
+TextureUploader::~TextureUploader() {
+    if (this->texture_id == 0) {
+        // Already handed over by release()
+        return;
+    }
+    GLuint buffers[RING_SIZE];
+    for (int i = 0; i < RING_SIZE; i++) {
+        if (this->ring[i].fence != nullptr) {
+            glDeleteSync(this->ring[i].fence);
+        }
+        buffers[i] = this->ring[i].buffer;
+    }
+    glDeleteBuffers(RING_SIZE, buffers);
+    glDeleteTextures(1, &this->texture_id);
+    textures_alive--;
+    buffers_alive -= RING_SIZE;
+}
+
+void TextureUploader::release(GlGarbage* garbage) {
+    if (this->texture_id == 0) {
+        return;
+    }
+    for (int i = 0; i < RING_SIZE; i++) {
+        if (this->ring[i].fence != nullptr) {
+            garbage->fences.push_back(this->ring[i].fence);
+            this->ring[i].fence = nullptr;
+        }
+        garbage->buffers.push_back(this->ring[i].buffer);
+        this->ring[i].buffer = 0;
+    }
+    garbage->textures.push_back(this->texture_id);
+    this->texture_id = 0;
+    textures_alive--;
+    buffers_alive -= RING_SIZE;
+}
+
+void TextureUploader::allocate_storage(int width, int height, GLenum internal_format) {
+    if (GLEW_ARB_texture_storage) {
+        // Immutable storage cannot be respecified, a new texture object is needed
+        glDeleteTextures(1, &this->texture_id);
+        glGenTextures(1, &this->texture_id);
+        glBindTexture(GL_TEXTURE_2D, this->texture_id);
+        init_texture_parameters();
+        glTexStorage2D(GL_TEXTURE_2D, 1, internal_format, width, height);
+    } else {
+        glBindTexture(GL_TEXTURE_2D, this->texture_id);
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0,
+                     internal_format == GL_RG8 ? GL_RG : (internal_format == GL_R8 ? GL_RED : GL_RGBA),
+                     GL_UNSIGNED_BYTE, nullptr);
+    }
+    this->width = width;
+    this->height = height;
+    this->internal_format = internal_format;
+    this->upload_stats.reallocations++;
+}
+
+bool TextureUploader::wait_for(Slot& slot) {
+    if (slot.fence == nullptr) {
+        return true;
+    }
+    GLenum result = glClientWaitSync(slot.fence, 0, 0);
+    if (result == GL_TIMEOUT_EXPIRED) {
+        this->upload_stats.stalls++;
+        result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+    }
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+    return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+}
+
+void TextureUploader::upload(const uint8_t* pixels, int stride, int width, int height, int bytes_per_pixel,
+                             GLenum internal_format, GLenum format, GLenum type) {
+    if (width != this->width || height != this->height || internal_format != this->internal_format) {
+        this->allocate_storage(width, height, internal_format);
+    }
+
+    Slot& slot = this->ring[this->next_slot];
+    this->next_slot = (this->next_slot + 1) % RING_SIZE;
+
+    bool has_sync = GLEW_ARB_sync;
+    bool idle = has_sync && this->wait_for(slot);
+
+    int row_size = width * bytes_per_pixel;
+    GLsizeiptr size = static_cast<GLsizeiptr>(row_size) * height;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+    if (slot.size < size || (has_sync && !idle)) {
+        // Still read by the GPU after the timeout, so take fresh storage
+        // rather than write under it
+        slot.size = std::max(slot.size, size);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, slot.size, nullptr, GL_STREAM_DRAW);
+    }
+
+    // With fences we know the buffer is idle, without them let the driver orphan it
+    GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+    if (has_sync) {
+        access |= GL_MAP_UNSYNCHRONIZED_BIT;
+    }
+    uint8_t* mapped = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, access));
+
+    glBindTexture(GL_TEXTURE_2D, this->texture_id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    if (mapped != nullptr) {
+        if (stride == row_size) {
+            memcpy(mapped, pixels, size);
+        } else {
+            for (int y = 0; y < height; y++) {
+                memcpy(mapped + y * row_size, pixels + y * stride, row_size);
+            }
+        }
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, type, nullptr);
+    } else {
+        // Mapping failed, fall back to a plain client memory upload
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, stride / bytes_per_pixel);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, type, pixels);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
+
+    if (has_sync && mapped != nullptr) {
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    this->upload_stats.uploads++;
+}
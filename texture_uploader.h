@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+#include "gl_garbage.h"
+
+/**
+ * Streams pixels into a texture through a ring of pixel buffer objects.
+ * Texture storage is allocated once per size/format (immutable when
+ * ARB_texture_storage is available) and every upload goes through
+ * glTexSubImage2D from a PBO, so the copy into GL memory does not stall
+ * the calling thread unless the driver is still reading the next buffer
+ * of the ring. All methods must be called with the GL context current.
+ */
+class TextureUploader {
+public:
+    static const int RING_SIZE = 3;
+
+    struct Stats {
+        uint64_t uploads;
+        // Times the next PBO of the ring was still in use and we had to wait for it
+        uint64_t stalls;
+        uint64_t reallocations;
+    };
+
+    TextureUploader();
+    ~TextureUploader();
+
+    // stride is in bytes. internal_format/format/type are the usual glTexImage2D ones.
+    void upload(const uint8_t* pixels, int stride, int width, int height, int bytes_per_pixel,
+                GLenum internal_format, GLenum format, GLenum type);
+
+    GLuint texture() const { return this->texture_id; }
+    const Stats& stats() const { return this->upload_stats; }
+
+    // Hands every GL object over to garbage, the uploader is unusable afterwards
+    void release(GlGarbage* garbage);
+
+    // Across all uploaders, for leak checks
+    static int live_textures() { return textures_alive.load(); }
+    static int live_buffers() { return buffers_alive.load(); }
+
+private:
+    struct Slot {
+        GLuint buffer;
+        GLsizeiptr size;
+        GLsync fence;
+    };
+
+    void allocate_storage(int width, int height, GLenum internal_format);
+    // False if the GPU may still be reading the slot's buffer
+    bool wait_for(Slot& slot);
+
+    GLuint texture_id;
+    int width;
+    int height;
+    GLenum internal_format;
+    Slot ring[RING_SIZE];
+    int next_slot;
+    Stats upload_stats;
+
+    static std::atomic<int> textures_alive;
+    static std::atomic<int> buffers_alive;
+};
@@ -0,0 +1,363 @@
+#include "trace.h"
+#include "frame_pacer.h"
+#include "log.h"
+
+#include <atomic>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+enum EventKind : uint8_t {
+    COMPLETE,
+    ASYNC,
+};
+
+struct Event {
+    int64_t start_us;
+    int64_t duration_us;
+    const char* name;
+    uint32_t id;
+    uint16_t stream;
+    uint8_t kind;
+};
+
+/**
+ * One thread's events. Only the owner appends; dump() reads the first
+ * count events, which the owner never touches again until the next
+ * start() outdates them. Once the owner exits, the buffer waits in
+ * free_buffers for a new thread, which takes it over after a start().
+ */
+struct ThreadBuffer {
+    static const uint32_t CAPACITY = 1 << 16;
+
+    std::atomic<Event*> events;
+    std::atomic<uint32_t> count;
+    // Recording generation the events belong to
+    std::atomic<uint32_t> generation;
+    uint32_t next_id;
+    int thread;
+    char name[32];
+    ThreadBuffer* next;
+};
+
+struct StreamName {
+    string name;
+    // Renderers holding the id. Unused names are dropped at start(), after
+    // which nothing recorded can refer to them anymore.
+    int users;
+};
+
+/**
+ * Hands the thread's buffer back when the thread exits.
+ */
+struct ThreadRegistration {
+    ThreadBuffer* buffer;
+    ~ThreadRegistration();
+};
+
+// Guards everything below except the event counts
+std::mutex buffers_mutex;
+ThreadBuffer* buffers = nullptr;
+vector<ThreadBuffer*> free_buffers;
+int next_thread = 1;
+vector<StreamName> streams(1, StreamName{ "", 1 });
+
+std::atomic<bool> enabled(false);
+std::atomic<uint32_t> generation(1);
+std::atomic<uint64_t> dropped_events(0);
+
+thread_local ThreadRegistration registration = { nullptr };
+// Set once registration is gone, spans in later thread_local destructors are not recorded
+thread_local bool thread_exited = false;
+
+ThreadRegistration::~ThreadRegistration() {
+    thread_exited = true;
+    if (this->buffer != nullptr) {
+        lock_guard<mutex> lock(buffers_mutex);
+        free_buffers.push_back(this->buffer);
+    }
+}
+
+ThreadBuffer* thread_buffer() {
+    // Threads come and go with the SDK. Their buffers stay for the next dump,
+    // then go to the threads that come after them.
+    ThreadBuffer* buffer = registration.buffer;
+    if (buffer != nullptr || thread_exited) {
+        return buffer;
+    }
+    uint32_t current = generation.load();
+    lock_guard<mutex> lock(buffers_mutex);
+    for (size_t i = 0; i < free_buffers.size(); i++) {
+        if (free_buffers[i]->generation.load(memory_order_relaxed) != current) {
+            buffer = free_buffers[i];
+            free_buffers.erase(free_buffers.begin() + i);
+            break;
+        }
+    }
+    if (buffer == nullptr) {
+        buffer = new ThreadBuffer();
+        buffer->events.store(nullptr);
+        buffer->count.store(0);
+        buffer->generation.store(0);
+        buffer->next = buffers;
+        buffers = buffer;
+    }
+    buffer->next_id = 0;
+    buffer->name[0] = '\0';
+    buffer->thread = next_thread++;
+    registration.buffer = buffer;
+    return buffer;
+}
+
+void record(EventKind kind, const char* name, uint16_t stream, int64_t start_us, int64_t end_us) {
+    ThreadBuffer* buffer = thread_buffer();
+    if (buffer == nullptr) {
+        return;
+    }
+    uint32_t current = generation.load(memory_order_acquire);
+    if (buffer->generation.load(memory_order_relaxed) != current) {
+        buffer->count.store(0, memory_order_relaxed);
+        buffer->generation.store(current, memory_order_release);
+    }
+    Event* events = buffer->events.load(memory_order_relaxed);
+    if (events == nullptr) {
+        events = new Event[ThreadBuffer::CAPACITY];
+        buffer->events.store(events, memory_order_release);
+    }
+    uint32_t count = buffer->count.load(memory_order_relaxed);
+    if (count == ThreadBuffer::CAPACITY) {
+        dropped_events++;
+        return;
+    }
+    Event& event = events[count];
+    event.start_us = start_us;
+    event.duration_us = end_us - start_us;
+    event.name = name;
+    event.id = buffer->next_id++;
+    event.stream = stream;
+    event.kind = kind;
+    buffer->count.store(count + 1, memory_order_release);
+}
+
+void append_escaped(string& json, const char* text) {
+    for (; *text != '\0'; text++) {
+        char c = *text;
+        if (c == '"' || c == '\\') {
+            json.push_back('\\');
+            json.push_back(c);
+        } else if (static_cast<unsigned char>(c) >= 0x20) {
+            json.push_back(c);
+        }
+    }
+}
+
+}
+
+void Trace::start() {
+    {
+        lock_guard<mutex> lock(buffers_mutex);
+        for (size_t i = 1; i < streams.size(); i++) {
+            if (streams[i].users == 0) {
+                streams[i].name.clear();
+            }
+        }
+    }
+    dropped_events.store(0);
+    generation.fetch_add(1, memory_order_acq_rel);
+    enabled.store(true);
+}
+
+void Trace::stop() {
+    enabled.store(false);
+}
+
+bool Trace::recording() {
+    return enabled.load(memory_order_relaxed);
+}
+
+uint64_t Trace::events() {
+    uint32_t current = generation.load();
+    uint64_t total = 0;
+    lock_guard<mutex> lock(buffers_mutex);
+    for (ThreadBuffer* buffer = buffers; buffer != nullptr; buffer = buffer->next) {
+        if (buffer->generation.load(memory_order_acquire) == current) {
+            total += buffer->count.load(memory_order_acquire);
+        }
+    }
+    return total;
+}
+
+uint64_t Trace::dropped() {
+    return dropped_events.load();
+}
+
+uint16_t Trace::intern(const char* stream) {
+    lock_guard<mutex> lock(buffers_mutex);
+    size_t unused = 0;
+    for (size_t i = 1; i < streams.size(); i++) {
+        if (streams[i].name == stream) {
+            streams[i].users++;
+            return static_cast<uint16_t>(i);
+        }
+        if (unused == 0 && streams[i].users == 0 && streams[i].name.empty()) {
+            unused = i;
+        }
+    }
+    if (unused == 0) {
+        if (streams.size() > MAX_STREAMS) {
+            return NO_STREAM;
+        }
+        unused = streams.size();
+        streams.push_back(StreamName{ "", 0 });
+    }
+    streams[unused].name = stream;
+    streams[unused].users = 1;
+    return static_cast<uint16_t>(unused);
+}
+
+void Trace::release(uint16_t stream) {
+    lock_guard<mutex> lock(buffers_mutex);
+    if (stream == NO_STREAM || stream >= streams.size() || streams[stream].users == 0) {
+        return;
+    }
+    // Kept for the events already recorded until the next start()
+    if (--streams[stream].users == 0 && generation.load() == 1) {
+        // Nothing was ever recorded
+        streams[stream].name.clear();
+    }
+}
+
+void Trace::set_thread_name(const char* name) {
+    ThreadBuffer* buffer = thread_buffer();
+    if (buffer == nullptr) {
+        return;
+    }
+    lock_guard<mutex> lock(buffers_mutex);
+    snprintf(buffer->name, sizeof(buffer->name), "%s", name);
+}
+
+void Trace::complete(const char* name, uint16_t stream, int64_t start_us, int64_t end_us) {
+    if (enabled.load(memory_order_relaxed)) {
+        record(COMPLETE, name, stream, start_us, end_us);
+    }
+}
+
+void Trace::async(const char* name, uint16_t stream, int64_t start_us, int64_t end_us) {
+    if (enabled.load(memory_order_relaxed)) {
+        record(ASYNC, name, stream, start_us, end_us);
+    }
+}
+
+bool Trace::dump(const char* path) {
+    // Only the list is read under the lock. The events themselves stay put:
+    // their owners never touch them again, and nobody takes over a buffer
+    // before the next start(), which runs on this thread.
+    struct Snapshot {
+        int thread;
+        char name[32];
+        const Event* events;
+        uint32_t count;
+    };
+    vector<Snapshot> snapshots;
+    vector<string> names;
+    uint32_t current = generation.load();
+    {
+        lock_guard<mutex> lock(buffers_mutex);
+        for (ThreadBuffer* buffer = buffers; buffer != nullptr; buffer = buffer->next) {
+            Snapshot snapshot;
+            snapshot.thread = buffer->thread;
+            memcpy(snapshot.name, buffer->name, sizeof(snapshot.name));
+            snapshot.events = nullptr;
+            snapshot.count = 0;
+            if (buffer->generation.load(memory_order_acquire) == current) {
+                snapshot.count = buffer->count.load(memory_order_acquire);
+                snapshot.events = buffer->events.load(memory_order_acquire);
+            }
+            snapshots.push_back(snapshot);
+        }
+        names.reserve(streams.size());
+        for (const StreamName& stream : streams) {
+            names.push_back(stream.name);
+        }
+    }
+
+    FILE* file = fopen(path, "w");
+    if (file == nullptr) {
+        LOG_ERROR("Could not write trace to %s", path);
+        return false;
+    }
+
+    string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    char line[160];
+    for (const Snapshot& buffer : snapshots) {
+        if (buffer.name[0] != '\0') {
+            json += first ? "" : ",\n";
+            first = false;
+            snprintf(line, sizeof(line), "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"",
+                     buffer.thread);
+            json += line;
+            append_escaped(json, buffer.name);
+            json += "\"}}";
+        }
+        for (uint32_t i = 0; i < buffer.count; i++) {
+            const Event& event = buffer.events[i];
+            json += first ? "" : ",\n";
+            first = false;
+            string args;
+            if (event.stream != NO_STREAM && event.stream < names.size()) {
+                args = ",\"args\":{\"stream\":\"";
+                append_escaped(args, names[event.stream].c_str());
+                args += "\"}";
+            }
+            if (event.kind == COMPLETE) {
+                snprintf(line, sizeof(line), "{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%lld,\"dur\":%lld,\"name\":\"",
+                         buffer.thread, (long long)event.start_us, (long long)event.duration_us);
+                json += line;
+                append_escaped(json, event.name);
+                json += "\"";
+            } else {
+                // Async pairs share an id, unique per thread
+                long long id = (static_cast<long long>(buffer.thread) << 32) | event.id;
+                snprintf(line, sizeof(line), "{\"ph\":\"b\",\"cat\":\"frame\",\"id\":%lld,\"pid\":1,\"tid\":%d,\"ts\":%lld,\"name\":\"",
+                         id, buffer.thread, (long long)event.start_us);
+                json += line;
+                append_escaped(json, event.name);
+                json += "\"";
+                json += args;
+                json += "},\n";
+                snprintf(line, sizeof(line), "{\"ph\":\"e\",\"cat\":\"frame\",\"id\":%lld,\"pid\":1,\"tid\":%d,\"ts\":%lld,\"name\":\"",
+                         id, buffer.thread, (long long)(event.start_us + event.duration_us));
+                json += line;
+                append_escaped(json, event.name);
+                json += "\"";
+            }
+            json += args;
+            json += "}";
+        }
+    }
+    json += "\n]}\n";
+
+    bool written = fwrite(json.data(), 1, json.size(), file) == json.size();
+    written = fclose(file) == 0 && written;
+    if (!written) {
+        LOG_ERROR("Could not write trace to %s", path);
+    }
+    return written;
+}
+
+TraceSpan::TraceSpan(const char* name, uint16_t stream)
+    : name(name), stream(stream), start_us(Trace::recording() ? FramePacer::now_us() : 0) {
+}
+
+TraceSpan::~TraceSpan() {
+    if (this->start_us != 0) {
+        Trace::complete(this->name, this->stream, this->start_us, FramePacer::now_us());
+    }
+}
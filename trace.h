@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Records where frames spend their time as Chrome trace events, to be
+ * opened in chrome://tracing or ui.perfetto.dev.
+ *
+ * Every thread records into its own buffer, nothing is shared or locked
+ * while recording, and with recording off a span costs one atomic load.
+ * Buffers have a fixed size; once one is full its thread stops recording
+ * until the next start(). Buffers of threads that exited are reused by new
+ * threads once a start() made their events obsolete.
+ */
+class Trace {
+public:
+    static const uint16_t NO_STREAM = 0;
+    static const size_t MAX_STREAMS = 4096;
+
+    // Main thread. start() drops whatever was recorded before.
+    static void start();
+    static void stop();
+    static bool recording();
+
+    // Main thread. Writes everything recorded so far as Chrome trace JSON.
+    static bool dump(const char* path);
+    static uint64_t events();
+    static uint64_t dropped();
+
+    // Any thread, not on a hot path. Returns the id spans use to tag a
+    // stream, NO_STREAM once MAX_STREAMS names are in use.
+    static uint16_t intern(const char* stream);
+    // Any thread, once the id is no longer used. Its name is dropped at the
+    // next start().
+    static void release(uint16_t stream);
+    // Any thread, shown instead of the thread number
+    static void set_thread_name(const char* name);
+
+    // Any thread. name must be a string literal, or live as long as the trace.
+    static void complete(const char* name, uint16_t stream, int64_t start_us, int64_t end_us);
+    // Like complete(), for time spans that overlap others on the same thread,
+    // e.g. a frame waiting in a queue
+    static void async(const char* name, uint16_t stream, int64_t start_us, int64_t end_us);
+};
+
+/**
+ * Records a complete event from construction to destruction.
+ */
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name, uint16_t stream = Trace::NO_STREAM);
+    ~TraceSpan();
+
+private:
+    TraceSpan(const TraceSpan&);
+    TraceSpan& operator=(const TraceSpan&);
+
+    const char* name;
+    uint16_t stream;
+    int64_t start_us;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * Wait-free single producer / single consumer handoff of the latest value.
+ *
+ * The producer fills back() and calls publish(), the consumer calls
+ * acquire() and reads front(). Each side owns one slot and the third one
+ * is exchanged through a single atomic byte, so neither side ever waits
+ * for the other. A value published and then superseded before the
+ * consumer acquired it is reported as dropped by publish().
+ */
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : slots(), shared(1), back_index(0), front_index(2) {}
+
+    // Producer side
+    T& back() { return this->slots[this->back_index]; }
+
+    // Returns true if the previously published value was never acquired
+    bool publish() {
+        uint8_t previous = this->shared.exchange(this->back_index | DIRTY, std::memory_order_acq_rel);
+        this->back_index = previous & INDEX_MASK;
+        return (previous & DIRTY) != 0;
+    }
+
+    // Consumer side
+    bool has_new() const {
+        return (this->shared.load(std::memory_order_acquire) & DIRTY) != 0;
+    }
+
+    // Makes the latest published value available in front(), returns false if there was none
+    bool acquire() {
+        if (!this->has_new()) {
+            return false;
+        }
+        uint8_t previous = this->shared.exchange(this->front_index, std::memory_order_acq_rel);
+        this->front_index = previous & INDEX_MASK;
+        return true;
+    }
+
+    T& front() { return this->slots[this->front_index]; }
+
+    // Only safe when neither side is running, e.g. for teardown
+    T& slot(int index) { return this->slots[index]; }
+
+private:
+    static const uint8_t INDEX_MASK = 0x3;
+    static const uint8_t DIRTY = 0x4;
+
+    T slots[3];
+    std::atomic<uint8_t> shared;
+    uint8_t back_index;
+    uint8_t front_index;
+};
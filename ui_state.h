@@ -6,8 +6,7 @@ public:
   bool isPublishing;
   bool showPublisherButtons;
 
-  bool isSubscribing;
-  bool showSubscriberButtons;
+  std::string lastError;
 
   UIState() : isSessionConnected(false) {};
 
@@ -18,8 +17,4 @@ public:
   const std::string publishButtonText() {
     return this->isPublishing ? "Unpublish" : "Publish";
   }
-
-  const std::string subscriberButtonText() {
-    return this->isSubscribing ? "Unsubscribe" : "Subscribe";
-  }
 };
@@ -0,0 +1,95 @@
+#include "upload_thread.h"
+#include "frame_pacer.h"
+#include "log.h"
+#include "renderer.h"
+#include "stream_registry.h"
+#include "trace.h"
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+
+using namespace std;
+
+UploadThread::UploadThread(GLFWwindow* window, const char* glsl_version, const RendererSettings* settings,
+                           StreamRegistry* registry, void (*uploaded)())
+    : window(window), glsl_version(glsl_version), settings(settings), registry(registry), uploaded(uploaded),
+      woken(false), stopping(false), converter_checked(false), converter_ok(false), next_swap_us(0), passes(0), uploads(0), last_pass_us(0) {
+    this->thread = std::thread(&UploadThread::run, this);
+    unique_lock<mutex> lock(this->wake_mutex);
+    this->wake_condition.wait(lock, [this]() { return this->converter_checked; });
+}
+
+UploadThread::~UploadThread() {
+    {
+        lock_guard<mutex> lock(this->wake_mutex);
+        this->stopping = true;
+    }
+    this->wake_condition.notify_one();
+    this->thread.join();
+}
+
+void UploadThread::wake() {
+    {
+        lock_guard<mutex> lock(this->wake_mutex);
+        this->woken = true;
+    }
+    this->wake_condition.notify_one();
+}
+
+UploadThread::Stats UploadThread::stats() const {
+    Stats stats;
+    stats.passes = this->passes;
+    stats.uploads = this->uploads;
+    stats.last_pass_us = this->last_pass_us;
+    return stats;
+}
+
+void UploadThread::run() {
+    Trace::set_thread_name("upload");
+    glfwMakeContextCurrent(this->window);
+    {
+        YuvConverter converter(this->glsl_version);
+        if (!converter.is_valid()) {
+            LOG_WARNING("Upload thread could not build its YUV shader");
+        }
+        {
+            lock_guard<mutex> lock(this->wake_mutex);
+            this->converter_checked = true;
+            this->converter_ok = converter.is_valid();
+        }
+        this->wake_condition.notify_all();
+
+        for (;;) {
+            {
+                // Paced streams have frames coming due without anything arriving
+                int timeout_ms = this->settings->jitter_depth > 0 ? 4 : 100;
+                unique_lock<mutex> lock(this->wake_mutex);
+                this->wake_condition.wait_for(lock, chrono::milliseconds(timeout_ms), [this]() {
+                    return this->woken || this->stopping;
+                });
+                if (this->stopping) {
+                    break;
+                }
+                this->woken = false;
+            }
+
+            int64_t start = FramePacer::now_us();
+            int64_t next_swap = this->next_swap_us.load();
+            uint64_t uploaded_now = 0;
+            this->registry->visit_live([&](Renderer* renderer) {
+                if (renderer->upload_to_output(&converter, next_swap)) {
+                    uploaded_now++;
+                }
+            });
+            this->passes++;
+            if (uploaded_now > 0) {
+                this->uploads += uploaded_now;
+                this->last_pass_us = FramePacer::now_us() - start;
+                this->uploaded();
+            }
+        }
+    }
+    glfwMakeContextCurrent(nullptr);
+}
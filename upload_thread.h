@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+
+struct GLFWwindow;
+class StreamRegistry;
+struct RendererSettings;
+
+/**
+ * Uploads and converts video frames for every renderer on its own thread,
+ * through a hidden GLFW window whose context shares objects with the UI
+ * window. Finished textures are handed to the UI with fences (see
+ * Renderer::upload_to_output), so UI frame time does not depend on how
+ * many streams there are or how large they are.
+ *
+ * Vertex arrays and framebuffers are not shared between contexts, so the
+ * thread has its own YuvConverter.
+ */
+class UploadThread {
+public:
+    struct Stats {
+        uint64_t passes;
+        uint64_t uploads;
+        // Duration of the last pass that uploaded something
+        int64_t last_pass_us;
+    };
+
+    // window must be created with the UI window as its share, on the main thread.
+    // uploaded is called after every pass that produced a new texture. Returns
+    // once the thread has built its YuvConverter.
+    UploadThread(GLFWwindow* window, const char* glsl_version, const RendererSettings* settings,
+                 StreamRegistry* registry, void (*uploaded)());
+    ~UploadThread();
+
+    // Any thread, a new frame arrived
+    void wake();
+    // Main thread, when the next buffer swap is expected to happen
+    void set_next_swap(int64_t next_swap_us) { this->next_swap_us.store(next_swap_us); }
+
+    Stats stats() const;
+    // False if the thread could not build its YUV shader, planar frames
+    // would never be converted then
+    bool converter_valid() const { return this->converter_ok; }
+
+private:
+    void run();
+
+    GLFWwindow* window;
+    const char* glsl_version;
+    const RendererSettings* settings;
+    StreamRegistry* registry;
+    void (*uploaded)();
+
+    std::mutex wake_mutex;
+    std::condition_variable wake_condition;
+    bool woken;
+    bool stopping;
+    bool converter_checked;
+    bool converter_ok;
+    std::atomic<int64_t> next_swap_us;
+    std::atomic<uint64_t> passes;
+    std::atomic<uint64_t> uploads;
+    std::atomic<int64_t> last_pass_us;
+    std::thread thread;
+};
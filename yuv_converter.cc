@@ -0,0 +1,198 @@
+#include "yuv_converter.h"
+#include "log.h"
+
+#include <string>
+
+using namespace std;
+
+static const char* vertex_shader_body =
+    "out vec2 uv;\n"
+    "void main() {\n"
+    "    // Fullscreen triangle, no vertex buffer needed\n"
+    "    vec2 position = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));\n"
+    "    uv = position;\n"
+    "    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);\n"
+    "}\n";
+
+static const char* fragment_shader_body =
+    "uniform sampler2D y_texture;\n"
+    "uniform sampler2D u_texture;\n"
+    "uniform sampler2D v_texture;\n"
+    "uniform int nv12;\n"
+    "uniform mat3 yuv_matrix;\n"
+    "uniform vec3 yuv_offset;\n"
+    "in vec2 uv;\n"
+    "out vec4 out_color;\n"
+    "void main() {\n"
+    "    vec3 yuv;\n"
+    "    yuv.x = texture(y_texture, uv).r;\n"
+    "    if (nv12 != 0) {\n"
+    "        yuv.yz = texture(u_texture, uv).rg;\n"
+    "    } else {\n"
+    "        yuv.y = texture(u_texture, uv).r;\n"
+    "        yuv.z = texture(v_texture, uv).r;\n"
+    "    }\n"
+    "    vec3 rgb = yuv_matrix * (yuv - yuv_offset);\n"
+    "    out_color = vec4(clamp(rgb, 0.0, 1.0), 1.0);\n"
+    "}\n";
+
+static GLuint compile_shader(GLenum type, const char* glsl_version, const char* body) {
+    string source = string(glsl_version) + "\n" + body;
+    const char* source_ptr = source.c_str();
+
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source_ptr, nullptr);
+    glCompileShader(shader);
+
+    GLint status = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status == GL_FALSE) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        LOG_ERROR("YUV shader compilation failed: %s", log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+YuvConverter::YuvConverter(const char* glsl_version) : program(0), vao(0), fbo(0) {
+    GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER, glsl_version, vertex_shader_body);
+    GLuint fragment_shader = compile_shader(GL_FRAGMENT_SHADER, glsl_version, fragment_shader_body);
+    if (vertex_shader == 0 || fragment_shader == 0) {
+        glDeleteShader(vertex_shader);
+        glDeleteShader(fragment_shader);
+        return;
+    }
+
+    GLuint linked = glCreateProgram();
+    glAttachShader(linked, vertex_shader);
+    glAttachShader(linked, fragment_shader);
+    glBindFragDataLocation(linked, 0, "out_color");
+    glLinkProgram(linked);
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+
+    GLint status = 0;
+    glGetProgramiv(linked, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE) {
+        char log[1024];
+        glGetProgramInfoLog(linked, sizeof(log), nullptr, log);
+        LOG_ERROR("YUV shader link failed: %s", log);
+        glDeleteProgram(linked);
+        return;
+    }
+
+    this->program = linked;
+    this->y_location = glGetUniformLocation(linked, "y_texture");
+    this->u_location = glGetUniformLocation(linked, "u_texture");
+    this->v_location = glGetUniformLocation(linked, "v_texture");
+    this->nv12_location = glGetUniformLocation(linked, "nv12");
+    this->matrix_location = glGetUniformLocation(linked, "yuv_matrix");
+    this->offset_location = glGetUniformLocation(linked, "yuv_offset");
+
+    glGenVertexArrays(1, &this->vao);
+    glGenFramebuffers(1, &this->fbo);
+}
+
+YuvConverter::~YuvConverter() {
+    if (this->program != 0) {
+        glDeleteProgram(this->program);
+        glDeleteVertexArrays(1, &this->vao);
+        glDeleteFramebuffers(1, &this->fbo);
+    }
+}
+
+// Column major YUV -> RGB matrix and offsets for the given standard
+static void build_matrix(ColorSpace color_space, ColorRange color_range,
+                         GLfloat* matrix, GLfloat* offset) {
+    float kr = color_space == ColorSpace::BT709 ? 0.2126f : 0.299f;
+    float kb = color_space == ColorSpace::BT709 ? 0.0722f : 0.114f;
+    float kg = 1.0f - kr - kb;
+
+    float y_scale = 1.0f;
+    float c_scale = 1.0f;
+    offset[0] = 0.0f;
+    offset[1] = offset[2] = 128.0f / 255.0f;
+    if (color_range == ColorRange::LIMITED) {
+        y_scale = 255.0f / 219.0f;
+        c_scale = 255.0f / 224.0f;
+        offset[0] = 16.0f / 255.0f;
+    }
+
+    // Y column
+    matrix[0] = y_scale;
+    matrix[1] = y_scale;
+    matrix[2] = y_scale;
+    // U column
+    matrix[3] = 0.0f;
+    matrix[4] = -c_scale * 2.0f * kb * (1.0f - kb) / kg;
+    matrix[5] = c_scale * 2.0f * (1.0f - kb);
+    // V column
+    matrix[6] = c_scale * 2.0f * (1.0f - kr);
+    matrix[7] = -c_scale * 2.0f * kr * (1.0f - kr) / kg;
+    matrix[8] = 0.0f;
+}
+
+void YuvConverter::convert(const GLuint* planes, bool nv12,
+                           ColorSpace color_space, ColorRange color_range,
+                           GLuint target, int width, int height) {
+    if (this->program == 0) {
+        return;
+    }
+
+    // Keep whatever state ImGui or the main loop had set up
+    GLint last_program, last_vao, last_fbo, last_active_texture;
+    GLint last_viewport[4];
+    glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &last_vao);
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &last_fbo);
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &last_active_texture);
+    glGetIntegerv(GL_VIEWPORT, last_viewport);
+    GLboolean last_blend = glIsEnabled(GL_BLEND);
+    GLboolean last_scissor = glIsEnabled(GL_SCISSOR_TEST);
+    GLboolean last_depth = glIsEnabled(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+    glDisable(GL_SCISSOR_TEST);
+    glDisable(GL_DEPTH_TEST);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target, 0);
+    glViewport(0, 0, width, height);
+
+    GLfloat matrix[9];
+    GLfloat offset[3];
+    build_matrix(color_space, color_range, matrix, offset);
+
+    glUseProgram(this->program);
+    glUniform1i(this->y_location, 0);
+    glUniform1i(this->u_location, 1);
+    glUniform1i(this->v_location, 2);
+    glUniform1i(this->nv12_location, nv12 ? 1 : 0);
+    glUniformMatrix3fv(this->matrix_location, 1, GL_FALSE, matrix);
+    glUniform3fv(this->offset_location, 1, offset);
+
+    int plane_count = nv12 ? 2 : 3;
+    for (int i = 0; i < plane_count; i++) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, planes[i]);
+    }
+
+    glBindVertexArray(this->vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    for (int i = plane_count - 1; i >= 0; i--) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+
+    glActiveTexture(last_active_texture);
+    glUseProgram(last_program);
+    glBindVertexArray(last_vao);
+    glBindFramebuffer(GL_FRAMEBUFFER, last_fbo);
+    glViewport(last_viewport[0], last_viewport[1], last_viewport[2], last_viewport[3]);
+    if (last_blend) glEnable(GL_BLEND);
+    if (last_scissor) glEnable(GL_SCISSOR_TEST);
+    if (last_depth) glEnable(GL_DEPTH_TEST);
+}
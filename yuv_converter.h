@@ -0,0 +1,36 @@
+#pragma once
+
+#include <GL/glew.h>
+
+enum class ColorSpace { BT601 = 0, BT709 = 1 };
+enum class ColorRange { LIMITED = 0, FULL = 1 };
+
+/**
+ * Converts Y/U/V (or Y/UV for NV12) plane textures into an RGBA texture
+ * with a fragment shader. Owns the GL program, so it must be created and
+ * used in the thread that owns the GL context.
+ */
+class YuvConverter {
+public:
+    YuvConverter(const char* glsl_version);
+    ~YuvConverter();
+
+    bool is_valid() const { return this->program != 0; }
+
+    // planes holds the Y, U and V textures, or Y and interleaved UV when nv12 is set.
+    // target must be a GL_RGBA texture of width x height.
+    void convert(const GLuint* planes, bool nv12,
+                 ColorSpace color_space, ColorRange color_range,
+                 GLuint target, int width, int height);
+
+private:
+    GLuint program;
+    GLuint vao;
+    GLuint fbo;
+    GLint y_location;
+    GLint u_location;
+    GLint v_location;
+    GLint nv12_location;
+    GLint matrix_location;
+    GLint offset_location;
+};
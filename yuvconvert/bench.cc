@@ -0,0 +1,145 @@
+// Compares the in-tree converters against otc_video_frame_convert for the
+// usual video resolutions. Usage: yuvconvert_bench [iterations]
+
+#include <opentok.h>
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "yuv_convert.h"
+
+using namespace std;
+
+struct Resolution {
+    const char* name;
+    int width;
+    int height;
+};
+
+static const Resolution resolutions[] = {
+    { "240p", 320, 240 },
+    { "360p", 640, 360 },
+    { "480p", 640, 480 },
+    { "720p", 1280, 720 },
+    { "1080p", 1920, 1080 },
+};
+
+typedef chrono::steady_clock Clock;
+
+template <typename F>
+static double time_per_frame_us(int iterations, F function) {
+    function();  // warm up caches and page in the destination
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        function();
+    }
+    chrono::duration<double, micro> elapsed = Clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 200;
+    if (iterations <= 0) {
+        iterations = 200;
+    }
+
+    YuvCpu best = yuv_detect_cpu();
+    printf("Best kernels on this CPU: %s, %d iterations per case\n\n", yuv_cpu_name(best), iterations);
+    printf("%-6s %-8s %12s %10s %10s\n", "size", "input", "converter", "us/frame", "speedup");
+
+    for (const Resolution& resolution : resolutions) {
+        int w = resolution.width;
+        int h = resolution.height;
+        int chroma_w = (w + 1) / 2;
+        int chroma_h = (h + 1) / 2;
+
+        vector<uint8_t> i420(w * h + 2 * chroma_w * chroma_h);
+        for (size_t i = 0; i < i420.size(); i++) {
+            i420[i] = static_cast<uint8_t>(rand());
+        }
+        uint8_t* y = i420.data();
+        uint8_t* u = y + w * h;
+        uint8_t* v = u + chroma_w * chroma_h;
+
+        vector<uint8_t> uv(chroma_w * 2 * chroma_h);
+        for (int i = 0; i < chroma_w * chroma_h; i++) {
+            uv[2 * i] = u[i];
+            uv[2 * i + 1] = v[i];
+        }
+
+        vector<uint8_t> bgra(w * h * 4);
+        vector<uint8_t> reference(w * h * 4);
+
+        otc_video_frame* frame = otc_video_frame_new(OTC_VIDEO_FRAME_FORMAT_YUV420P, w, h, i420.data());
+        double sdk_us = time_per_frame_us(iterations, [&]() {
+            otc_video_frame* converted = otc_video_frame_convert(OTC_VIDEO_FRAME_FORMAT_ARGB32, frame);
+            otc_video_frame_delete(converted);
+        });
+        otc_video_frame_delete(frame);
+        printf("%-6s %-8s %12s %10.1f %10s\n", resolution.name, "I420", "SDK", sdk_us, "1.00x");
+
+        yuv_set_cpu(YUV_CPU_SCALAR);
+        i420_to_bgra(y, w, u, chroma_w, v, chroma_w, reference.data(), w * 4, w, h);
+
+        for (int cpu = YUV_CPU_SCALAR; cpu <= best; cpu++) {
+            yuv_set_cpu(static_cast<YuvCpu>(cpu));
+            double i420_us = time_per_frame_us(iterations, [&]() {
+                i420_to_bgra(y, w, u, chroma_w, v, chroma_w, bgra.data(), w * 4, w, h);
+            });
+            bool i420_matches = bgra == reference;
+            double nv12_us = time_per_frame_us(iterations, [&]() {
+                nv12_to_bgra(y, w, uv.data(), chroma_w * 2, bgra.data(), w * 4, w, h);
+            });
+            bool nv12_matches = bgra == reference;
+
+            const char* name = yuv_cpu_name(static_cast<YuvCpu>(cpu));
+            printf("%-6s %-8s %12s %10.1f %9.2fx%s\n", resolution.name, "I420", name,
+                   i420_us, sdk_us / i420_us, i420_matches ? "" : "  MISMATCH");
+            printf("%-6s %-8s %12s %10.1f %9.2fx%s\n", resolution.name, "NV12", name,
+                   nv12_us, sdk_us / nv12_us, nv12_matches ? "" : "  MISMATCH");
+        }
+
+        // Fused conversion into a quarter size tile, as used for gallery views
+        int tile_w = w / 2;
+        int tile_h = h / 2;
+        vector<uint8_t> scratch(i420_to_bgra_scaled_scratch_size(w, tile_w));
+        yuv_set_cpu(best);
+        double scaled_us = time_per_frame_us(iterations, [&]() {
+            i420_to_bgra_scaled(y, w, u, chroma_w, v, chroma_w, w, h,
+                                bgra.data(), tile_w * 4, tile_w, tile_h, scratch.data());
+        });
+        printf("%-6s %-8s %12s %10.1f %9.2fx\n", resolution.name, "I420/2", "scaled",
+               scaled_us, sdk_us / scaled_us);
+
+        // Mild reductions cannot box filter, everything is bilinear
+        int mild_w = w * 3 / 4 & ~1;
+        int mild_h = h * 3 / 4 & ~1;
+        int mild_chroma_w = mild_w / 2;
+        int mild_chroma_h = mild_h / 2;
+        scratch.resize(max(i420_to_bgra_scaled_scratch_size(w, mild_w), scale_plane_scratch_size(w, h, mild_w)));
+        double mild_us = time_per_frame_us(iterations, [&]() {
+            i420_to_bgra_scaled(y, w, u, chroma_w, v, chroma_w, w, h,
+                                bgra.data(), mild_w * 4, mild_w, mild_h, scratch.data());
+        });
+        printf("%-6s %-8s %12s %10.1f %9.2fx\n", resolution.name, "I420*3/4", "scaled",
+               mild_us, sdk_us / mild_us);
+        vector<uint8_t> planes(mild_w * mild_h + 2 * mild_chroma_w * mild_chroma_h);
+        double planes_us = time_per_frame_us(iterations, [&]() {
+            uint8_t* out = planes.data();
+            scale_plane(y, w, w, h, out, mild_w, mild_w, mild_h, scratch.data());
+            out += mild_w * mild_h;
+            scale_plane(u, chroma_w, chroma_w, chroma_h, out, mild_chroma_w, mild_chroma_w, mild_chroma_h,
+                        scratch.data());
+            out += mild_chroma_w * mild_chroma_h;
+            scale_plane(v, chroma_w, chroma_w, chroma_h, out, mild_chroma_w, mild_chroma_w, mild_chroma_h,
+                        scratch.data());
+        });
+        printf("%-6s %-8s %12s %10.1f %9.2fx\n\n", resolution.name, "I420*3/4", "planes",
+               planes_us, sdk_us / planes_us);
+    }
+    return 0;
+}
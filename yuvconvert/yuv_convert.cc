@@ -0,0 +1,307 @@
+#include "yuv_convert.h"
+#include "yuv_convert_internal.h"
+
+#include <atomic>
+#include <string.h>
+
+static const YuvCoefficients coefficients[] = {
+    // y_offset, y_scale, vr, ug, vg, ub (6 fractional bits)
+    { 16, 75, 102, 25, 52, 129 },  // BT.601 limited
+    {  0, 64,  90, 22, 46, 113 },  // BT.601 full
+    { 16, 75, 115, 14, 34, 135 },  // BT.709 limited
+    {  0, 64, 101, 12, 30, 119 },  // BT.709 full
+};
+
+struct Kernels {
+    I420RowFunction i420_row;
+    NV12RowFunction nv12_row;
+    BoxHalveRowFunction box_halve_row;
+    BlendRowsFunction blend_rows;
+};
+
+static Kernels kernels_for(YuvCpu cpu) {
+    Kernels kernels = { i420_row_scalar, nv12_row_scalar, box_halve_row_scalar, blend_rows_scalar };
+#if defined(YUV_CONVERT_X86)
+    if (cpu == YUV_CPU_AVX2) {
+        kernels.i420_row = i420_row_avx2;
+        kernels.nv12_row = nv12_row_avx2;
+        kernels.box_halve_row = box_halve_row_sse2;
+        kernels.blend_rows = blend_rows_sse2;
+    } else if (cpu == YUV_CPU_SSE2) {
+        kernels.i420_row = i420_row_sse2;
+        kernels.nv12_row = nv12_row_sse2;
+        kernels.box_halve_row = box_halve_row_sse2;
+        kernels.blend_rows = blend_rows_sse2;
+    }
+#endif
+    return kernels;
+}
+
+YuvCpu yuv_detect_cpu() {
+#if defined(YUV_CONVERT_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return YUV_CPU_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return YUV_CPU_SSE2;
+    }
+#endif
+    return YUV_CPU_SCALAR;
+}
+
+static std::atomic<int> selected_cpu(-1);
+
+YuvCpu yuv_cpu() {
+    int cpu = selected_cpu.load(std::memory_order_relaxed);
+    if (cpu < 0) {
+        cpu = yuv_detect_cpu();
+        selected_cpu.store(cpu, std::memory_order_relaxed);
+    }
+    return static_cast<YuvCpu>(cpu);
+}
+
+void yuv_set_cpu(YuvCpu cpu) {
+    YuvCpu best = yuv_detect_cpu();
+    selected_cpu.store(cpu > best ? best : cpu, std::memory_order_relaxed);
+}
+
+const char* yuv_cpu_name(YuvCpu cpu) {
+    switch (cpu) {
+    case YUV_CPU_AVX2: return "AVX2";
+    case YUV_CPU_SSE2: return "SSE2";
+    default: return "scalar";
+    }
+}
+
+void i420_to_bgra(const uint8_t* y, int y_stride,
+                  const uint8_t* u, int u_stride,
+                  const uint8_t* v, int v_stride,
+                  uint8_t* dst, int dst_stride,
+                  int width, int height,
+                  YuvMatrix matrix) {
+    const Kernels kernels = kernels_for(yuv_cpu());
+    const YuvCoefficients* c = &coefficients[matrix];
+    for (int row = 0; row < height; row++) {
+        kernels.i420_row(y + row * y_stride,
+                         u + (row / 2) * u_stride,
+                         v + (row / 2) * v_stride,
+                         dst + row * dst_stride, width, c);
+    }
+}
+
+void nv12_to_bgra(const uint8_t* y, int y_stride,
+                  const uint8_t* uv, int uv_stride,
+                  uint8_t* dst, int dst_stride,
+                  int width, int height,
+                  YuvMatrix matrix) {
+    const Kernels kernels = kernels_for(yuv_cpu());
+    const YuvCoefficients* c = &coefficients[matrix];
+    for (int row = 0; row < height; row++) {
+        kernels.nv12_row(y + row * y_stride,
+                         uv + (row / 2) * uv_stride,
+                         dst + row * dst_stride, width, c);
+    }
+}
+
+// Bilinear sample positions use 16.16 fixed point
+static inline int source_position(int dst, int src_size, int dst_size) {
+    int64_t position = ((2 * static_cast<int64_t>(dst) + 1) * src_size * 65536) / (2 * dst_size) - 32768;
+    return position < 0 ? 0 : static_cast<int>(position);
+}
+
+// Horizontal bilinear taps, computed once per call rather than per pixel:
+// the left source sample of each output pixel and the right one's weight
+struct Taps {
+    int32_t* index;
+    uint16_t* weight;
+};
+
+static size_t taps_size(int dst_width) {
+    // Rounded up so the next set of taps stays aligned as well
+    return (static_cast<size_t>(dst_width) * (sizeof(int32_t) + sizeof(uint16_t)) + 3) & ~static_cast<size_t>(3);
+}
+
+// Carves taps for dst_width pixels off the front of scratch, which must be 4 byte aligned
+static Taps make_taps(uint8_t** scratch, int src_width, int dst_width) {
+    Taps taps;
+    taps.index = reinterpret_cast<int32_t*>(*scratch);
+    taps.weight = reinterpret_cast<uint16_t*>(*scratch + dst_width * sizeof(int32_t));
+    *scratch += taps_size(dst_width);
+    for (int x = 0; x < dst_width; x++) {
+        int sx = source_position(x, src_width, dst_width);
+        taps.index[x] = sx >> 16;
+        taps.weight[x] = static_cast<uint16_t>((sx >> 8) & 0xff);
+    }
+    return taps;
+}
+
+// Callers may hand in any pointer, the taps want it aligned
+static const size_t SCRATCH_ALIGNMENT = 16;
+
+static uint8_t* align_scratch(uint8_t* scratch) {
+    uintptr_t address = reinterpret_cast<uintptr_t>(scratch);
+    return scratch + ((SCRATCH_ALIGNMENT - address % SCRATCH_ALIGNMENT) % SCRATCH_ALIGNMENT);
+}
+
+// Resamples row dst_row of a src_width x src_height plane into out (dst_width bytes).
+// tmp must hold src_width + 1 bytes.
+static void scale_row(const Kernels& kernels, const Taps& taps,
+                      const uint8_t* src, int src_stride, int src_width, int src_height,
+                      int dst_width, int dst_height, int dst_row, uint8_t* tmp, uint8_t* out) {
+    int sy = source_position(dst_row, src_height, dst_height);
+    int y0 = sy >> 16;
+    int y1 = y0 + 1 < src_height ? y0 + 1 : y0;
+    int fy = (sy >> 8) & 0xff;
+
+    const uint8_t* row0 = src + y0 * src_stride;
+    if (fy == 0) {
+        memcpy(tmp, row0, src_width);
+    } else {
+        kernels.blend_rows(row0, src + y1 * src_stride, tmp, src_width, fy);
+    }
+    // The last pixel's right neighbour is itself
+    tmp[src_width] = tmp[src_width - 1];
+
+    for (int x = 0; x < dst_width; x++) {
+        const uint8_t* pair = tmp + taps.index[x];
+        int fx = taps.weight[x];
+        out[x] = static_cast<uint8_t>((pair[0] * (256 - fx) + pair[1] * fx + 128) >> 8);
+    }
+}
+
+size_t i420_to_bgra_scaled_scratch_size(int src_width, int dst_width) {
+    // Taps for both plane sizes, one temporary source row plus one output row per plane
+    int dst_chroma_width = (dst_width + 1) / 2;
+    return SCRATCH_ALIGNMENT + taps_size(dst_width) + taps_size(dst_chroma_width) +
+           src_width + 1 + dst_width + 2 * dst_chroma_width;
+}
+
+void i420_to_bgra_scaled(const uint8_t* y, int y_stride,
+                         const uint8_t* u, int u_stride,
+                         const uint8_t* v, int v_stride,
+                         int src_width, int src_height,
+                         uint8_t* dst, int dst_stride,
+                         int dst_width, int dst_height,
+                         uint8_t* scratch,
+                         YuvMatrix matrix) {
+    if (src_width == dst_width && src_height == dst_height) {
+        i420_to_bgra(y, y_stride, u, u_stride, v, v_stride, dst, dst_stride, dst_width, dst_height, matrix);
+        return;
+    }
+
+    const Kernels kernels = kernels_for(yuv_cpu());
+    const YuvCoefficients* c = &coefficients[matrix];
+
+    int src_chroma_width = (src_width + 1) / 2;
+    int src_chroma_height = (src_height + 1) / 2;
+    int dst_chroma_width = (dst_width + 1) / 2;
+    int dst_chroma_height = (dst_height + 1) / 2;
+
+    scratch = align_scratch(scratch);
+    Taps luma_taps = make_taps(&scratch, src_width, dst_width);
+    Taps chroma_taps = make_taps(&scratch, src_chroma_width, dst_chroma_width);
+    uint8_t* tmp = scratch;
+    uint8_t* y_row = tmp + src_width + 1;
+    uint8_t* u_row = y_row + dst_width;
+    uint8_t* v_row = u_row + dst_chroma_width;
+
+    int last_chroma_row = -1;
+    for (int row = 0; row < dst_height; row++) {
+        scale_row(kernels, luma_taps, y, y_stride, src_width, src_height, dst_width, dst_height, row, tmp, y_row);
+        if (row / 2 != last_chroma_row) {
+            last_chroma_row = row / 2;
+            scale_row(kernels, chroma_taps, u, u_stride, src_chroma_width, src_chroma_height,
+                      dst_chroma_width, dst_chroma_height, last_chroma_row, tmp, u_row);
+            scale_row(kernels, chroma_taps, v, v_stride, src_chroma_width, src_chroma_height,
+                      dst_chroma_width, dst_chroma_height, last_chroma_row, tmp, v_row);
+        }
+        kernels.i420_row(y_row, u_row, v_row, dst + row * dst_stride, dst_width, c);
+    }
+}
+
+size_t scale_plane_scratch_size(int src_width, int src_height, int dst_width) {
+    // Taps and the temporary row used by bilinear sampling, plus the first halving pass
+    return SCRATCH_ALIGNMENT + taps_size(dst_width) + src_width + 1 +
+           static_cast<size_t>(src_width / 2) * (src_height / 2);
+}
+
+void scale_plane(const uint8_t* src, int src_stride, int src_width, int src_height,
+                 uint8_t* dst, int dst_stride, int dst_width, int dst_height,
+                 uint8_t* scratch) {
+    const Kernels kernels = kernels_for(yuv_cpu());
+
+    // Halve into scratch while we are at least 2x too big, after the first
+    // pass the rows are compacted and later passes run in place
+    scratch = align_scratch(scratch);
+    uint8_t* tmp = scratch + taps_size(dst_width);
+    uint8_t* halved = tmp + src_width + 1;
+    while (src_width >= 2 * dst_width && src_height >= 2 * dst_height) {
+        int half_width = src_width / 2;
+        int half_height = src_height / 2;
+        for (int row = 0; row < half_height; row++) {
+            kernels.box_halve_row(src + 2 * row * src_stride, src + (2 * row + 1) * src_stride,
+                                  halved + row * half_width, half_width);
+        }
+        src = halved;
+        src_stride = half_width;
+        src_width = half_width;
+        src_height = half_height;
+    }
+
+    if (src_width == dst_width && src_height == dst_height) {
+        for (int row = 0; row < dst_height; row++) {
+            memcpy(dst + row * dst_stride, src + row * src_stride, dst_width);
+        }
+        return;
+    }
+    Taps taps = make_taps(&scratch, src_width, dst_width);
+    for (int row = 0; row < dst_height; row++) {
+        scale_row(kernels, taps, src, src_stride, src_width, src_height, dst_width, dst_height, row,
+                  tmp, dst + row * dst_stride);
+    }
+}
+
+void split_uv_plane(const uint8_t* uv, int uv_stride,
+                    uint8_t* u, int u_stride, uint8_t* v, int v_stride,
+                    int width, int height) {
+    for (int row = 0; row < height; row++) {
+        const uint8_t* pairs = uv + row * uv_stride;
+        uint8_t* u_row = u + row * u_stride;
+        uint8_t* v_row = v + row * v_stride;
+        for (int x = 0; x < width; x++) {
+            u_row[x] = pairs[2 * x];
+            v_row[x] = pairs[2 * x + 1];
+        }
+    }
+}
+
+void bgra_to_i420(const uint8_t* src, int src_stride,
+                  uint8_t* y, int y_stride,
+                  uint8_t* u, int u_stride,
+                  uint8_t* v, int v_stride,
+                  int width, int height) {
+    for (int row = 0; row < height; row++) {
+        const uint8_t* pixel = src + row * src_stride;
+        uint8_t* y_row = y + row * y_stride;
+        for (int x = 0; x < width; x++, pixel += 4) {
+            y_row[x] = static_cast<uint8_t>(((66 * pixel[2] + 129 * pixel[1] + 25 * pixel[0] + 128) >> 8) + 16);
+        }
+    }
+    // Chroma from the average of each 2x2 block, edge pixels repeat on odd sizes
+    for (int row = 0; row < (height + 1) / 2; row++) {
+        const uint8_t* top = src + 2 * row * src_stride;
+        const uint8_t* bottom = 2 * row + 1 < height ? top + src_stride : top;
+        uint8_t* u_row = u + row * u_stride;
+        uint8_t* v_row = v + row * v_stride;
+        for (int x = 0; x < (width + 1) / 2; x++) {
+            int left = 8 * x;
+            int right = 2 * x + 1 < width ? left + 4 : left;
+            int b = top[left] + top[right] + bottom[left] + bottom[right];
+            int g = top[left + 1] + top[right + 1] + bottom[left + 1] + bottom[right + 1];
+            int r = top[left + 2] + top[right + 2] + bottom[left + 2] + bottom[right + 2];
+            u_row[x] = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128);
+            v_row[x] = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 512) >> 10) + 128);
+        }
+    }
+}
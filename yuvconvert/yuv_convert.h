@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * YUV to BGRA conversion (BGRA in memory, which is what the SDK calls
+ * ARGB32). Every entry point dispatches at runtime to the best kernel the
+ * CPU supports: AVX2, SSE2 or plain C.
+ */
+
+enum YuvMatrix {
+    YUV_MATRIX_BT601_LIMITED = 0,
+    YUV_MATRIX_BT601_FULL = 1,
+    YUV_MATRIX_BT709_LIMITED = 2,
+    YUV_MATRIX_BT709_FULL = 3,
+};
+
+enum YuvCpu {
+    YUV_CPU_SCALAR = 0,
+    YUV_CPU_SSE2 = 1,
+    YUV_CPU_AVX2 = 2,
+};
+
+// Best kernel set available on this CPU
+YuvCpu yuv_detect_cpu();
+// Kernel set currently in use
+YuvCpu yuv_cpu();
+// Forces a kernel set, e.g. for benchmarks. Requests above what the CPU supports are clamped.
+void yuv_set_cpu(YuvCpu cpu);
+const char* yuv_cpu_name(YuvCpu cpu);
+
+void i420_to_bgra(const uint8_t* y, int y_stride,
+                  const uint8_t* u, int u_stride,
+                  const uint8_t* v, int v_stride,
+                  uint8_t* dst, int dst_stride,
+                  int width, int height,
+                  YuvMatrix matrix = YUV_MATRIX_BT601_LIMITED);
+
+void nv12_to_bgra(const uint8_t* y, int y_stride,
+                  const uint8_t* uv, int uv_stride,
+                  uint8_t* dst, int dst_stride,
+                  int width, int height,
+                  YuvMatrix matrix = YUV_MATRIX_BT601_LIMITED);
+
+// Bytes of scratch memory i420_to_bgra_scaled() needs
+size_t i420_to_bgra_scaled_scratch_size(int src_width, int dst_width);
+
+// Bilinear scaling fused with conversion: source rows are resampled one at
+// a time into scratch and converted straight into dst, so no intermediate
+// scaled frame is ever written.
+void i420_to_bgra_scaled(const uint8_t* y, int y_stride,
+                         const uint8_t* u, int u_stride,
+                         const uint8_t* v, int v_stride,
+                         int src_width, int src_height,
+                         uint8_t* dst, int dst_stride,
+                         int dst_width, int dst_height,
+                         uint8_t* scratch,
+                         YuvMatrix matrix = YUV_MATRIX_BT601_LIMITED);
+
+// Bytes of scratch memory scale_plane() needs
+size_t scale_plane_scratch_size(int src_width, int src_height, int dst_width);
+
+// Downscales (or upscales) a single 8 bit plane. Large reductions go through
+// repeated 2x2 box filtering first, which does not alias the way plain
+// bilinear sampling does, and the remaining ratio is covered by bilinear.
+void scale_plane(const uint8_t* src, int src_stride, int src_width, int src_height,
+                 uint8_t* dst, int dst_stride, int dst_width, int dst_height,
+                 uint8_t* scratch);
+
+// Splits an interleaved UV plane into separate U and V planes
+void split_uv_plane(const uint8_t* uv, int uv_stride,
+                    uint8_t* u, int u_stride, uint8_t* v, int v_stride,
+                    int width, int height);
+
+// BGRA (the SDK's ARGB32) to limited range BT.601 I420. Plain C, meant for
+// recording and test sources rather than the render path.
+void bgra_to_i420(const uint8_t* src, int src_stride,
+                  uint8_t* y, int y_stride,
+                  uint8_t* u, int u_stride,
+                  uint8_t* v, int v_stride,
+                  int width, int height);
@@ -0,0 +1,120 @@
+#include "yuv_convert_internal.h"
+
+#if defined(YUV_CONVERT_X86)
+
+#include <immintrin.h>
+
+struct Avx2Coefficients {
+    __m256i y_offset;
+    __m256i y_scale;
+    __m256i vr;
+    __m256i ug;
+    __m256i vg;
+    __m256i ub;
+    __m256i round;
+    __m128i bias;
+};
+
+static inline Avx2Coefficients load_coefficients(const YuvCoefficients* c) {
+    Avx2Coefficients k;
+    k.y_offset = _mm256_set1_epi16(c->y_offset);
+    k.y_scale = _mm256_set1_epi16(c->y_scale);
+    k.vr = _mm256_set1_epi16(c->vr);
+    k.ug = _mm256_set1_epi16(c->ug);
+    k.vg = _mm256_set1_epi16(c->vg);
+    k.ub = _mm256_set1_epi16(c->ub);
+    k.round = _mm256_set1_epi16(32);
+    k.bias = _mm_set1_epi16(128);
+    return k;
+}
+
+// Doubles 8 chroma samples (16 bit lanes) into 16 lanes in pixel order
+static inline __m256i double_chroma(__m128i c) {
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(c, c)),
+                                   _mm_unpackhi_epi16(c, c), 1);
+}
+
+// 16 pixels in 16 bit lanes, in pixel order
+static inline void yuv_to_rgb_16(const uint8_t* y, __m128i u, __m128i v, const Avx2Coefficients& k,
+                                 __m256i* r, __m256i* g, __m256i* b) {
+    __m256i luma = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(y)));
+    __m256i u16 = double_chroma(_mm_sub_epi16(u, k.bias));
+    __m256i v16 = double_chroma(_mm_sub_epi16(v, k.bias));
+
+    luma = _mm256_adds_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(luma, k.y_offset), k.y_scale), k.round);
+    *r = _mm256_srai_epi16(_mm256_adds_epi16(luma, _mm256_mullo_epi16(v16, k.vr)), 6);
+    *g = _mm256_srai_epi16(_mm256_subs_epi16(_mm256_subs_epi16(luma, _mm256_mullo_epi16(u16, k.ug)),
+                                             _mm256_mullo_epi16(v16, k.vg)), 6);
+    *b = _mm256_srai_epi16(_mm256_adds_epi16(luma, _mm256_mullo_epi16(u16, k.ub)), 6);
+}
+
+// Packs two runs of 16 pixels (a = pixels 0-15, b = pixels 16-31) into 32 BGRA pixels
+static inline void store_bgra_32(__m256i r_a, __m256i g_a, __m256i b_a,
+                                 __m256i r_b, __m256i g_b, __m256i b_b, uint8_t* dst) {
+    const __m256i alpha = _mm256_set1_epi8(-1);
+
+    // packus works per 128 bit lane: [a0-7 b0-7 | a8-15 b8-15]
+    __m256i r = _mm256_packus_epi16(r_a, r_b);
+    __m256i g = _mm256_packus_epi16(g_a, g_b);
+    __m256i b = _mm256_packus_epi16(b_a, b_b);
+
+    // lane 0 holds a0-7 / a8-15, lane 1 holds b0-7 / b8-15 after the unpacks below
+    __m256i bg_a = _mm256_unpacklo_epi8(b, g);
+    __m256i bg_b = _mm256_unpackhi_epi8(b, g);
+    __m256i ra_a = _mm256_unpacklo_epi8(r, alpha);
+    __m256i ra_b = _mm256_unpackhi_epi8(r, alpha);
+
+    __m256i a_lo = _mm256_unpacklo_epi16(bg_a, ra_a);  // a0-3  | a8-11
+    __m256i a_hi = _mm256_unpackhi_epi16(bg_a, ra_a);  // a4-7  | a12-15
+    __m256i b_lo = _mm256_unpacklo_epi16(bg_b, ra_b);  // b0-3  | b8-11
+    __m256i b_hi = _mm256_unpackhi_epi16(bg_b, ra_b);  // b4-7  | b12-15
+
+    __m256i* out = reinterpret_cast<__m256i*>(dst);
+    _mm256_storeu_si256(out + 0, _mm256_permute2x128_si256(a_lo, a_hi, 0x20));
+    _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(a_lo, a_hi, 0x31));
+    _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(b_lo, b_hi, 0x20));
+    _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(b_lo, b_hi, 0x31));
+}
+
+static inline __m128i load_chroma_8(const uint8_t* c) {
+    return _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(c)));
+}
+
+void i420_row_avx2(const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                   uint8_t* dst, int width, const YuvCoefficients* c) {
+    const Avx2Coefficients k = load_coefficients(c);
+
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i r_a, g_a, b_a, r_b, g_b, b_b;
+        yuv_to_rgb_16(y + x, load_chroma_8(u + x / 2), load_chroma_8(v + x / 2), k, &r_a, &g_a, &b_a);
+        yuv_to_rgb_16(y + x + 16, load_chroma_8(u + x / 2 + 8), load_chroma_8(v + x / 2 + 8), k, &r_b, &g_b, &b_b);
+        store_bgra_32(r_a, g_a, b_a, r_b, g_b, b_b, dst + x * 4);
+    }
+    _mm256_zeroupper();
+    if (x < width) {
+        i420_row_sse2(y + x, u + x / 2, v + x / 2, dst + x * 4, width - x, c);
+    }
+}
+
+void nv12_row_avx2(const uint8_t* y, const uint8_t* uv,
+                   uint8_t* dst, int width, const YuvCoefficients* c) {
+    const Avx2Coefficients k = load_coefficients(c);
+    const __m128i low_bytes = _mm_set1_epi16(0x00ff);
+
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m128i pairs_a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(uv + x));
+        __m128i pairs_b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(uv + x + 16));
+        __m256i r_a, g_a, b_a, r_b, g_b, b_b;
+        yuv_to_rgb_16(y + x, _mm_and_si128(pairs_a, low_bytes), _mm_srli_epi16(pairs_a, 8), k, &r_a, &g_a, &b_a);
+        yuv_to_rgb_16(y + x + 16, _mm_and_si128(pairs_b, low_bytes), _mm_srli_epi16(pairs_b, 8), k, &r_b, &g_b, &b_b);
+        store_bgra_32(r_a, g_a, b_a, r_b, g_b, b_b, dst + x * 4);
+    }
+    _mm256_zeroupper();
+    if (x < width) {
+        nv12_row_sse2(y + x, uv + x, dst + x * 4, width - x, c);
+    }
+}
+
+#endif
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+// Fixed point coefficients with 6 fractional bits. The values are small
+// enough for 16 bit SIMD lanes, anything that saturates would be clamped
+// to 0 or 255 anyway, so every kernel produces the same bytes.
+struct YuvCoefficients {
+    int16_t y_offset;
+    int16_t y_scale;
+    int16_t vr;
+    int16_t ug;
+    int16_t vg;
+    int16_t ub;
+};
+
+typedef void (*I420RowFunction)(const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                                 uint8_t* dst, int width, const YuvCoefficients* c);
+typedef void (*NV12RowFunction)(const uint8_t* y, const uint8_t* uv,
+                                uint8_t* dst, int width, const YuvCoefficients* c);
+// Averages 2x2 blocks of two source rows into dst_width bytes
+typedef void (*BoxHalveRowFunction)(const uint8_t* row0, const uint8_t* row1,
+                                    uint8_t* dst, int dst_width);
+// dst = (row0 * (256 - weight) + row1 * weight + 128) >> 8, weight in 0..255
+typedef void (*BlendRowsFunction)(const uint8_t* row0, const uint8_t* row1,
+                                  uint8_t* dst, int width, int weight);
+
+void i420_row_scalar(const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                     uint8_t* dst, int width, const YuvCoefficients* c);
+void nv12_row_scalar(const uint8_t* y, const uint8_t* uv,
+                     uint8_t* dst, int width, const YuvCoefficients* c);
+void box_halve_row_scalar(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int dst_width);
+void blend_rows_scalar(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int width, int weight);
+
+#if defined(__x86_64__) || defined(__i386__)
+#define YUV_CONVERT_X86 1
+void i420_row_sse2(const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                   uint8_t* dst, int width, const YuvCoefficients* c);
+void nv12_row_sse2(const uint8_t* y, const uint8_t* uv,
+                   uint8_t* dst, int width, const YuvCoefficients* c);
+void box_halve_row_sse2(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int dst_width);
+void blend_rows_sse2(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int width, int weight);
+void i420_row_avx2(const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                   uint8_t* dst, int width, const YuvCoefficients* c);
+void nv12_row_avx2(const uint8_t* y, const uint8_t* uv,
+                   uint8_t* dst, int width, const YuvCoefficients* c);
+#endif
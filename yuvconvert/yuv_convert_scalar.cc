@@ -0,0 +1,46 @@
+#include "yuv_convert_internal.h"
+
+static inline uint8_t clamp_pixel(int value) {
+    value >>= 6;
+    return value < 0 ? 0 : (value > 255 ? 255 : static_cast<uint8_t>(value));
+}
+
+static inline void yuv_pixel(int y, int u, int v, uint8_t* dst, const YuvCoefficients* c) {
+    int luma = (y - c->y_offset) * c->y_scale + 32;
+    u -= 128;
+    v -= 128;
+    dst[0] = clamp_pixel(luma + c->ub * u);
+    dst[1] = clamp_pixel(luma - c->ug * u - c->vg * v);
+    dst[2] = clamp_pixel(luma + c->vr * v);
+    dst[3] = 255;
+}
+
+void i420_row_scalar(const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                     uint8_t* dst, int width, const YuvCoefficients* c) {
+    for (int x = 0; x < width; x++) {
+        yuv_pixel(y[x], u[x >> 1], v[x >> 1], dst + x * 4, c);
+    }
+}
+
+void nv12_row_scalar(const uint8_t* y, const uint8_t* uv,
+                     uint8_t* dst, int width, const YuvCoefficients* c) {
+    for (int x = 0; x < width; x++) {
+        int pair = (x >> 1) * 2;
+        yuv_pixel(y[x], uv[pair], uv[pair + 1], dst + x * 4, c);
+    }
+}
+
+void box_halve_row_scalar(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int dst_width) {
+    // Average of averages, the same rounding as pavgb in the SIMD version
+    for (int x = 0; x < dst_width; x++) {
+        int left = (row0[2 * x] + row1[2 * x] + 1) >> 1;
+        int right = (row0[2 * x + 1] + row1[2 * x + 1] + 1) >> 1;
+        dst[x] = static_cast<uint8_t>((left + right + 1) >> 1);
+    }
+}
+
+void blend_rows_scalar(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int width, int weight) {
+    for (int x = 0; x < width; x++) {
+        dst[x] = static_cast<uint8_t>((row0[x] * (256 - weight) + row1[x] * weight + 128) >> 8);
+    }
+}
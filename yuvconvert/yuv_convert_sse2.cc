@@ -0,0 +1,149 @@
+#include "yuv_convert_internal.h"
+
+#if defined(YUV_CONVERT_X86)
+
+#include <emmintrin.h>
+
+struct Sse2Coefficients {
+    __m128i y_offset;
+    __m128i y_scale;
+    __m128i vr;
+    __m128i ug;
+    __m128i vg;
+    __m128i ub;
+    __m128i round;
+    __m128i bias;
+};
+
+static inline Sse2Coefficients load_coefficients(const YuvCoefficients* c) {
+    Sse2Coefficients k;
+    k.y_offset = _mm_set1_epi16(c->y_offset);
+    k.y_scale = _mm_set1_epi16(c->y_scale);
+    k.vr = _mm_set1_epi16(c->vr);
+    k.ug = _mm_set1_epi16(c->ug);
+    k.vg = _mm_set1_epi16(c->vg);
+    k.ub = _mm_set1_epi16(c->ub);
+    k.round = _mm_set1_epi16(32);
+    k.bias = _mm_set1_epi16(128);
+    return k;
+}
+
+// 8 pixels worth of 16 bit lanes, u and v already doubled horizontally
+static inline void yuv_to_rgb_8(__m128i y, __m128i u, __m128i v, const Sse2Coefficients& k,
+                                __m128i* r, __m128i* g, __m128i* b) {
+    y = _mm_adds_epi16(_mm_mullo_epi16(_mm_sub_epi16(y, k.y_offset), k.y_scale), k.round);
+    *r = _mm_srai_epi16(_mm_adds_epi16(y, _mm_mullo_epi16(v, k.vr)), 6);
+    *g = _mm_srai_epi16(_mm_subs_epi16(_mm_subs_epi16(y, _mm_mullo_epi16(u, k.ug)),
+                                       _mm_mullo_epi16(v, k.vg)), 6);
+    *b = _mm_srai_epi16(_mm_adds_epi16(y, _mm_mullo_epi16(u, k.ub)), 6);
+}
+
+// 16 pixels: 16 luma bytes and 8 chroma samples per channel as 16 bit lanes minus 128
+static inline void yuv_to_bgra_16(__m128i y8, __m128i u, __m128i v,
+                                  uint8_t* dst, const Sse2Coefficients& k) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi8(-1);
+
+    __m128i r_lo, g_lo, b_lo, r_hi, g_hi, b_hi;
+    yuv_to_rgb_8(_mm_unpacklo_epi8(y8, zero), _mm_unpacklo_epi16(u, u), _mm_unpacklo_epi16(v, v),
+                 k, &r_lo, &g_lo, &b_lo);
+    yuv_to_rgb_8(_mm_unpackhi_epi8(y8, zero), _mm_unpackhi_epi16(u, u), _mm_unpackhi_epi16(v, v),
+                 k, &r_hi, &g_hi, &b_hi);
+
+    __m128i r = _mm_packus_epi16(r_lo, r_hi);
+    __m128i g = _mm_packus_epi16(g_lo, g_hi);
+    __m128i b = _mm_packus_epi16(b_lo, b_hi);
+
+    __m128i bg_lo = _mm_unpacklo_epi8(b, g);
+    __m128i bg_hi = _mm_unpackhi_epi8(b, g);
+    __m128i ra_lo = _mm_unpacklo_epi8(r, alpha);
+    __m128i ra_hi = _mm_unpackhi_epi8(r, alpha);
+
+    __m128i* out = reinterpret_cast<__m128i*>(dst);
+    _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(bg_lo, ra_lo));
+    _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(bg_lo, ra_lo));
+    _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(bg_hi, ra_hi));
+    _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(bg_hi, ra_hi));
+}
+
+void i420_row_sse2(const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                   uint8_t* dst, int width, const YuvCoefficients* c) {
+    const Sse2Coefficients k = load_coefficients(c);
+    const __m128i zero = _mm_setzero_si128();
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i y8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + x));
+        __m128i u16 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(u + x / 2)), zero);
+        __m128i v16 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(v + x / 2)), zero);
+        yuv_to_bgra_16(y8, _mm_sub_epi16(u16, k.bias), _mm_sub_epi16(v16, k.bias), dst + x * 4, k);
+    }
+    if (x < width) {
+        i420_row_scalar(y + x, u + x / 2, v + x / 2, dst + x * 4, width - x, c);
+    }
+}
+
+void nv12_row_sse2(const uint8_t* y, const uint8_t* uv,
+                   uint8_t* dst, int width, const YuvCoefficients* c) {
+    const Sse2Coefficients k = load_coefficients(c);
+    const __m128i low_bytes = _mm_set1_epi16(0x00ff);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i y8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + x));
+        __m128i pairs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(uv + x));
+        __m128i u16 = _mm_and_si128(pairs, low_bytes);
+        __m128i v16 = _mm_srli_epi16(pairs, 8);
+        yuv_to_bgra_16(y8, _mm_sub_epi16(u16, k.bias), _mm_sub_epi16(v16, k.bias), dst + x * 4, k);
+    }
+    if (x < width) {
+        nv12_row_scalar(y + x, uv + x, dst + x * 4, width - x, c);
+    }
+}
+
+void box_halve_row_sse2(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int dst_width) {
+    const __m128i low_bytes = _mm_set1_epi16(0x00ff);
+
+    // Safe to run in place (dst == row0) since every chunk is read before it is written
+    int x = 0;
+    for (; x + 16 <= dst_width; x += 16) {
+        __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 2 * x));
+        __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 2 * x + 16));
+        __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 2 * x));
+        __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 2 * x + 16));
+        __m128i v0 = _mm_avg_epu8(a0, b0);
+        __m128i v1 = _mm_avg_epu8(a1, b1);
+        __m128i h0 = _mm_avg_epu16(_mm_and_si128(v0, low_bytes), _mm_srli_epi16(v0, 8));
+        __m128i h1 = _mm_avg_epu16(_mm_and_si128(v1, low_bytes), _mm_srli_epi16(v1, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(h0, h1));
+    }
+    if (x < dst_width) {
+        box_halve_row_scalar(row0 + 2 * x, row1 + 2 * x, dst + x, dst_width - x);
+    }
+}
+
+void blend_rows_sse2(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int width, int weight) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weight0 = _mm_set1_epi16(static_cast<short>(256 - weight));
+    const __m128i weight1 = _mm_set1_epi16(static_cast<short>(weight));
+    const __m128i round = _mm_set1_epi16(128);
+
+    // The weighted sum is at most 255 * 256 + 128, so it fits unsigned 16 bit lanes
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), weight0),
+                                   _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), weight1));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), weight0),
+                                   _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), weight1));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, round), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, round), 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(lo, hi));
+    }
+    if (x < width) {
+        blend_rows_scalar(row0 + x, row1 + x, dst + x, width - x, weight);
+    }
+}
+
+#endif